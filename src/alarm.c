@@ -0,0 +1,413 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/gpio.h>
+#include <shell/shell.h>
+
+#include "alarm.h"
+#include "ble.h"
+#include "channels.h"
+#include "fxp.h"
+#include "gui.h"
+#include "latency.h"
+#include "record.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(alarm, CONFIG_APP_ALARM_LOG_LEVEL);
+
+#define ALARM_THREAD_STACK_SIZE 1024
+#define ALARM_THREAD_PRIORITY K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
+#define ALARM_QUEUE_SIZE 8
+
+#define ALARM_MINUTE_MS (60 * MSEC_PER_SEC)
+#define ALARM_RATE_SPAN_MS (30 * MSEC_PER_SEC) /* min. age of the rate reference */
+#define ALARM_BUZZER_MS 1000				   /* beep on each raised alarm */
+
+#if DT_NODE_EXISTS(DT_ALIAS(alarm_led))
+#define ALARM_LED DT_ALIAS(alarm_led)
+#else
+#define ALARM_LED DT_ALIAS(led0)
+#endif
+#define ALARM_BUZZER DT_ALIAS(buzzer)
+
+enum alarm_kind
+{
+	ALARM_KIND_LEVEL,
+	ALARM_KIND_RATE,
+	ALARM_KIND_DURATION,
+};
+
+/* Rules, in the order of importance (the banner shows the first active
+ * one). A threshold of 0 disables the rule.
+*/
+static const struct
+{
+	const char *text; /* static, for the banner */
+	enum record_channel channel;
+	enum alarm_kind kind;
+	fxp_t threshold; /* level, or rise per minute */
+	fxp_t hysteresis;
+	uint32_t duration_ms;
+} rules[ALARM_COUNT] = {
+	[ALARM_CO2_HIGH] = {
+		.text = "eCO2 high - ventilate!",
+		.channel = RECORD_CHAN_CO2,
+		.kind = ALARM_KIND_LEVEL,
+		.threshold = CONFIG_APP_ALARM_CO2_HIGH * FXP_SCALE,
+		.hysteresis = CONFIG_APP_ALARM_CO2_HIGH * FXP_SCALE / 10,
+	},
+	[ALARM_TVOC_HIGH] = {
+		.text = "TVOC high - ventilate!",
+		.channel = RECORD_CHAN_TVOC,
+		.kind = ALARM_KIND_LEVEL,
+		.threshold = CONFIG_APP_ALARM_TVOC_HIGH * FXP_SCALE,
+		.hysteresis = CONFIG_APP_ALARM_TVOC_HIGH * FXP_SCALE / 10,
+	},
+	[ALARM_CO2_RISING] = {
+		.text = "eCO2 rising fast",
+		.channel = RECORD_CHAN_CO2,
+		.kind = ALARM_KIND_RATE,
+		.threshold = CONFIG_APP_ALARM_CO2_RISE * FXP_SCALE,
+		.hysteresis = CONFIG_APP_ALARM_CO2_RISE * FXP_SCALE / 2,
+	},
+	[ALARM_CO2_SUSTAINED] = {
+		.text = "eCO2 elevated for long",
+		.channel = RECORD_CHAN_CO2,
+		.kind = ALARM_KIND_DURATION,
+		.threshold = CONFIG_APP_ALARM_CO2_SUSTAINED * FXP_SCALE,
+		.hysteresis = CONFIG_APP_ALARM_CO2_SUSTAINED * FXP_SCALE / 10,
+		.duration_ms = CONFIG_APP_ALARM_CO2_SUSTAINED_MIN * ALARM_MINUTE_MS,
+	},
+};
+
+BUILD_ASSERT(ALARM_COUNT <= 32, "Too many alarms for the active mask");
+
+/* Rule state: Each rule watches the channel of a single sensor, so its
+ * state is only touched by that sensor's acquisition thread.
+*/
+struct alarm_state
+{
+	bool active;
+	uint8_t count; /* consecutive samples towards a state change */
+	bool above;	   /* duration: at or above the threshold since ... */
+	uint32_t above_since;
+	bool primed; /* rate: references valid */
+	fxp_t ref_value;
+	uint32_t ref_time;
+	fxp_t next_value;
+	uint32_t next_time;
+};
+
+static struct alarm_state states[ALARM_COUNT];
+
+static atomic_t active_alarms = ATOMIC_INIT(0);
+
+struct alarm_event
+{
+	uint32_t start; /* latency_start() on publishing the sample */
+	fxp_t value;
+	uint8_t id;
+	bool active;
+};
+
+K_MSGQ_DEFINE(alarm_msgq, sizeof(struct alarm_event), ALARM_QUEUE_SIZE, 4);
+
+static K_THREAD_STACK_DEFINE(alarm_thread_stack, ALARM_THREAD_STACK_SIZE);
+static struct k_thread alarm_thread_data;
+
+/* Alarm outputs (GPIO, active level from the devicetree)
+*/
+struct alarm_output
+{
+	const struct device *dev;
+	gpio_pin_t pin;
+};
+
+static struct alarm_output led;
+static struct alarm_output buzzer;
+static struct k_delayed_work buzzer_work;
+
+static void output_init(struct alarm_output *out, const char *label, gpio_pin_t pin, gpio_flags_t flags)
+{
+	out->dev = device_get_binding(label);
+	out->pin = pin;
+	if (out->dev != NULL && gpio_pin_configure(out->dev, pin, GPIO_OUTPUT_INACTIVE | flags) != 0)
+	{
+		out->dev = NULL;
+	}
+}
+
+static void output_set(struct alarm_output *out, bool on)
+{
+	if (out->dev != NULL)
+	{
+		gpio_pin_set(out->dev, out->pin, on);
+	}
+}
+
+static void buzzer_off(struct k_work *work)
+{
+	output_set(&buzzer, false);
+}
+
+/* Gets the values of the channels in a sample, returns the mask of the
+ * channels present
+*/
+static uint32_t sample_values(const struct sensor_sample *sample, fxp_t *values)
+{
+	switch (sample->source)
+	{
+	case SENSOR_SAMPLE_BME280:
+		values[RECORD_CHAN_TEMP] = sample->env.temp;
+		values[RECORD_CHAN_PRESS] = sample->env.press;
+		values[RECORD_CHAN_HUMIDITY] = sample->env.humidity;
+		return BIT(RECORD_CHAN_TEMP) | BIT(RECORD_CHAN_PRESS) | BIT(RECORD_CHAN_HUMIDITY);
+	case SENSOR_SAMPLE_CCS811:
+		values[RECORD_CHAN_CO2] = sample->gas.co2;
+		values[RECORD_CHAN_TVOC] = sample->gas.tvoc;
+		return BIT(RECORD_CHAN_CO2) | BIT(RECORD_CHAN_TVOC);
+	}
+
+	return 0;
+}
+
+/* Evaluates the condition of a rule for a new value: Does it call for
+ * raising or for clearing the alarm (or neither, e.g. within the
+ * hysteresis)?
+*/
+static void rule_condition(int id, fxp_t value, uint32_t now, bool *raise, bool *clear)
+{
+	struct alarm_state *s = &states[id];
+	fxp_t threshold = rules[id].threshold;
+	fxp_t release = threshold - rules[id].hysteresis;
+	int64_t rate;
+
+	*raise = false;
+	*clear = false;
+
+	switch (rules[id].kind)
+	{
+	case ALARM_KIND_LEVEL:
+		*raise = value >= threshold;
+		*clear = value < release;
+		break;
+	case ALARM_KIND_RATE:
+		/* The reference is the 'next' sample once that is old enough,
+		 * i.e. always 30 - 60 s old
+		*/
+		if (!s->primed)
+		{
+			s->ref_value = s->next_value = value;
+			s->ref_time = s->next_time = now;
+			s->primed = true;
+		}
+		if (now - s->next_time >= ALARM_RATE_SPAN_MS)
+		{
+			s->ref_value = s->next_value;
+			s->ref_time = s->next_time;
+			s->next_value = value;
+			s->next_time = now;
+		}
+		if (now - s->ref_time >= ALARM_RATE_SPAN_MS)
+		{
+			rate = (int64_t)(value - s->ref_value) * ALARM_MINUTE_MS / (now - s->ref_time);
+			*raise = rate >= threshold;
+			*clear = rate < release;
+		}
+		break;
+	case ALARM_KIND_DURATION:
+		if (value >= threshold)
+		{
+			if (!s->above)
+			{
+				s->above = true;
+				s->above_since = now;
+			}
+			*raise = now - s->above_since >= rules[id].duration_ms;
+		}
+		else
+		{
+			s->above = false;
+			*clear = value < release;
+		}
+		break;
+	}
+}
+
+/* Debouncing: Returns true if the rule changed its state
+*/
+static bool rule_debounce(int id, bool raise, bool clear)
+{
+	if (!(states[id].active ? clear : raise))
+	{
+		states[id].count = 0;
+		return false;
+	}
+	if (++states[id].count < CONFIG_APP_ALARM_DEBOUNCE)
+	{
+		return false;
+	}
+	states[id].count = 0;
+	states[id].active = !states[id].active;
+
+	return true;
+}
+
+/* Evaluates the rules for a sample being published (listener of the raw
+ * sample channels, runs in the acquisition threads)
+*/
+static void alarm_evaluate(const struct bus_channel *chan, const void *message)
+{
+	const struct sensor_sample *sample = message;
+	uint32_t start = latency_start();
+	fxp_t values[RECORD_CHAN_COUNT];
+	uint32_t channels;
+
+	if (sample->rc != 0)
+	{
+		return;
+	}
+
+	channels = sample_values(sample, values);
+	for (int id = 0; id < ALARM_COUNT; id++)
+	{
+		bool raise, clear;
+
+		if (rules[id].threshold == 0 || (channels & BIT(rules[id].channel)) == 0)
+		{
+			continue;
+		}
+
+		rule_condition(id, values[rules[id].channel], sample->timestamp, &raise, &clear);
+		if (rule_debounce(id, raise, clear))
+		{
+			struct alarm_event event = {
+				.start = start,
+				.value = values[rules[id].channel],
+				.id = id,
+				.active = states[id].active,
+			};
+
+			if (event.active)
+			{
+				atomic_or(&active_alarms, BIT(id));
+			}
+			else
+			{
+				atomic_and(&active_alarms, ~BIT(id));
+			}
+			if (k_msgq_put(&alarm_msgq, &event, K_NO_WAIT) != 0)
+			{
+				latency_event(LATENCY_ALARM_DROPPED);
+			}
+		}
+	}
+}
+
+BUS_LISTENER_DEFINE(alarm_listener, alarm_evaluate);
+
+uint32_t alarm_get_active(void)
+{
+	return atomic_get(&active_alarms);
+}
+
+/* Alarm thread: Drives the outputs ...
+ * The outputs follow the set of active alarms rather than the single
+ * event, so a dropped event is caught up with the next one.
+*/
+static void alarm_run(void *p1, void *p2, void *p3)
+{
+	struct alarm_event event;
+	uint32_t active;
+
+	while (1)
+	{
+		k_msgq_get(&alarm_msgq, &event, K_FOREVER);
+		active = atomic_get(&active_alarms);
+
+		output_set(&led, active != 0);
+		if (event.active)
+		{
+			output_set(&buzzer, true);
+			k_delayed_work_submit(&buzzer_work, K_MSEC(ALARM_BUZZER_MS));
+		}
+		gui_update_alarm(active != 0 ? rules[__builtin_ctz(active)].text : NULL);
+		ble_set_flags(active != 0 ? RECORD_FLAG_ALARM : 0);
+		latency_end(LATENCY_ALARM, event.start);
+
+		if (event.active)
+		{
+			LOG_WRN("Alarm raised: %s (value %d)", rules[event.id].text, fxp_to_int(event.value));
+		}
+		else
+		{
+			LOG_INF("Alarm cleared: %s (value %d)", rules[event.id].text, fxp_to_int(event.value));
+		}
+	}
+}
+
+/* Setup the alarm outputs and start the alarm thread
+*/
+void alarm_init(void)
+{
+#if DT_NODE_EXISTS(ALARM_LED)
+	output_init(&led, DT_GPIO_LABEL(ALARM_LED, gpios), DT_GPIO_PIN(ALARM_LED, gpios),
+				DT_GPIO_FLAGS(ALARM_LED, gpios));
+#endif
+#if DT_NODE_EXISTS(ALARM_BUZZER)
+	output_init(&buzzer, DT_GPIO_LABEL(ALARM_BUZZER, gpios), DT_GPIO_PIN(ALARM_BUZZER, gpios),
+				DT_GPIO_FLAGS(ALARM_BUZZER, gpios));
+#endif
+	if (led.dev == NULL)
+	{
+		LOG_WRN("No alarm LED, alarms are shown in the GUI and advertised only");
+	}
+	k_delayed_work_init(&buzzer_work, buzzer_off);
+
+	k_thread_create(&alarm_thread_data, alarm_thread_stack,
+					K_THREAD_STACK_SIZEOF(alarm_thread_stack),
+					alarm_run, NULL, NULL, NULL,
+					ALARM_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&alarm_thread_data, "alarm");
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_alarm(const struct shell *shell, size_t argc, char **argv)
+{
+	uint32_t active = alarm_get_active();
+
+	shell_print(shell, "%-24s %-8s %10s %6s", "alarm", "channel", "threshold", "state");
+	for (int id = 0; id < ALARM_COUNT; id++)
+	{
+		shell_print(shell, "%-24s %-8s %10d %6s", rules[id].text,
+					record_channel_name(rules[id].channel), fxp_to_int(rules[id].threshold),
+					rules[id].threshold == 0 ? "off" : (active & BIT(id)) ? "ACTIVE" : "-");
+	}
+
+	return 0;
+}
+
+SHELL_CMD_REGISTER(alarm, NULL, "Threshold alarms", cmd_alarm);
+
+#endif
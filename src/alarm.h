@@ -0,0 +1,77 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ALARM_H
+#define __ALARM_H
+
+#include <zephyr.h>
+
+/* Threshold alarms (CONFIG_APP_ALARM) ...
+ * The rules are evaluated by the acquisition thread publishing a sample
+ * (alarm_listener on the raw sample channels), i.e. without waiting for
+ * the main loop. Each rule watches one channel:
+ *
+ * Level: The value reaches the threshold.
+ * Rate: The value rises by the threshold per minute or more, measured
+ * against a reference sample 30 - 60 s old.
+ * Duration: The value stays at or above the threshold for a minimum time.
+ *
+ * A rule is raised once its condition holds for CONFIG_APP_ALARM_DEBOUNCE
+ * consecutive samples and cleared once the value (rate) stays below the
+ * threshold minus the hysteresis for as many samples. Invalid samples are
+ * ignored.
+ *
+ * State changes are passed to the alarm thread, which runs at a
+ * cooperative priority above all application threads. It switches the
+ * alarm GPIO (alias alarm-led, else led0, and the optional alias buzzer),
+ * sets RECORD_FLAG_ALARM in the advertising data and shows a banner with
+ * the most important active alarm in the GUI. The time from publishing
+ * the sample to completing these actions is recorded as latency stage
+ * 'alarm'.
+*/
+enum alarm_id
+{
+	ALARM_CO2_HIGH,		 /* level */
+	ALARM_TVOC_HIGH,	 /* level */
+	ALARM_CO2_RISING,	 /* rate */
+	ALARM_CO2_SUSTAINED, /* duration */
+	ALARM_COUNT,
+};
+
+#if defined(CONFIG_APP_ALARM)
+
+void alarm_init(void);
+
+uint32_t alarm_get_active(void);
+
+#else
+
+static inline void alarm_init(void)
+{
+}
+
+static inline uint32_t alarm_get_active(void)
+{
+	return 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+
+#include "benchmark.h"
+#include "cycles.h"
+#include "filter.h"
+#include "fxp.h"
+#include "iaq.h"
+#include "stats.h"
+#include "tscodec.h"
+#include "util.h"
+
+/* Consumes the results, so the calls are not optimized away
+*/
+static volatile uint32_t sink;
+
+static struct iaq_input inputs[BENCHMARK_INPUTS];
+static uint8_t outputs[BENCHMARK_INPUTS];
+static struct tsc_block block;
+
+void benchmark_report(const char *name, uint32_t calls, uint32_t counts)
+{
+	uint64_t per_call_x10 = (uint64_t)counts * 10U / calls;
+	uint64_t ns = (uint64_t)counts * NSEC_PER_SEC / cycles_hz() / calls;
+
+	printk("BENCH,%s,%u,%u.%u,%u\n", name, calls,
+		   (uint32_t)(per_call_x10 / 10U), (uint32_t)(per_call_x10 % 10U), (uint32_t)ns);
+}
+
+/* Synthetic inputs covering the rating range: 15 - 30 °C, 20 - 80 %RH,
+ * 400 - 3000 ppm eCO2, 0 - 1500 ppb TVOC
+*/
+static void inputs_init(void)
+{
+	uint32_t random = 12345;
+
+	for (int i = 0; i < BENCHMARK_INPUTS; i++)
+	{
+		random = random * 1103515245U + 12345U;
+		inputs[i].temperature = 15000 + (random >> 8) % 15000;
+		random = random * 1103515245U + 12345U;
+		inputs[i].humidity = 20000 + (random >> 8) % 60000;
+		random = random * 1103515245U + 12345U;
+		inputs[i].eco2 = 400 + (random >> 8) % 2600;
+		random = random * 1103515245U + 12345U;
+		inputs[i].tvoc = (random >> 8) % 1500;
+	}
+}
+
+/* The i-th synthetic input (repeating every BENCHMARK_INPUTS)
+*/
+const struct iaq_input *benchmark_input(uint32_t i)
+{
+	return &inputs[i & (BENCHMARK_INPUTS - 1)];
+}
+
+/* Sets up the counter and the inputs and prints the info line
+*/
+void benchmark_begin(void)
+{
+	cycles_init();
+	inputs_init();
+	printk("BENCH_INFO,%s,%u\n", CONFIG_BOARD, cycles_hz());
+}
+
+void benchmark_end(void)
+{
+	printk("BENCH_END\n");
+}
+
+uint32_t benchmark_iaq_index(void)
+{
+	uint32_t start;
+
+	start = cycles_get();
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		const struct iaq_input *in = benchmark_input(i);
+
+		sink += get_iaq_index(in->temperature, in->humidity, in->eco2, in->tvoc);
+	}
+	benchmark_report("get_iaq_index", BENCHMARK_CALLS, cycles_get() - start);
+
+	return BENCHMARK_CALLS;
+}
+
+uint32_t benchmark_iaq_index_batch(void)
+{
+	uint32_t batches = MAX(BENCHMARK_CALLS / BENCHMARK_INPUTS, 1);
+	uint32_t start;
+
+	start = cycles_get();
+	for (uint32_t i = 0; i < batches; i++)
+	{
+		get_iaq_index_batch(inputs, outputs, BENCHMARK_INPUTS);
+		sink += outputs[i & (BENCHMARK_INPUTS - 1)];
+	}
+	benchmark_report("get_iaq_index_batch", batches * BENCHMARK_INPUTS, cycles_get() - start);
+
+	return batches * BENCHMARK_INPUTS;
+}
+
+/* Ratings of the IAQ indexes of the last benchmark_iaq_index_batch()
+*/
+uint32_t benchmark_iaq_rating(void)
+{
+	uint32_t start;
+
+	start = cycles_get();
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		sink += (uintptr_t)get_iaq_rating(outputs[i & (BENCHMARK_INPUTS - 1)]);
+	}
+	benchmark_report("get_iaq_rating", BENCHMARK_CALLS, cycles_get() - start);
+
+	return BENCHMARK_CALLS;
+}
+
+/* Label formatting of the sensor values (GUI thread)
+*/
+uint32_t benchmark_fxp_format(void)
+{
+	char buf[FXP_STR_LEN];
+	uint32_t start;
+
+	start = cycles_get();
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		sink += fxp_format(buf, sizeof(buf), benchmark_input(i)->humidity, 2);
+	}
+	benchmark_report("fxp_format", BENCHMARK_CALLS, cycles_get() - start);
+
+	return BENCHMARK_CALLS;
+}
+
+uint32_t benchmark_time_str(void)
+{
+	char buf[TIME_STR_LEN];
+	uint32_t start;
+
+	start = cycles_get();
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		sink += time_str(buf, sizeof(buf), i * 7919U, true)[0];
+	}
+	benchmark_report("time_str", BENCHMARK_CALLS, cycles_get() - start);
+
+	return BENCHMARK_CALLS;
+}
+
+#if defined(CONFIG_APP_FILTER)
+/* Conditioning of one channel (window, outlier test and EMA) per sample
+*/
+uint32_t benchmark_filter(void)
+{
+	uint32_t start;
+
+	filter_reset();
+	start = cycles_get();
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		sink += filter_sample(RECORD_CHAN_CO2, fxp_from_int(benchmark_input(i)->eco2));
+	}
+	benchmark_report("filter_sample", BENCHMARK_CALLS, cycles_get() - start);
+	filter_reset();
+
+	return BENCHMARK_CALLS;
+}
+#endif
+
+/* A record per simulated second from the synthetic inputs
+*/
+static void record_init(struct iaq_record *record, uint32_t i)
+{
+	const struct iaq_input *in = benchmark_input(i);
+
+	record->timestamp = i * MSEC_PER_SEC;
+	record->values[RECORD_CHAN_TEMP] = in->temperature;
+	record->values[RECORD_CHAN_HUMIDITY] = in->humidity;
+	record->values[RECORD_CHAN_CO2] = fxp_from_int(in->eco2);
+	record->values[RECORD_CHAN_TVOC] = fxp_from_int(in->tvoc);
+	record->iaq_index = outputs[i & (BENCHMARK_INPUTS - 1)];
+}
+
+#if defined(CONFIG_APP_STATS)
+/* Rolling statistics: One record per simulated second, including the
+ * bucket completions of all windows
+*/
+uint32_t benchmark_stats(void)
+{
+	struct iaq_record record = {0};
+	uint32_t start;
+
+	stats_reset();
+	start = cycles_get();
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		record_init(&record, i);
+		stats_add(&record);
+	}
+	benchmark_report("stats_add", BENCHMARK_CALLS, cycles_get() - start);
+	stats_reset();
+
+	return BENCHMARK_CALLS;
+}
+#endif
+
+/* History archive: Encoding one record per simulated second. The inputs
+ * change at random, i.e. close to the longest codes, and the cost of the
+ * most expensive record is reported as well (tsc_encode_max). A full block
+ * is started over like in history_add(); the rejected attempt and the
+ * block initialization are not measured.
+*/
+uint32_t benchmark_tsc_encode(void)
+{
+	struct iaq_record record = {0};
+	uint32_t counts = 0;
+	uint32_t max = 0;
+	uint32_t start;
+	uint32_t end;
+	int rc;
+
+	tsc_block_init(&block);
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		record_init(&record, i);
+
+		start = cycles_get();
+		rc = tsc_block_add(&block, &record);
+		end = cycles_get();
+		if (rc == -ENOSPC)
+		{
+			tsc_block_init(&block);
+			start = cycles_get();
+			tsc_block_add(&block, &record);
+			end = cycles_get();
+		}
+		counts += end - start;
+		max = MAX(max, end - start);
+	}
+	benchmark_report("tsc_encode", BENCHMARK_CALLS, counts);
+	benchmark_report("tsc_encode_max", 1, max);
+
+	return BENCHMARK_CALLS;
+}
@@ -0,0 +1,81 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BENCHMARK_H
+#define __BENCHMARK_H
+
+#include <zephyr.h>
+
+#include "iaq.h"
+#include "sensors.h"
+
+/* Microbenchmarks of the hot paths ...
+ * Each benchmark runs BENCHMARK_CALLS times (CONFIG_APP_BENCHMARK_CALLS)
+ * on synthetic inputs, prints a machine readable result to the console and
+ * returns the number of calls measured:
+ *
+ *   BENCH_INFO,<board>,<counter frequency (Hz)>
+ *   BENCH,<name>,<calls>,<counts per call>,<ns per call>
+ *   BENCH_END
+ *
+ * Counts are those of cycles_get(), see cycles.h.
+ *
+ * The benchmarks of the processing (benchmark.c) run in the ztest suite
+ * tests/benchmark. The benchmark firmware (CONFIG_APP_BENCHMARK,
+ * benchmark_app.c) runs them as well, plus the GUI updates and the main
+ * loop, which feeds synthetic samples to 'iteration', the consumer stage
+ * of the main loop.
+*/
+#define BENCHMARK_CALLS CONFIG_APP_BENCHMARK_CALLS
+#define BENCHMARK_INPUTS 64 /* must be a power of 2 */
+
+typedef void (*benchmark_iteration_t)(const struct sensor_sample *sample);
+
+void benchmark_begin(void);
+
+void benchmark_end(void);
+
+void benchmark_report(const char *name, uint32_t calls, uint32_t counts);
+
+const struct iaq_input *benchmark_input(uint32_t i);
+
+uint32_t benchmark_iaq_index(void);
+
+uint32_t benchmark_iaq_index_batch(void);
+
+uint32_t benchmark_iaq_rating(void);
+
+uint32_t benchmark_fxp_format(void);
+
+uint32_t benchmark_time_str(void);
+
+#if defined(CONFIG_APP_FILTER)
+uint32_t benchmark_filter(void);
+#endif
+
+#if defined(CONFIG_APP_STATS)
+uint32_t benchmark_stats(void);
+#endif
+
+uint32_t benchmark_tsc_encode(void);
+
+void benchmark_run(benchmark_iteration_t iteration);
+
+#endif
@@ -0,0 +1,116 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+
+#include "benchmark.h"
+#include "cycles.h"
+#include "fxp.h"
+#include "gui.h"
+
+/* Benchmark firmware (CONFIG_APP_BENCHMARK): The benchmarks of the
+ * processing plus those that need the running application (GUI thread,
+ * consumer stage)
+*/
+#define BENCHMARK_GUI_BURST 16	  /* updates per GUI drain (half the update ring) */
+#define BENCHMARK_DRAIN_TIME_MS 5 /* time for the GUI thread to catch up */
+
+/* Posting sensor values to the GUI, in bursts so the GUI thread can drain
+ * the update ring in between (not measured)
+*/
+static void bench_gui_update(void)
+{
+	uint32_t counts = 0;
+	uint32_t start;
+
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i += BENCHMARK_GUI_BURST)
+	{
+		start = cycles_get();
+		for (uint32_t j = i; j < i + BENCHMARK_GUI_BURST; j++)
+		{
+			gui_update_sensor_value(SENSOR_CHAN_HUMIDITY, benchmark_input(j)->humidity);
+		}
+		counts += cycles_get() - start;
+		k_sleep(K_MSEC(BENCHMARK_DRAIN_TIME_MS));
+	}
+	benchmark_report("gui_update_sensor_value", ROUND_UP(BENCHMARK_CALLS, BENCHMARK_GUI_BURST), counts);
+}
+
+/* One main loop iteration per synthetic sample, alternating between the
+ * sensors (including the console output of the loop)
+*/
+static void bench_main_loop(benchmark_iteration_t iteration)
+{
+	struct sensor_sample sample = {0};
+	uint32_t counts = 0;
+	uint32_t start;
+
+	for (uint32_t i = 0; i < BENCHMARK_CALLS; i++)
+	{
+		const struct iaq_input *in = benchmark_input(i / 2);
+
+		sample.timestamp = k_uptime_get_32();
+		if (i & 1)
+		{
+			sample.source = SENSOR_SAMPLE_CCS811;
+			sample.gas.co2 = fxp_from_int(in->eco2);
+			sample.gas.tvoc = fxp_from_int(in->tvoc);
+		}
+		else
+		{
+			sample.source = SENSOR_SAMPLE_BME280;
+			sample.env.temp = in->temperature;
+			sample.env.press = 101325;
+			sample.env.humidity = in->humidity;
+		}
+
+		start = cycles_get();
+		iteration(&sample);
+		counts += cycles_get() - start;
+		k_sleep(K_MSEC(BENCHMARK_DRAIN_TIME_MS));
+	}
+	benchmark_report("main_loop", BENCHMARK_CALLS, counts);
+}
+
+/* Runs all benchmarks ...
+*/
+void benchmark_run(benchmark_iteration_t iteration)
+{
+	/* Let the other threads (GUI, Bluetooth) finish their startup
+	*/
+	k_sleep(K_MSEC(1000));
+
+	benchmark_begin();
+	benchmark_iaq_index();
+	benchmark_iaq_index_batch();
+	benchmark_iaq_rating();
+	benchmark_fxp_format();
+	benchmark_time_str();
+#if defined(CONFIG_APP_FILTER)
+	benchmark_filter();
+#endif
+#if defined(CONFIG_APP_STATS)
+	benchmark_stats();
+#endif
+	benchmark_tsc_encode();
+	bench_gui_update();
+	bench_main_loop(iteration);
+	benchmark_end();
+}
@@ -0,0 +1,746 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <string.h>
+#include <sys/atomic.h>
+#include <sys/byteorder.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <bluetooth/gatt.h>
+
+#include "ble.h"
+#include "channels.h"
+#include "flashlog.h"
+#include "gateway.h"
+#include "history.h"
+#include "latency.h"
+#include "stats.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(ble, CONFIG_APP_BLE_LOG_LEVEL);
+
+#define DEVICE_NAME CONFIG_BT_DEVICE_NAME
+#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
+
+#define BLE_HISTORY_THREAD_STACK_SIZE 1536
+#define BLE_HISTORY_THREAD_PRIORITY 8
+#define BLE_HISTORY_RETRY_MS 5
+#define BLE_UPDATE_THREAD_STACK_SIZE 1536
+#define BLE_UPDATE_THREAD_PRIORITY 7
+
+/* Bluetooth beacon setup ...
+ * The advertising data carries the latest record as manufacturer specific
+ * data (struct iaq_record_adv) and lists the Environmental Sensing Service.
+ * The scan response carries the device name.
+*/
+static struct iaq_record_adv adv_payload = {
+	.company_id = sys_cpu_to_le16(CONFIG_APP_BT_COMPANY_ID),
+	.version = RECORD_ADV_VERSION,
+};
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA_BYTES(BT_DATA_UUID16_ALL, 0x1a, 0x18),
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, &adv_payload, sizeof(adv_payload)),
+};
+
+/* Set Scan Response data */
+static const struct bt_data sd[] = {
+	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+};
+
+/* The payload currently advertised ...
+ * The last record and the flags are updated by the main and the alarm
+ * thread.
+*/
+static struct iaq_record_adv advertised;
+
+static K_MUTEX_DEFINE(adv_mutex);
+static struct iaq_record adv_record;
+static bool adv_record_valid;
+static uint8_t adv_flags;
+
+/* BLE update work queue: Advertising data and notifications (see
+ * ble_iaq_changed())
+*/
+static K_THREAD_STACK_DEFINE(update_queue_stack, BLE_UPDATE_THREAD_STACK_SIZE);
+static struct k_work_q update_queue;
+
+#if defined(CONFIG_APP_BT_CONNECTABLE)
+
+/* Connectable advertising: Without BT_LE_ADV_OPT_ONE_TIME the host resumes
+ * advertising by itself once the connection is gone.
+*/
+#define BLE_ADV_PARAM BT_LE_ADV_PARAM(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_USE_IDENTITY, \
+									  BT_GAP_ADV_FAST_INT_MIN_2, BT_GAP_ADV_FAST_INT_MAX_2, NULL)
+
+/* Connection parameters requested for a bulk transfer: 7.5 - 15 ms interval
+*/
+#define BLE_HISTORY_CONN_PARAM BT_LE_CONN_PARAM(6, 12, 0, 400)
+
+#define BLE_UUID_INIT(x) BT_UUID_INIT_128(0x20, 0x1e, 0x9f, 0x7b, 0x5d, 0x3c, 0x1a, 0x9e, \
+										  0x6d, 0x4c, 0x2b, 0x8f, (x)&0xff, (x) >> 8, 0x4e, 0x6a)
+
+static struct bt_uuid_128 eco2_uuid = BLE_UUID_INIT(BLE_UUID_ECO2);
+static struct bt_uuid_128 tvoc_uuid = BLE_UUID_INIT(BLE_UUID_TVOC);
+static struct bt_uuid_128 iaq_uuid = BLE_UUID_INIT(BLE_UUID_IAQ);
+static struct bt_uuid_128 history_uuid = BLE_UUID_INIT(BLE_UUID_HISTORY);
+static struct bt_uuid_128 history_control_uuid = BLE_UUID_INIT(BLE_UUID_HISTORY_CONTROL);
+static struct bt_uuid_128 history_data_uuid = BLE_UUID_INIT(BLE_UUID_HISTORY_DATA);
+
+/* Characteristic values (little endian, as sent over the air) ...
+*/
+enum ble_ess_value
+{
+	BLE_ESS_TEMP,
+	BLE_ESS_HUMIDITY,
+	BLE_ESS_PRESS,
+	BLE_ESS_CO2,
+	BLE_ESS_TVOC,
+	BLE_ESS_IAQ,
+	BLE_ESS_COUNT,
+};
+
+static struct
+{
+	int16_t temp;
+	uint16_t humidity;
+	uint32_t press;
+	uint16_t co2;
+	uint16_t tvoc;
+	uint8_t iaq_index;
+} ess_values;
+
+static const struct
+{
+	void *value;
+	uint8_t len;
+} ess_chrcs[BLE_ESS_COUNT] = {
+	[BLE_ESS_TEMP] = {&ess_values.temp, sizeof(ess_values.temp)},
+	[BLE_ESS_HUMIDITY] = {&ess_values.humidity, sizeof(ess_values.humidity)},
+	[BLE_ESS_PRESS] = {&ess_values.press, sizeof(ess_values.press)},
+	[BLE_ESS_CO2] = {&ess_values.co2, sizeof(ess_values.co2)},
+	[BLE_ESS_TVOC] = {&ess_values.tvoc, sizeof(ess_values.tvoc)},
+	[BLE_ESS_IAQ] = {&ess_values.iaq_index, sizeof(ess_values.iaq_index)},
+};
+
+static ssize_t ess_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+						void *buf, uint16_t len, uint16_t offset)
+{
+	const enum ble_ess_value id = (enum ble_ess_value)(uintptr_t)attr->user_data;
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, ess_chrcs[id].value, ess_chrcs[id].len);
+}
+
+#define ESS_CHARACTERISTIC(_uuid, _id)                                           \
+	BT_GATT_CHARACTERISTIC(_uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,      \
+						   BT_GATT_PERM_READ, ess_read, NULL, (void *)(_id)), \
+		BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
+
+#if defined(CONFIG_APP_STATS)
+
+BUILD_ASSERT(ARRAY_SIZE(((struct ble_stats *)0)->windows) == STATS_WINDOW_COUNT, "Statistics windows mismatch");
+
+static struct bt_uuid_128 stats_uuid = BLE_UUID_INIT(BLE_UUID_STATS);
+
+static struct ble_stats stats_value;
+
+static inline uint16_t stats_u16(fxp_t value)
+{
+	return sys_cpu_to_le16(CLAMP(fxp_round(value, 0), 0, UINT16_MAX));
+}
+
+/* Takes a snapshot of the statistics on the first part of a (long) read,
+ * so all parts are consistent
+*/
+static ssize_t stats_read(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+						  void *buf, uint16_t len, uint16_t offset)
+{
+	if (offset == 0)
+	{
+		memset(&stats_value, 0, sizeof(stats_value));
+		for (int w = 0; w < STATS_WINDOW_COUNT; w++)
+		{
+			struct ble_stats_window *out = &stats_value.windows[w];
+			struct stats_value value;
+
+			if (stats_get(w, RECORD_CHAN_CO2, &value) == 0)
+			{
+				out->co2_mean = stats_u16(value.mean);
+				out->co2_bucket_p95 = stats_u16(value.bucket_p95);
+				out->co2_max = stats_u16(value.max);
+			}
+			if (stats_get(w, RECORD_CHAN_TVOC, &value) == 0)
+			{
+				out->tvoc_mean = stats_u16(value.mean);
+				out->tvoc_bucket_p95 = stats_u16(value.bucket_p95);
+				out->tvoc_max = stats_u16(value.max);
+			}
+			out->co2_exposure = stats_u16(stats_get_exposure(w, STATS_EXPOSURE_CO2));
+			out->tvoc_exposure = stats_u16(stats_get_exposure(w, STATS_EXPOSURE_TVOC));
+		}
+		stats_value.co2_exposure_total = sys_cpu_to_le32(fxp_to_int(stats_get_exposure_total(STATS_EXPOSURE_CO2)));
+		stats_value.tvoc_exposure_total = sys_cpu_to_le32(fxp_to_int(stats_get_exposure_total(STATS_EXPOSURE_TVOC)));
+	}
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &stats_value, sizeof(stats_value));
+}
+
+#define STATS_CHARACTERISTIC                                              \
+	BT_GATT_CHARACTERISTIC(&stats_uuid.uuid, BT_GATT_CHRC_READ,           \
+						   BT_GATT_PERM_READ, stats_read, NULL, NULL),
+
+#else
+
+#define STATS_CHARACTERISTIC
+
+#endif
+
+/* Attribute index of a characteristic's value: Service declaration, then
+ * declaration, value and CCC per characteristic.
+*/
+#define ESS_VALUE_ATTR(_id) (&ess_svc.attrs[2 + 3 * (_id)])
+
+BT_GATT_SERVICE_DEFINE(ess_svc,
+					   BT_GATT_PRIMARY_SERVICE(BT_UUID_ESS),
+					   ESS_CHARACTERISTIC(BT_UUID_TEMPERATURE, BLE_ESS_TEMP),
+					   ESS_CHARACTERISTIC(BT_UUID_HUMIDITY, BLE_ESS_HUMIDITY),
+					   ESS_CHARACTERISTIC(BT_UUID_PRESSURE, BLE_ESS_PRESS),
+					   ESS_CHARACTERISTIC(&eco2_uuid.uuid, BLE_ESS_CO2),
+					   ESS_CHARACTERISTIC(&tvoc_uuid.uuid, BLE_ESS_TVOC),
+					   ESS_CHARACTERISTIC(&iaq_uuid.uuid, BLE_ESS_IAQ),
+					   STATS_CHARACTERISTIC);
+
+/* History transfer ...
+ * The transfer runs in its own thread, which reads the records one by one
+ * (from the flash log or the archive) and packs them into MTU sized chunks.
+ * Notifications are queued back-to-back without waiting for the peer; if
+ * the stack runs out of buffers, the thread retries after a short delay.
+ * Together with the 247 byte MTU, Data Length Extension and the 2M PHY this
+ * moves about 15 records per notification.
+*/
+#define BLE_HISTORY_CHUNK_RECORDS_MAX \
+	((CONFIG_BT_L2CAP_TX_MTU - 3 - sizeof(struct ble_history_chunk)) / sizeof(struct iaq_record_packed))
+
+BUILD_ASSERT(BLE_HISTORY_CHUNK_RECORDS_MAX >= 1, "ATT MTU too small for history transfer");
+
+struct ble_history_xfer
+{
+	struct ble_history_chunk header;
+	struct iaq_record_packed records[BLE_HISTORY_CHUNK_RECORDS_MAX];
+} __packed;
+
+static ssize_t history_control_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+									 const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+
+BT_GATT_SERVICE_DEFINE(history_svc,
+					   BT_GATT_PRIMARY_SERVICE(&history_uuid.uuid),
+					   BT_GATT_CHARACTERISTIC(&history_control_uuid.uuid, BT_GATT_CHRC_WRITE,
+											  BT_GATT_PERM_WRITE, NULL, history_control_write, NULL),
+					   BT_GATT_CHARACTERISTIC(&history_data_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+											  BT_GATT_PERM_NONE, NULL, NULL, NULL),
+					   BT_GATT_CCC(NULL, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE), );
+
+#define HISTORY_DATA_ATTR (&history_svc.attrs[4])
+
+static K_THREAD_STACK_DEFINE(history_thread_stack, BLE_HISTORY_THREAD_STACK_SIZE);
+static struct k_thread history_thread_data;
+static K_SEM_DEFINE(history_sem, 0, 1);
+
+static struct bt_conn *history_conn = NULL;
+static struct ble_history_request history_request;
+static struct ble_history_xfer history_xfer;
+static uint16_t history_boot;
+static size_t history_chunk_records;
+static uint32_t history_records_sent;
+static uint32_t history_chunks_sent;
+static atomic_t history_busy = ATOMIC_INIT(0);
+static atomic_t history_abort = ATOMIC_INIT(0);
+
+static ssize_t history_control_write(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+									 const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	const struct ble_history_request *request = buf;
+
+	if (offset != 0 || len != sizeof(*request))
+	{
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	if (request->op == BLE_HISTORY_OP_ABORT)
+	{
+		atomic_set(&history_abort, 1);
+		return len;
+	}
+	if (request->op != BLE_HISTORY_OP_FLASHLOG && request->op != BLE_HISTORY_OP_ARCHIVE)
+	{
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+	if (!bt_gatt_is_subscribed(conn, HISTORY_DATA_ATTR, BT_GATT_CCC_NOTIFY))
+	{
+		return BT_GATT_ERR(BT_ATT_ERR_CCC_IMPROPER_CONF);
+	}
+	if (!atomic_cas(&history_busy, 0, 1))
+	{
+		return BT_GATT_ERR(BT_ATT_ERR_PROCEDURE_IN_PROGRESS);
+	}
+
+	history_request.op = request->op;
+	history_request.boot = sys_le16_to_cpu(request->boot);
+	history_request.from = sys_le32_to_cpu(request->from);
+	history_conn = bt_conn_ref(conn);
+	atomic_set(&history_abort, 0);
+	k_sem_give(&history_sem);
+
+	return len;
+}
+
+/* Sends the current chunk (count 0 ends the transfer) ...
+*/
+static int history_send(void)
+{
+	uint16_t len = sizeof(history_xfer.header) + history_xfer.header.count * sizeof(struct iaq_record_packed);
+	int rc;
+
+	history_xfer.header.boot = sys_cpu_to_le16(history_boot);
+	do
+	{
+		if (atomic_get(&history_abort))
+		{
+			rc = -ECANCELED;
+			break;
+		}
+		rc = bt_gatt_notify(history_conn, HISTORY_DATA_ATTR, &history_xfer, len);
+		if (rc == -ENOMEM)
+		{
+			/* Out of TX buffers, let the stack catch up
+			*/
+			k_sleep(K_MSEC(BLE_HISTORY_RETRY_MS));
+		}
+	} while (rc == -ENOMEM);
+
+	if (rc == 0)
+	{
+		history_records_sent += history_xfer.header.count;
+		history_chunks_sent++;
+	}
+	history_xfer.header.seq++;
+	history_xfer.header.count = 0;
+
+	return rc;
+}
+
+static int history_put(uint16_t boot, const struct iaq_record *record)
+{
+	int rc;
+
+	if (history_xfer.header.count > 0 &&
+		(history_xfer.header.count == history_chunk_records || history_boot != boot))
+	{
+		rc = history_send();
+		if (rc != 0)
+		{
+			return rc;
+		}
+	}
+
+	history_boot = boot;
+	record_pack(record, &history_xfer.records[history_xfer.header.count++]);
+
+	return 0;
+}
+
+static bool history_walk_cb(uint16_t boot, const struct iaq_record *record, void *user_data)
+{
+	int *rc = user_data;
+
+	*rc = history_put(boot, record);
+
+	return *rc == 0;
+}
+
+static void history_run(void *p1, void *p2, void *p3)
+{
+	while (1)
+	{
+		struct flashlog_stats stats;
+		struct bt_conn_info info;
+		bool restore;
+		uint16_t mtu;
+		uint32_t start;
+		int rc = 0;
+
+		k_sem_take(&history_sem, K_FOREVER);
+
+		/* Records per chunk for the negotiated MTU
+		*/
+		mtu = MIN(bt_gatt_get_mtu(history_conn), CONFIG_BT_L2CAP_TX_MTU);
+		history_chunk_records = MAX(1, (mtu - 3 - sizeof(struct ble_history_chunk)) / sizeof(struct iaq_record_packed));
+		history_chunk_records = MIN(history_chunk_records, BLE_HISTORY_CHUNK_RECORDS_MAX);
+		history_xfer.header.seq = 0;
+		history_xfer.header.count = 0;
+		history_records_sent = 0;
+		history_chunks_sent = 0;
+
+		/* Short connection interval for the transfer; the previous parameters
+		 * are restored afterwards
+		*/
+		restore = bt_conn_get_info(history_conn, &info) == 0;
+		bt_conn_le_param_update(history_conn, BLE_HISTORY_CONN_PARAM);
+
+		flashlog_get_stats(&stats);
+		start = k_uptime_get_32();
+		LOG_INF("History transfer started (op %u, MTU %u, %u records per chunk)",
+				history_request.op, mtu, history_chunk_records);
+
+		if (history_request.op == BLE_HISTORY_OP_FLASHLOG)
+		{
+			flashlog_walk(history_request.boot, history_request.from, history_walk_cb, &rc);
+		}
+		else
+		{
+			struct history_archive_iter iter;
+			struct iaq_record record;
+
+			history_archive_iter_init(&iter, history_request.from, UINT32_MAX);
+			while (rc == 0 && history_archive_iter_next(&iter, &record))
+			{
+				rc = history_put(stats.boot, &record);
+			}
+		}
+
+		/* Send the last partial chunk and the end marker
+		*/
+		if (rc == 0 && history_xfer.header.count > 0)
+		{
+			rc = history_send();
+		}
+		if (rc == 0)
+		{
+			history_boot = stats.boot;
+			rc = history_send();
+		}
+
+		uint32_t duration = MAX(1, k_uptime_get_32() - start);
+		LOG_INF("History transfer %s: %u records in %u chunks, %u ms (%u B/s)",
+				rc == 0 ? "done" : "aborted", history_records_sent, history_chunks_sent, duration,
+				(uint32_t)((uint64_t)history_records_sent * sizeof(struct iaq_record_packed) * MSEC_PER_SEC / duration));
+
+		/* Also after an abort (fails harmlessly if disconnected)
+		*/
+		if (restore)
+		{
+			bt_conn_le_param_update(history_conn, BT_LE_CONN_PARAM(info.le.interval, info.le.interval,
+																   info.le.latency, info.le.timeout));
+		}
+
+		bt_conn_unref(history_conn);
+		history_conn = NULL;
+		atomic_set(&history_busy, 0);
+	}
+}
+
+/* Connection handling ...
+ * On connect, ask for the largest ATT MTU, the maximum data length and the
+ * 2M PHY. The peer may decline any of these; transfers adapt to the MTU.
+*/
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+	LOG_INF("MTU exchange %s (MTU %u)", err ? "failed" : "done", bt_gatt_get_mtu(conn));
+}
+
+static struct bt_gatt_exchange_params mtu_params = {
+	.func = mtu_exchanged,
+};
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err)
+	{
+		LOG_WRN("Connection failed (err 0x%02x)", err);
+		return;
+	}
+	LOG_INF("Connected");
+
+	bt_gatt_exchange_mtu(conn, &mtu_params);
+	bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	LOG_INF("Disconnected (reason 0x%02x)", reason);
+
+	if (atomic_get(&history_busy) && conn == history_conn)
+	{
+		atomic_set(&history_abort, 1);
+	}
+}
+
+static void le_data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	LOG_INF("Data length updated (TX %u bytes, RX %u bytes)", info->tx_max_len,
+			info->rx_max_len);
+}
+
+static void le_phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	LOG_INF("PHY updated (TX %u, RX %u)", param->tx_phy, param->rx_phy);
+}
+
+static struct bt_conn_cb conn_callbacks = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_data_len_updated = le_data_len_updated,
+	.le_phy_updated = le_phy_updated,
+};
+
+/* Updates the characteristic values and notifies subscribers of changes ...
+*/
+static void ess_update(const struct iaq_record *record)
+{
+	struct iaq_record_packed packed;
+	bool changed[BLE_ESS_COUNT];
+
+	record_pack(record, &packed);
+
+	/* Pressure: kPa (1/1000) = Pa -> 0.1 Pa
+	*/
+	uint32_t press = sys_cpu_to_le32(MAX(record->values[RECORD_CHAN_PRESS], 0) * 10);
+
+	changed[BLE_ESS_TEMP] = ess_values.temp != packed.temp;
+	changed[BLE_ESS_HUMIDITY] = ess_values.humidity != packed.humidity;
+	changed[BLE_ESS_PRESS] = ess_values.press != press;
+	changed[BLE_ESS_CO2] = ess_values.co2 != packed.co2;
+	changed[BLE_ESS_TVOC] = ess_values.tvoc != packed.tvoc;
+	changed[BLE_ESS_IAQ] = ess_values.iaq_index != packed.iaq_index;
+
+	ess_values.temp = packed.temp;
+	ess_values.humidity = packed.humidity;
+	ess_values.press = press;
+	ess_values.co2 = packed.co2;
+	ess_values.tvoc = packed.tvoc;
+	ess_values.iaq_index = packed.iaq_index;
+
+	for (int i = 0; i < BLE_ESS_COUNT; i++)
+	{
+		if (changed[i])
+		{
+			/* Notifies all subscribed connections, -ENOTCONN if there are none
+			*/
+			bt_gatt_notify(NULL, ESS_VALUE_ATTR(i), ess_chrcs[i].value, ess_chrcs[i].len);
+		}
+	}
+}
+
+#else
+
+#define BLE_ADV_PARAM BT_LE_ADV_NCONN_IDENTITY
+
+#endif
+
+#if defined(CONFIG_APP_GATEWAY)
+
+/* Gateway role: Passive scanning for other monitors ...
+ * The callback runs in the Bluetooth RX thread; it only hands the raw
+ * advertising data to the gateway module, which decodes it without any
+ * allocation.
+*/
+#define BLE_SCAN_PARAM BT_LE_SCAN_PARAM(BT_LE_SCAN_TYPE_PASSIVE, BT_LE_SCAN_OPT_NONE, \
+										BT_GAP_SCAN_FAST_INTERVAL, BT_GAP_SCAN_FAST_WINDOW)
+
+static void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t adv_type, struct net_buf_simple *buf)
+{
+	struct gateway_addr node_addr = {
+		.type = addr->type,
+	};
+
+	if (adv_type != BT_GAP_ADV_TYPE_ADV_IND && adv_type != BT_GAP_ADV_TYPE_ADV_NONCONN_IND &&
+		adv_type != BT_GAP_ADV_TYPE_ADV_SCAN_IND)
+	{
+		return;
+	}
+
+	memcpy(node_addr.val, addr->a.val, sizeof(node_addr.val));
+	gateway_process_adv(&node_addr, rssi, buf->data, buf->len, k_uptime_get_32());
+}
+
+#endif
+
+static void bt_ready(int err)
+{
+
+	char addr_s[BT_ADDR_LE_STR_LEN];
+	bt_addr_le_t addr = {0};
+	size_t count = 1;
+
+	if (err)
+	{
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return;
+	}
+	LOG_INF("Bluetooth initialized");
+
+	/* Start advertising */
+	err = bt_le_adv_start(BLE_ADV_PARAM, ad, ARRAY_SIZE(ad),
+						  sd, ARRAY_SIZE(sd));
+	if (err)
+	{
+		LOG_ERR("Advertising failed to start (err %d)", err);
+		return;
+	}
+
+	bt_id_get(&addr, &count);
+	bt_addr_le_to_str(&addr, addr_s, sizeof(addr_s));
+
+	LOG_INF("Beacon started, advertising as %s", log_strdup(addr_s));
+
+#if defined(CONFIG_APP_GATEWAY)
+	err = bt_le_scan_start(BLE_SCAN_PARAM, scan_cb);
+	if (err)
+	{
+		LOG_ERR("Scanning failed to start (err %d)", err);
+		return;
+	}
+	LOG_INF("Gateway scanning started");
+#endif
+}
+
+/* Setup and start Bluetooth ...
+*/
+int ble_init(void)
+{
+	int bt_err;
+
+	k_work_q_start(&update_queue, update_queue_stack,
+				   K_THREAD_STACK_SIZEOF(update_queue_stack),
+				   BLE_UPDATE_THREAD_PRIORITY);
+	k_thread_name_set(&update_queue.thread, "ble_update");
+
+#if defined(CONFIG_APP_BT_CONNECTABLE)
+	bt_conn_cb_register(&conn_callbacks);
+
+	k_thread_create(&history_thread_data, history_thread_stack,
+					K_THREAD_STACK_SIZEOF(history_thread_stack),
+					history_run, NULL, NULL, NULL,
+					BLE_HISTORY_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&history_thread_data, "ble_history");
+#endif
+
+	LOG_INF("Starting beacon ...");
+	bt_err = bt_enable(bt_ready);
+	if (bt_err)
+	{
+		LOG_ERR("Initialization failed (err %d)", bt_err);
+	}
+
+	return bt_err;
+}
+
+/* Updates the advertising data, if the payload changed ...
+*/
+static void adv_update(const struct iaq_record *record)
+{
+	struct iaq_record_adv payload;
+	uint32_t start;
+	int bt_err;
+
+	/* Compare with the current sequence number, i.e. only the values
+	*/
+	record_pack_adv(record, CONFIG_APP_BT_COMPANY_ID, advertised.seq, &payload);
+	payload.flags |= adv_flags;
+	if (memcmp(&payload, &advertised, sizeof(payload)) == 0)
+	{
+		return;
+	}
+
+	payload.seq = advertised.seq + 1;
+	adv_payload = payload;
+	start = latency_start();
+	bt_err = bt_le_adv_update_data(ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	latency_end(LATENCY_ADV_UPDATE, start);
+	if (bt_err == 0)
+	{
+		advertised = payload;
+	}
+	else if (bt_err != -EAGAIN)
+	{
+		/* -EAGAIN: Not advertising (not yet ready or connected), retried with the next record
+		*/
+		LOG_WRN("Advertising update failed (err %d)", bt_err);
+	}
+}
+
+/* Publishes a new record ...
+*/
+void ble_update(const struct iaq_record *record)
+{
+#if defined(CONFIG_APP_BT_CONNECTABLE)
+	ess_update(record);
+#endif
+
+	k_mutex_lock(&adv_mutex, K_FOREVER);
+	adv_record = *record;
+	adv_record_valid = true;
+	adv_update(&adv_record);
+	k_mutex_unlock(&adv_mutex);
+}
+
+/* Sets the flags of the advertising payload (RECORD_FLAG_*) and updates
+ * the advertising data right away
+*/
+void ble_set_flags(uint8_t flags)
+{
+	k_mutex_lock(&adv_mutex, K_FOREVER);
+	adv_flags = flags;
+	if (adv_record_valid)
+	{
+		adv_update(&adv_record);
+	}
+	k_mutex_unlock(&adv_mutex);
+}
+
+/* Observer of iaq_chan ...
+ * The listener only submits the work item; the advertising data update and
+ * the notifications run in the BLE update work queue with the latest result,
+ * so they never delay the publisher. A stalled controller therefore only
+ * holds up this queue, not the system work queue.
+*/
+static void ble_update_work_handler(struct k_work *work)
+{
+	struct iaq_result result;
+
+	if (bus_chan_read(&iaq_chan, &result, K_FOREVER) == 0)
+	{
+		ble_update(&result.record);
+	}
+}
+
+static K_WORK_DEFINE(ble_update_work, ble_update_work_handler);
+
+static void ble_iaq_changed(const struct bus_channel *chan, const void *message)
+{
+	k_work_submit_to_queue(&update_queue, &ble_update_work);
+}
+
+BUS_LISTENER_DEFINE(ble_listener, ble_iaq_changed);
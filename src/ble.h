@@ -0,0 +1,113 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BLE_H
+#define __BLE_H
+
+#include <zephyr.h>
+
+#include "record.h"
+
+/* Bluetooth LE interface ...
+ * The device advertises the latest record as manufacturer specific data
+ * (struct iaq_record_adv, company id CONFIG_APP_BT_COMPANY_ID) along with
+ * the flags set by ble_set_flags() (RECORD_FLAG_*). The data is only
+ * updated when the payload changes. If CONFIG_APP_BT_CONNECTABLE is
+ * enabled, the device accepts a connection offering two GATT services:
+ *
+ * Environmental Sensing Service (0x181A) with read/notify characteristics for
+ * Temperature (0x2A6E, sint16, 0.01 °C), Humidity (0x2A6F, uint16, 0.01 %RH),
+ * Pressure (0x2A6D, uint32, 0.1 Pa) and the vendor specific characteristics
+ * eCO2 (BLE_UUID_ECO2, uint16, ppm), TVOC (BLE_UUID_TVOC, uint16, ppb) and
+ * IAQ index (BLE_UUID_IAQ, uint8, 0 = n/a). Notifications are sent on change
+ * only. With CONFIG_APP_STATS, the read-only characteristic Statistics
+ * (BLE_UUID_STATS, struct ble_stats) carries the rolling eCO2 / TVOC
+ * statistics and exposure.
+ *
+ * History service (BLE_UUID_HISTORY) for bulk transfer of logged records:
+ * Writing a struct ble_history_request to the control characteristic starts
+ * streaming records as notifications of the data characteristic. Each
+ * notification carries a struct ble_history_chunk header followed by as many
+ * packed records (struct iaq_record_packed) as fit into the ATT MTU. A chunk
+ * with count 0 ends the transfer.
+ *
+ * Vendor specific UUIDs are 6a4eXXXX-8f2b-4c6d-9e1a-3c5d7b9f1e20.
+*/
+#define BLE_UUID_ECO2 0x0001
+#define BLE_UUID_TVOC 0x0002
+#define BLE_UUID_IAQ 0x0003
+#define BLE_UUID_STATS 0x0004
+#define BLE_UUID_HISTORY 0x0100
+#define BLE_UUID_HISTORY_CONTROL 0x0101
+#define BLE_UUID_HISTORY_DATA 0x0102
+
+enum ble_history_op
+{
+	BLE_HISTORY_OP_ABORT = 0,
+	BLE_HISTORY_OP_FLASHLOG = 1, /* logged records (1 / min) of boot 'boot' (from uptime 'from') and later boots */
+	BLE_HISTORY_OP_ARCHIVE = 2,	 /* archived records (1 / sample) of this boot from uptime 'from' */
+};
+
+struct ble_history_request
+{
+	uint8_t op;
+	uint8_t reserved;
+	uint16_t boot;
+	uint32_t from; /* uptime in ms */
+} __packed;
+
+struct ble_history_chunk
+{
+	uint16_t boot; /* boot number of all records in this chunk */
+	uint8_t seq;   /* chunk sequence number (wraps around) */
+	uint8_t count; /* number of records following, 0 = end of transfer */
+} __packed;
+
+/* Rolling statistics of one window (15 min, 1 h, 8 h, 24 h), 0 = n/a.
+ * The p95 values are the 95th percentile of the window's 1/30 means (e.g.
+ * 2 minute means for 1 h), not of the individual records; see stats.h.
+ * Exposure above the configured thresholds, saturated at UINT16_MAX.
+*/
+struct ble_stats_window
+{
+	uint16_t co2_mean; /* ppm */
+	uint16_t co2_bucket_p95;
+	uint16_t co2_max;
+	uint16_t tvoc_mean; /* ppb */
+	uint16_t tvoc_bucket_p95;
+	uint16_t tvoc_max;
+	uint16_t co2_exposure;	/* ppm·h */
+	uint16_t tvoc_exposure; /* ppb·h */
+} __packed;
+
+struct ble_stats
+{
+	struct ble_stats_window windows[4];
+	uint32_t co2_exposure_total;  /* ppm·h since boot */
+	uint32_t tvoc_exposure_total; /* ppb·h since boot */
+} __packed;
+
+int ble_init(void);
+
+void ble_update(const struct iaq_record *record);
+
+void ble_set_flags(uint8_t flags);
+
+#endif
@@ -0,0 +1,132 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+
+#include "bus.h"
+#include "cycles.h"
+
+/* Publishes a message: Copies it into the channel, runs the listeners and
+ * notifies the subscribers. Returns -EBUSY if the channel could not be
+ * locked in time.
+*/
+int bus_chan_pub(const struct bus_channel *chan, const void *message, k_timeout_t timeout)
+{
+	uint32_t start = cycles_get();
+
+	if (k_mutex_lock(chan->mutex, timeout) != 0)
+	{
+		atomic_inc(&chan->stats->failed);
+		return -EBUSY;
+	}
+
+	memcpy(chan->message, message, chan->size);
+	for (size_t i = 0; i < chan->observer_count; i++)
+	{
+		const struct bus_observer *obs = chan->observers[i];
+
+		if (obs != NULL && obs->type == BUS_LISTENER)
+		{
+			obs->callback(chan, chan->message);
+		}
+	}
+	k_mutex_unlock(chan->mutex);
+
+	for (size_t i = 0; i < chan->observer_count; i++)
+	{
+		const struct bus_observer *obs = chan->observers[i];
+
+		if (obs != NULL && obs->type == BUS_SUBSCRIBER &&
+			k_msgq_put(obs->queue, &chan, K_NO_WAIT) != 0)
+		{
+			atomic_inc(&chan->stats->dropped);
+		}
+	}
+	atomic_inc(&chan->stats->published);
+
+#if defined(CONFIG_APP_LATENCY)
+	uint32_t us = cycles_to_us(cycles_get() - start);
+	k_spinlock_key_t key = k_spin_lock(&chan->stats->lock);
+
+	histogram_add(&chan->stats->publish_us, us);
+	k_spin_unlock(&chan->stats->lock, key);
+#else
+	ARG_UNUSED(start);
+#endif
+
+	return 0;
+}
+
+/* Copies the latest message of a channel
+*/
+int bus_chan_read(const struct bus_channel *chan, void *message, k_timeout_t timeout)
+{
+	if (k_mutex_lock(chan->mutex, timeout) != 0)
+	{
+		return -EBUSY;
+	}
+	memcpy(message, chan->message, chan->size);
+	k_mutex_unlock(chan->mutex);
+
+	return 0;
+}
+
+/* Locks a channel to read its message in place (zero-copy), NULL if the
+ * channel could not be locked in time. Release with bus_chan_finish()
+ * as soon as possible: Publishers wait meanwhile.
+*/
+const void *bus_chan_claim(const struct bus_channel *chan, k_timeout_t timeout)
+{
+	if (k_mutex_lock(chan->mutex, timeout) != 0)
+	{
+		return NULL;
+	}
+
+	return chan->message;
+}
+
+void bus_chan_finish(const struct bus_channel *chan)
+{
+	k_mutex_unlock(chan->mutex);
+}
+
+/* Waits for a notification of a subscriber, i.e. the next channel with a
+ * new message
+*/
+int bus_sub_wait(const struct bus_observer *sub, const struct bus_channel **chan, k_timeout_t timeout)
+{
+	return k_msgq_get(sub->queue, chan, timeout);
+}
+
+void bus_chan_reset_stats(const struct bus_channel *chan)
+{
+	atomic_set(&chan->stats->published, 0);
+	atomic_set(&chan->stats->failed, 0);
+	atomic_set(&chan->stats->dropped, 0);
+
+#if defined(CONFIG_APP_LATENCY)
+	k_spinlock_key_t key = k_spin_lock(&chan->stats->lock);
+
+	histogram_reset(&chan->stats->publish_us);
+	k_spin_unlock(&chan->stats->lock, key);
+#endif
+}
@@ -0,0 +1,138 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BUS_H
+#define __BUS_H
+
+#include <zephyr.h>
+
+#include "histogram.h"
+
+/* Publish / subscribe data bus ...
+ * Channels are defined statically (BUS_CHAN_DEFINE) with their message type
+ * and observers; each holds the latest message. Publishing copies the
+ * message into the channel and then:
+ *
+ * Listeners: The callback runs in the publisher's context with the channel
+ * locked and reads the message in place (zero-copy). Callbacks must be
+ * short and must not block, e.g. post to a queue or submit work.
+ *
+ * Subscribers: The channel is put into the subscriber's queue (never
+ * waiting); the subscriber thread reads the message later
+ * (bus_chan_read(), or bus_chan_claim() / bus_chan_finish() in place). If
+ * the queue is full, the notification is dropped, the subscriber still
+ * finds the latest message in the channel.
+ *
+ * A publisher only waits for the channel lock, which readers hold for the
+ * time of a copy, never for a consumer's processing. Each channel counts
+ * its publications, failed publications (lock timeout) and dropped
+ * notifications; with CONFIG_APP_LATENCY the publish time (including the
+ * listeners) is recorded in a histogram.
+*/
+struct bus_channel;
+
+typedef void (*bus_listener_cb_t)(const struct bus_channel *chan, const void *message);
+
+enum bus_observer_type
+{
+	BUS_LISTENER,
+	BUS_SUBSCRIBER,
+};
+
+struct bus_observer
+{
+	const char *name;
+	enum bus_observer_type type;
+	union
+	{
+		bus_listener_cb_t callback; /* BUS_LISTENER */
+		struct k_msgq *queue;		/* BUS_SUBSCRIBER: of const struct bus_channel * */
+	};
+};
+
+struct bus_channel_stats
+{
+	atomic_t published;
+	atomic_t failed;
+	atomic_t dropped;
+#if defined(CONFIG_APP_LATENCY)
+	struct k_spinlock lock;
+	struct histogram publish_us;
+#endif
+};
+
+struct bus_channel
+{
+	const char *name;
+	void *message;
+	size_t size;
+	struct k_mutex *mutex;
+	const struct bus_observer *const *observers; /* NULL entries are skipped */
+	size_t observer_count;
+	struct bus_channel_stats *stats;
+};
+
+#define BUS_LISTENER_DEFINE(_name, _callback)  \
+	const struct bus_observer _name = {        \
+		.name = #_name,                        \
+		.type = BUS_LISTENER,                  \
+		.callback = _callback,                 \
+	}
+
+#define BUS_SUBSCRIBER_DEFINE(_name, _queue_size)                                         \
+	K_MSGQ_DEFINE(_name##_queue, sizeof(const struct bus_channel *), _queue_size, 4); \
+	const struct bus_observer _name = {                                               \
+		.name = #_name,                                                               \
+		.type = BUS_SUBSCRIBER,                                                       \
+		.queue = &_name##_queue,                                                      \
+	}
+
+/* Observer only present if the Kconfig option is enabled
+*/
+#define BUS_OBSERVER_IF(_config, _observer) COND_CODE_1(_config, (&_observer), (NULL))
+
+#define BUS_CHAN_DEFINE(_name, _type, ...)                                       \
+	static _type _name##_message;                                                \
+	static K_MUTEX_DEFINE(_name##_mutex);                                        \
+	static const struct bus_observer *const _name##_observers[] = {__VA_ARGS__}; \
+	static struct bus_channel_stats _name##_stats;                               \
+	const struct bus_channel _name = {                                           \
+		.name = #_name,                                                          \
+		.message = &_name##_message,                                             \
+		.size = sizeof(_type),                                                   \
+		.mutex = &_name##_mutex,                                                 \
+		.observers = _name##_observers,                                          \
+		.observer_count = ARRAY_SIZE(_name##_observers),                         \
+		.stats = &_name##_stats,                                                 \
+	}
+
+int bus_chan_pub(const struct bus_channel *chan, const void *message, k_timeout_t timeout);
+
+int bus_chan_read(const struct bus_channel *chan, void *message, k_timeout_t timeout);
+
+const void *bus_chan_claim(const struct bus_channel *chan, k_timeout_t timeout);
+
+void bus_chan_finish(const struct bus_channel *chan);
+
+int bus_sub_wait(const struct bus_observer *sub, const struct bus_channel **chan, k_timeout_t timeout);
+
+void bus_chan_reset_stats(const struct bus_channel *chan);
+
+#endif
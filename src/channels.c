@@ -0,0 +1,112 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <init.h>
+#include <shell/shell.h>
+
+#include "channels.h"
+
+BUS_CHAN_DEFINE(sample_env_chan, struct sensor_sample,
+				BUS_OBSERVER_IF(CONFIG_APP_ALARM, alarm_listener),
+				&app_subscriber);
+
+BUS_CHAN_DEFINE(sample_gas_chan, struct sensor_sample,
+				BUS_OBSERVER_IF(CONFIG_APP_ALARM, alarm_listener),
+				&app_subscriber);
+
+BUS_CHAN_DEFINE(record_chan, struct iaq_record,
+				&gui_listener);
+
+BUS_CHAN_DEFINE(iaq_chan, struct iaq_result,
+				&gui_listener,
+				&ble_listener,
+				&recorder_listener);
+
+static const struct bus_channel *const channels[] = {
+	&sample_env_chan,
+	&sample_gas_chan,
+	&record_chan,
+	&iaq_chan,
+};
+
+static void channels_reset_stats(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(channels); i++)
+	{
+		bus_chan_reset_stats(channels[i]);
+	}
+}
+
+static int channels_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	channels_reset_stats();
+
+	return 0;
+}
+
+SYS_INIT(channels_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_bus_show(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_print(shell, "%-16s %8s %8s %8s %8s %8s %8s", "channel",
+				"pub", "failed", "dropped", "p50 us", "p99 us", "max us");
+	for (int i = 0; i < ARRAY_SIZE(channels); i++)
+	{
+		struct bus_channel_stats *stats = channels[i]->stats;
+		uint32_t p50 = 0, p99 = 0, max = 0;
+
+#if defined(CONFIG_APP_LATENCY)
+		k_spinlock_key_t key = k_spin_lock(&stats->lock);
+
+		p50 = histogram_percentile(&stats->publish_us, 500);
+		p99 = histogram_percentile(&stats->publish_us, 990);
+		max = stats->publish_us.max;
+		k_spin_unlock(&stats->lock, key);
+#endif
+
+		shell_print(shell, "%-16s %8u %8u %8u %8u %8u %8u", channels[i]->name,
+					(uint32_t)atomic_get(&stats->published), (uint32_t)atomic_get(&stats->failed),
+					(uint32_t)atomic_get(&stats->dropped), p50, p99, max);
+	}
+
+	return 0;
+}
+
+static int cmd_bus_reset(const struct shell *shell, size_t argc, char **argv)
+{
+	channels_reset_stats();
+	shell_print(shell, "Bus statistics cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_bus,
+							   SHELL_CMD(show, NULL, "Show the channel statistics", cmd_bus_show),
+							   SHELL_CMD(reset, NULL, "Clear the statistics", cmd_bus_reset),
+							   SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(bus, &sub_bus, "Data bus channels", NULL);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CHANNELS_H
+#define __CHANNELS_H
+
+#include <zephyr.h>
+
+#include "bus.h"
+#include "record.h"
+#include "sensors.h"
+
+/* Data bus channels of the sensing pipeline ...
+ * sample_env_chan, sample_gas_chan: Raw samples (struct sensor_sample) of
+ * the BME280 / CCS811, published by the acquisition threads. Observed by
+ * the alarm rules (listener) and the consumer stage (subscriber, main
+ * thread).
+ *
+ * record_chan: Conditioned record (struct iaq_record), published by the
+ * consumer stage for each valid sample, right before iaq_chan. Observed by
+ * the GUI (sensor values).
+ *
+ * iaq_chan: IAQ result (struct iaq_result), published by the consumer
+ * stage for each sample. Observed by the GUI (quality meter, calibration),
+ * Bluetooth (advertising, GATT) and the recorder (history, flash log,
+ * statistics, adaptive sampling).
+ *
+ * Publishers wait at most CHANNELS_PUB_TIMEOUT for the channel lock.
+ * The shell command 'bus' shows ('bus show') or clears ('bus reset') the
+ * channel statistics.
+*/
+#define CHANNELS_PUB_TIMEOUT K_MSEC(10)
+
+struct iaq_result
+{
+	struct iaq_record record;		   /* conditioned values and IAQ index (0 = n/a) */
+	uint32_t calibration_remaining_ms; /* 0 once calibrated */
+	bool valid;						   /* valid data of both sensors */
+	bool complete;					   /* valid and a new CCS811 sample (measurement cycle) */
+};
+
+extern const struct bus_channel sample_env_chan;
+extern const struct bus_channel sample_gas_chan;
+extern const struct bus_channel record_chan;
+extern const struct bus_channel iaq_chan;
+
+/* Observers, defined by the modules
+*/
+extern const struct bus_observer alarm_listener;
+extern const struct bus_observer app_subscriber;
+extern const struct bus_observer ble_listener;
+extern const struct bus_observer gui_listener;
+extern const struct bus_observer recorder_listener;
+
+#endif
@@ -0,0 +1,93 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __CYCLES_H
+#define __CYCLES_H
+
+#include <zephyr.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+#include <time.h>
+#elif defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#include <arch/arm/aarch32/cortex_m/cmsis.h>
+#endif
+
+/* High resolution counter for timing measurements ...
+ * The CPU cycle counter (DWT) on Cortex-M, the host's monotonic clock in ns
+ * on native_posix (the simulated time does not advance while code runs),
+ * else the system timer. The counter has 32 bits: Differences are valid
+ * for up to 2^32 / cycles_hz() seconds (67 s at 64 MHz).
+*/
+#if defined(CONFIG_ARCH_POSIX)
+static inline void cycles_init(void)
+{
+}
+
+static inline uint32_t cycles_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint32_t)((uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec);
+}
+
+static inline uint32_t cycles_hz(void)
+{
+	return NSEC_PER_SEC;
+}
+#elif defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+static inline void cycles_init(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t cycles_get(void)
+{
+	return DWT->CYCCNT;
+}
+
+static inline uint32_t cycles_hz(void)
+{
+	return SystemCoreClock;
+}
+#else
+static inline void cycles_init(void)
+{
+}
+
+static inline uint32_t cycles_get(void)
+{
+	return k_cycle_get_32();
+}
+
+static inline uint32_t cycles_hz(void)
+{
+	return sys_clock_hw_cycles_per_sec();
+}
+#endif
+
+static inline uint32_t cycles_to_us(uint32_t cycles)
+{
+	return (uint32_t)((uint64_t)cycles * USEC_PER_SEC / cycles_hz());
+}
+
+#endif
@@ -0,0 +1,288 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <shell/shell.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(filter, CONFIG_APP_FILTER_LOG_LEVEL);
+
+#define FILTER_WINDOW_SIZE MIN(CONFIG_APP_FILTER_WINDOW, FILTER_WINDOW_MAX)
+#define FILTER_HAMPEL_MIN_SAMPLES 3 /* window fill before rejecting outliers */
+
+/* Scaled MAD: 1.4826 x MAD estimates the standard deviation of normally
+ * distributed samples
+*/
+#define FILTER_MAD_SCALE 14826
+#define FILTER_MAD_DIVISOR 100000 /* incl. the 1/10 of the threshold */
+
+/* Minimum deviation regarded as an outlier per channel, so a constant
+ * signal (MAD 0) does not reject every small change
+*/
+static const fxp_t min_deviation[RECORD_CHAN_COUNT] = {
+	[RECORD_CHAN_TEMP] = 500,			 /* 0.5 °C */
+	[RECORD_CHAN_PRESS] = 100,			 /* 100 Pa */
+	[RECORD_CHAN_HUMIDITY] = 3000,		 /* 3 %RH */
+	[RECORD_CHAN_CO2] = 50 * FXP_SCALE,	 /* 50 ppm */
+	[RECORD_CHAN_TVOC] = 25 * FXP_SCALE, /* 25 ppb */
+};
+
+struct filter_channel
+{
+	struct filter_window window;
+	struct filter_ema ema;
+};
+
+static struct filter_channel channels[RECORD_CHAN_COUNT];
+static struct filter_hysteresis hysteresis;
+static struct filter_stats stats;
+
+/* Sorted sliding window ...
+ * The ring keeps the arrival order to find the oldest sample, the sorted
+ * copy is updated by removing it and inserting the new one (insertion sort
+ * step, at most 'size' moves each).
+*/
+void filter_window_init(struct filter_window *w, uint8_t size)
+{
+	memset(w, 0, sizeof(*w));
+	w->size = CLAMP(size, 1, FILTER_WINDOW_MAX);
+}
+
+void filter_window_add(struct filter_window *w, fxp_t value)
+{
+	int i;
+
+	if (w->count == w->size)
+	{
+		fxp_t oldest = w->ring[w->head];
+
+		for (i = 0; w->sorted[i] != oldest; i++)
+		{
+		}
+		for (; i < w->count - 1; i++)
+		{
+			w->sorted[i] = w->sorted[i + 1];
+		}
+		w->count--;
+		w->ring[w->head] = value;
+		w->head = (w->head + 1) % w->size;
+	}
+	else
+	{
+		w->ring[w->count] = value;
+	}
+
+	for (i = w->count; i > 0 && w->sorted[i - 1] > value; i--)
+	{
+		w->sorted[i] = w->sorted[i - 1];
+	}
+	w->sorted[i] = value;
+	w->count++;
+}
+
+/* Median (the lower one for an even count) of a non-empty window
+*/
+fxp_t filter_window_median(const struct filter_window *w)
+{
+	return w->sorted[(w->count - 1) / 2];
+}
+
+/* Median absolute deviation from 'median' ...
+ * The deviations of the samples below and above the median are each
+ * ascending when walking away from it, so merging both sides yields the
+ * deviations in order.
+*/
+fxp_t filter_window_mad(const struct filter_window *w, fxp_t median)
+{
+	int k = (w->count - 1) / 2;
+	int right = 0;
+	int left;
+	fxp_t deviation = 0;
+
+	while (right < w->count && w->sorted[right] < median)
+	{
+		right++;
+	}
+	left = right - 1;
+
+	for (int n = 0; n <= k; n++)
+	{
+		if (right < w->count && (left < 0 || w->sorted[right] - median <= median - w->sorted[left]))
+		{
+			deviation = w->sorted[right++] - median;
+		}
+		else
+		{
+			deviation = median - w->sorted[left--];
+		}
+	}
+
+	return deviation;
+}
+
+/* Exponential moving average, alpha = 1 / 2^shift (0: no smoothing)
+*/
+fxp_t filter_ema_update(struct filter_ema *ema, fxp_t value, unsigned int shift)
+{
+	if (!ema->primed)
+	{
+		ema->value = value;
+		ema->primed = true;
+	}
+	else
+	{
+		ema->value += (value - ema->value) / (1 << shift);
+	}
+
+	return ema->value;
+}
+
+/* Hysteresis for small integer levels ...
+ * A change by one step passes after 'hold' identical values in a row,
+ * larger changes pass immediately.
+*/
+uint8_t filter_hysteresis_update(struct filter_hysteresis *h, uint8_t value, uint8_t hold)
+{
+	if (h->held == 0 || abs(value - h->held) >= 2)
+	{
+		h->held = value;
+		h->seen = 0;
+	}
+	else if (value == h->held)
+	{
+		h->seen = 0;
+	}
+	else
+	{
+		if (value == h->candidate && h->seen > 0)
+		{
+			h->seen++;
+		}
+		else
+		{
+			h->candidate = value;
+			h->seen = 1;
+		}
+		if (h->seen >= hold)
+		{
+			h->held = value;
+			h->seen = 0;
+		}
+	}
+
+	return h->held;
+}
+
+void filter_reset(void)
+{
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		filter_window_init(&channels[ch].window, FILTER_WINDOW_SIZE);
+		channels[ch].ema.primed = false;
+	}
+	memset(&hysteresis, 0, sizeof(hysteresis));
+	memset(&stats, 0, sizeof(stats));
+}
+
+/* Conditions a new sample of a record channel ...
+ * Hampel: The sample is compared to the window of the preceding samples
+ * (causal), but always enters the window itself, so a lasting level change
+ * replaces the old median after half a window.
+*/
+fxp_t filter_sample(enum record_channel channel, fxp_t value)
+{
+	struct filter_channel *c = &channels[channel];
+	fxp_t out = value;
+
+	if (c->window.size == 0)
+	{
+		filter_window_init(&c->window, FILTER_WINDOW_SIZE);
+	}
+
+#if defined(CONFIG_APP_FILTER_MEDIAN)
+	filter_window_add(&c->window, value);
+	out = filter_window_median(&c->window);
+#elif defined(CONFIG_APP_FILTER_HAMPEL)
+	if (c->window.count >= FILTER_HAMPEL_MIN_SAMPLES)
+	{
+		fxp_t median = filter_window_median(&c->window);
+		int64_t threshold = (int64_t)filter_window_mad(&c->window, median) *
+							CONFIG_APP_FILTER_HAMPEL_K * FILTER_MAD_SCALE / FILTER_MAD_DIVISOR;
+
+		if (llabs((int64_t)value - median) > MAX(threshold, min_deviation[channel]))
+		{
+			LOG_DBG("Outlier on channel %d: %d (median %d)", channel, value, median);
+			stats.outliers[channel]++;
+			out = median;
+		}
+	}
+	filter_window_add(&c->window, value);
+#endif
+
+	return filter_ema_update(&c->ema, out, CONFIG_APP_FILTER_EMA_SHIFT);
+}
+
+uint8_t filter_iaq_index(uint8_t iaq_index)
+{
+	uint8_t held = hysteresis.held;
+	uint8_t out = filter_hysteresis_update(&hysteresis, iaq_index, CONFIG_APP_FILTER_HOLD_SAMPLES);
+
+	if (out != held)
+	{
+		stats.index_changes++;
+	}
+	else if (iaq_index != held)
+	{
+		stats.index_held++;
+	}
+
+	return out;
+}
+
+void filter_get_stats(struct filter_stats *out)
+{
+	*out = stats;
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_filter(const struct shell *shell, size_t argc, char **argv)
+{
+	struct filter_stats stats;
+
+	filter_get_stats(&stats);
+
+	shell_print(shell, "%-10s %8s", "channel", "outliers");
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		shell_print(shell, "%-10s %8u", record_channel_name(ch), stats.outliers[ch]);
+	}
+	shell_print(shell, "IAQ index: %u changes passed, %u held", stats.index_changes, stats.index_held);
+
+	return 0;
+}
+
+SHELL_CMD_REGISTER(filter, NULL, "Signal conditioning statistics", cmd_filter);
+
+#endif
@@ -0,0 +1,118 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FILTER_H
+#define __FILTER_H
+
+#include <zephyr.h>
+
+#include "fxp.h"
+#include "record.h"
+
+/* Signal conditioning between acquisition and scoring (CONFIG_APP_FILTER) ...
+ * Each record channel passes through two stages with static state:
+ *
+ * Spike suppression over a sliding window of the last
+ * CONFIG_APP_FILTER_WINDOW raw samples, kept sorted (O(window) per sample):
+ * Either the window median, or Hampel outlier rejection, which replaces a
+ * sample by the median if it deviates from it by more than
+ * CONFIG_APP_FILTER_HAMPEL_K / 10 scaled median absolute deviations (and a
+ * per-channel minimum). A lasting level change is accepted once it fills
+ * half of the window.
+ *
+ * Exponential moving average with alpha = 1 / 2^CONFIG_APP_FILTER_EMA_SHIFT.
+ *
+ * The IAQ index is held unless it changes by 2 or more, or the new index is
+ * seen CONFIG_APP_FILTER_HOLD_SAMPLES times in a row, so the rating does not
+ * flicker between neighbouring levels.
+*/
+#define FILTER_WINDOW_MAX 9
+
+struct filter_window
+{
+	fxp_t ring[FILTER_WINDOW_MAX];	 /* in arrival order */
+	fxp_t sorted[FILTER_WINDOW_MAX]; /* ascending */
+	uint8_t size;
+	uint8_t count;
+	uint8_t head; /* oldest sample, if full */
+};
+
+struct filter_ema
+{
+	fxp_t value;
+	bool primed;
+};
+
+struct filter_hysteresis
+{
+	uint8_t held;
+	uint8_t candidate;
+	uint8_t seen;
+};
+
+struct filter_stats
+{
+	uint32_t outliers[RECORD_CHAN_COUNT]; /* samples replaced by the median */
+	uint32_t index_changes;				  /* IAQ index changes passed */
+	uint32_t index_held;				  /* IAQ index changes suppressed */
+};
+
+/* Building blocks
+*/
+void filter_window_init(struct filter_window *w, uint8_t size);
+
+void filter_window_add(struct filter_window *w, fxp_t value);
+
+fxp_t filter_window_median(const struct filter_window *w);
+
+fxp_t filter_window_mad(const struct filter_window *w, fxp_t median);
+
+fxp_t filter_ema_update(struct filter_ema *ema, fxp_t value, unsigned int shift);
+
+uint8_t filter_hysteresis_update(struct filter_hysteresis *h, uint8_t value, uint8_t hold);
+
+/* Conditioning of the record channels (main thread only); without
+ * CONFIG_APP_FILTER, the values are passed through.
+*/
+#if defined(CONFIG_APP_FILTER)
+
+void filter_reset(void);
+
+fxp_t filter_sample(enum record_channel channel, fxp_t value);
+
+uint8_t filter_iaq_index(uint8_t iaq_index);
+
+void filter_get_stats(struct filter_stats *stats);
+
+#else
+
+static inline fxp_t filter_sample(enum record_channel channel, fxp_t value)
+{
+	return value;
+}
+
+static inline uint8_t filter_iaq_index(uint8_t iaq_index)
+{
+	return iaq_index;
+}
+
+#endif
+
+#endif
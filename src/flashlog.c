@@ -0,0 +1,526 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <fs/fcb.h>
+#include <storage/flash_map.h>
+#include <sys/byteorder.h>
+#include <string.h>
+
+#include "flashlog.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(flashlog, CONFIG_APP_FLASHLOG_LOG_LEVEL);
+
+#define FLASHLOG_AREA_ID FLASH_AREA_ID(storage)
+#define FLASHLOG_MAGIC 0x49415131 /* "IAQ1" */
+#define FLASHLOG_VERSION 1
+#define FLASHLOG_MAX_SECTORS 16
+
+#define FLASHLOG_THREAD_STACK_SIZE 1024
+#define FLASHLOG_THREAD_PRIORITY 10
+
+/* Entry types ...
+*/
+enum flashlog_entry_type
+{
+	FLASHLOG_ENTRY_RECORDS = 1,
+	FLASHLOG_ENTRY_BASELINE = 2,
+};
+
+/* Every FCB entry starts with this header (4 bytes, keeping the entry
+ * word-aligned for the flash driver).
+*/
+struct flashlog_header
+{
+	uint8_t type;
+	uint8_t count;
+	uint16_t boot;
+} __packed;
+
+struct flashlog_batch
+{
+	struct flashlog_header header;
+	struct iaq_record_packed records[FLASHLOG_BATCH_RECORDS];
+} __packed;
+
+/* CCS811 baseline entry ...
+*/
+struct flashlog_baseline
+{
+	struct flashlog_header header;
+	uint16_t baseline;
+	uint16_t reserved;
+	uint32_t runtime; /* sensor runtime since its power-up or reset (s) */
+} __packed;
+
+BUILD_ASSERT(FLASHLOG_BATCH_RECORDS <= UINT8_MAX, "Batch too large");
+BUILD_ASSERT(sizeof(struct flashlog_baseline) % 4 == 0, "Baseline entry not word-aligned");
+BUILD_ASSERT(sizeof(struct flashlog_batch) % 4 == 0, "Batch not word-aligned");
+
+static struct fcb fcb;
+static struct flash_sector sectors[FLASHLOG_MAX_SECTORS];
+static K_MUTEX_DEFINE(fcb_lock);
+static bool ready = false;
+
+static struct flashlog_stats stats;
+
+/* Latest baseline entry found at startup
+*/
+static struct flashlog_baseline last_baseline;
+static bool last_baseline_valid = false;
+
+/* Staging: Two batches, one being filled by flashlog_add(), the other one
+ * being written by the flashlog thread.
+*/
+static struct flashlog_batch batches[2];
+static uint8_t staging = 0;
+static atomic_t writing = ATOMIC_INIT(0);
+static K_SEM_DEFINE(write_sem, 0, 1);
+
+/* Accumulator for the current logging interval ...
+ * The staging lock protects it and the staged batch, as flashlog_flush()
+ * may be called from another thread than flashlog_add().
+*/
+static struct k_spinlock staging_lock;
+static struct
+{
+	uint32_t start;
+	uint32_t n;
+	int64_t sum[RECORD_CHAN_COUNT];
+	uint8_t iaq_index;
+} acc;
+
+/* Appends an entry to the FCB, erasing the oldest sector if necessary ...
+*/
+static int flashlog_append(const void *data, uint16_t len)
+{
+	struct fcb_entry loc;
+	int rc;
+
+	k_mutex_lock(&fcb_lock, K_FOREVER);
+
+	rc = fcb_append(&fcb, len, &loc);
+	if (rc == -ENOSPC)
+	{
+		rc = fcb_rotate(&fcb);
+		if (rc == 0)
+		{
+			stats.erases++;
+			rc = fcb_append(&fcb, len, &loc);
+		}
+	}
+	if (rc == 0)
+	{
+		rc = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), data, len);
+	}
+	if (rc == 0)
+	{
+		rc = fcb_append_finish(&fcb, &loc);
+	}
+
+	k_mutex_unlock(&fcb_lock);
+
+	return rc;
+}
+
+/* Thread writing the staged batches ...
+*/
+static void flashlog_run(void *p1, void *p2, void *p3)
+{
+	while (1)
+	{
+		k_sem_take(&write_sem, K_FOREVER);
+
+		struct flashlog_batch *batch = &batches[staging ^ 1];
+		uint16_t len = sizeof(batch->header) + batch->header.count * sizeof(batch->records[0]);
+		int rc = flashlog_append(batch, len);
+
+		if (rc == 0)
+		{
+			stats.records_logged += batch->header.count;
+			stats.batches++;
+		}
+		else
+		{
+			stats.records_lost += batch->header.count;
+			LOG_WRN("Write failed (err %d)", rc);
+		}
+
+		atomic_clear(&writing);
+	}
+}
+
+K_THREAD_STACK_DEFINE(flashlog_thread_stack, FLASHLOG_THREAD_STACK_SIZE);
+static struct k_thread flashlog_thread_data;
+
+/* Hands the staged batch over to the flashlog thread ...
+*/
+static void flashlog_submit(void)
+{
+	if (batches[staging].header.count == 0)
+	{
+		return;
+	}
+
+	if (!atomic_cas(&writing, 0, 1))
+	{
+		/* Previous batch still being written */
+		stats.records_lost += batches[staging].header.count;
+		batches[staging].header.count = 0;
+		return;
+	}
+
+	staging ^= 1;
+	batches[staging].header.type = FLASHLOG_ENTRY_RECORDS;
+	batches[staging].header.boot = sys_cpu_to_le16(stats.boot);
+	batches[staging].header.count = 0;
+	k_sem_give(&write_sem);
+}
+
+/* Iterates over all entries (oldest first) ...
+*/
+static int flashlog_foreach(bool (*cb)(uint16_t boot, const struct flashlog_header *header,
+									   void *user_data),
+							void *user_data, struct fcb_entry *loc)
+{
+	struct flashlog_header header;
+	int rc;
+
+	loc->fe_sector = NULL;
+	loc->fe_elem_off = 0;
+
+	while ((rc = fcb_getnext(&fcb, loc)) == 0)
+	{
+		if (loc->fe_data_len < sizeof(header) ||
+			flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(*loc), &header, sizeof(header)) != 0)
+		{
+			continue;
+		}
+		if (!cb(sys_le16_to_cpu(header.boot), &header, user_data))
+		{
+			break;
+		}
+	}
+
+	return rc == -ENOTSUP ? 0 : rc;
+}
+
+/* Walk callback used at startup: Find the latest boot number and the
+ * latest CCS811 baseline ...
+*/
+struct scan_ctx
+{
+	uint16_t last_boot;
+	struct fcb_entry *loc;
+};
+
+static bool scan_entry(uint16_t boot, const struct flashlog_header *header, void *user_data)
+{
+	struct scan_ctx *ctx = user_data;
+
+	ctx->last_boot = boot;
+	if (header->type == FLASHLOG_ENTRY_BASELINE &&
+		ctx->loc->fe_data_len == sizeof(last_baseline) &&
+		flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(*ctx->loc), &last_baseline,
+						sizeof(last_baseline)) == 0)
+	{
+		last_baseline_valid = true;
+	}
+	return true;
+}
+
+/* Initializes the flash log: Recovers the FCB state and determines the
+ * boot number by scanning the entry headers only.
+*/
+int flashlog_init(void)
+{
+	uint32_t sector_cnt = ARRAY_SIZE(sectors);
+	struct fcb_entry loc;
+	struct scan_ctx ctx = {
+		.last_boot = 0,
+		.loc = &loc,
+	};
+	int rc;
+
+	rc = flash_area_get_sectors(FLASHLOG_AREA_ID, &sector_cnt, sectors);
+	if (rc)
+	{
+		LOG_ERR("No flash sectors (err %d)", rc);
+		return rc;
+	}
+
+	fcb.f_magic = FLASHLOG_MAGIC;
+	fcb.f_version = FLASHLOG_VERSION;
+	fcb.f_sector_cnt = sector_cnt;
+	fcb.f_scratch_cnt = 0;
+	fcb.f_sectors = sectors;
+
+	rc = fcb_init(FLASHLOG_AREA_ID, &fcb);
+	if (rc)
+	{
+		LOG_ERR("FCB init failed (err %d)", rc);
+		return rc;
+	}
+
+	k_mutex_lock(&fcb_lock, K_FOREVER);
+	flashlog_foreach(scan_entry, &ctx, &loc);
+	k_mutex_unlock(&fcb_lock);
+
+	stats.boot = ctx.last_boot + 1;
+	batches[staging].header.type = FLASHLOG_ENTRY_RECORDS;
+	batches[staging].header.boot = sys_cpu_to_le16(stats.boot);
+	acc.n = 0;
+
+	k_thread_create(&flashlog_thread_data, flashlog_thread_stack,
+					K_THREAD_STACK_SIZEOF(flashlog_thread_stack),
+					flashlog_run, NULL, NULL, NULL,
+					FLASHLOG_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&flashlog_thread_data, "flashlog");
+
+	ready = true;
+	LOG_INF("%u sectors, boot %u", sector_cnt, stats.boot);
+
+	return 0;
+}
+
+/* Closes the current interval: Stages its mean values ...
+*/
+static void flashlog_stage(void)
+{
+	struct flashlog_batch *batch = &batches[staging];
+	struct iaq_record record;
+
+	record.timestamp = acc.start;
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		record.values[ch] = (fxp_t)(acc.sum[ch] / acc.n);
+	}
+	record.iaq_index = acc.iaq_index == UINT8_MAX ? 0 : acc.iaq_index;
+
+	record_pack(&record, &batch->records[batch->header.count++]);
+	if (batch->header.count == FLASHLOG_BATCH_RECORDS)
+	{
+		flashlog_submit();
+	}
+}
+
+/* Adds a record to the log. Only the consumer stage calls this function.
+*/
+void flashlog_add(const struct iaq_record *record)
+{
+	k_spinlock_key_t key;
+
+	if (!ready)
+	{
+		return;
+	}
+
+	key = k_spin_lock(&staging_lock);
+	if (acc.n > 0 && record->timestamp - acc.start >= FLASHLOG_INTERVAL_MS)
+	{
+		flashlog_stage();
+		acc.n = 0;
+	}
+	if (acc.n == 0)
+	{
+		acc.start = record->timestamp;
+		acc.iaq_index = UINT8_MAX;
+		memset(acc.sum, 0, sizeof(acc.sum));
+	}
+
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		acc.sum[ch] += record->values[ch];
+	}
+	if (record->iaq_index > 0)
+	{
+		acc.iaq_index = MIN(acc.iaq_index, record->iaq_index);
+	}
+	acc.n++;
+
+	k_spin_unlock(&staging_lock, key);
+}
+
+/* Writes the staged records, including the open interval, now (e.g. before
+ * a planned reset). The write completes asynchronously on the flashlog
+ * thread.
+*/
+void flashlog_flush(void)
+{
+	k_spinlock_key_t key;
+
+	if (!ready)
+	{
+		return;
+	}
+
+	key = k_spin_lock(&staging_lock);
+	if (acc.n > 0)
+	{
+		flashlog_stage();
+		acc.n = 0;
+	}
+	flashlog_submit();
+	k_spin_unlock(&staging_lock, key);
+}
+
+/* Walks all logged records of the given boot (starting at uptime 'from')
+ * and of all later boots, oldest first. The log is never loaded into RAM as
+ * a whole: Up to FLASHLOG_WALK_RECORDS records are read with the FCB lock
+ * held and passed to the callback with the lock released, so a slow
+ * callback (e.g. a BLE transfer) blocks neither the flashlog thread nor
+ * flashlog_save_baseline(). If the oldest sector is erased meanwhile, the
+ * walk starts over, skipping the records passed on already.
+*/
+#define FLASHLOG_WALK_RECORDS 8
+
+int flashlog_walk(uint16_t boot, uint32_t from, flashlog_cb_t cb, void *user_data)
+{
+	struct iaq_record_packed packed[FLASHLOG_WALK_RECORDS];
+	struct iaq_record record;
+	struct flashlog_header header = {.count = 0};
+	struct fcb_entry loc = {.fe_sector = NULL, .fe_elem_off = 0};
+	uint16_t entry_boot = 0;
+	uint32_t erases;
+	int index = 0; /* next record of the current entry */
+	int count;
+	int rc;
+
+	if (!ready)
+	{
+		return -ENODEV;
+	}
+
+	k_mutex_lock(&fcb_lock, K_FOREVER);
+	erases = stats.erases;
+	while (1)
+	{
+		if (stats.erases != erases)
+		{
+			/* The current entry may be gone, start over
+			*/
+			loc.fe_sector = NULL;
+			loc.fe_elem_off = 0;
+			header.count = 0;
+			erases = stats.erases;
+		}
+
+		/* Next entry with records of the requested boots
+		*/
+		if (index >= header.count)
+		{
+			rc = fcb_getnext(&fcb, &loc);
+			if (rc != 0)
+			{
+				break;
+			}
+			index = 0;
+			if (loc.fe_data_len < sizeof(header) ||
+				flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), &header, sizeof(header)) != 0)
+			{
+				header.count = 0;
+				continue;
+			}
+			entry_boot = sys_le16_to_cpu(header.boot);
+			/* Boot numbers wrap around, compare the distance */
+			if (header.type != FLASHLOG_ENTRY_RECORDS || (int16_t)(entry_boot - boot) < 0)
+			{
+				header.count = 0;
+				continue;
+			}
+		}
+
+		count = MIN(header.count - index, FLASHLOG_WALK_RECORDS);
+		if (flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc) + sizeof(header) + index * sizeof(packed[0]),
+							packed, count * sizeof(packed[0])) != 0)
+		{
+			header.count = 0;
+			continue;
+		}
+		index += count;
+		k_mutex_unlock(&fcb_lock);
+
+		for (int i = 0; i < count; i++)
+		{
+			record_unpack(&packed[i], &record);
+			if (entry_boot == boot && record.timestamp < from)
+			{
+				continue;
+			}
+			if (!cb(entry_boot, &record, user_data))
+			{
+				return 0;
+			}
+			/* Resume position in case the walk starts over */
+			boot = entry_boot;
+			from = record.timestamp + 1;
+		}
+
+		k_mutex_lock(&fcb_lock, K_FOREVER);
+	}
+	k_mutex_unlock(&fcb_lock);
+
+	return rc == -ENOTSUP ? 0 : rc;
+}
+
+/* Saves a CCS811 baseline (written synchronously) ...
+*/
+int flashlog_save_baseline(uint16_t baseline, uint32_t runtime)
+{
+	struct flashlog_baseline entry = {
+		.header = {
+			.type = FLASHLOG_ENTRY_BASELINE,
+			.count = 0,
+			.boot = sys_cpu_to_le16(stats.boot),
+		},
+		.baseline = sys_cpu_to_le16(baseline),
+		.runtime = sys_cpu_to_le32(runtime),
+	};
+
+	if (!ready)
+	{
+		return -ENODEV;
+	}
+
+	return flashlog_append(&entry, sizeof(entry));
+}
+
+/* Gets the latest CCS811 baseline saved before this boot, the sensor runtime
+ * at the time of saving and the age in boots ...
+*/
+int flashlog_load_baseline(uint16_t *baseline, uint32_t *runtime, uint16_t *boot_age)
+{
+	if (!ready || !last_baseline_valid)
+	{
+		return -ENOENT;
+	}
+
+	*baseline = sys_le16_to_cpu(last_baseline.baseline);
+	*runtime = sys_le32_to_cpu(last_baseline.runtime);
+	*boot_age = stats.boot - sys_le16_to_cpu(last_baseline.header.boot);
+
+	return 0;
+}
+
+void flashlog_get_stats(struct flashlog_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,72 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FLASHLOG_H
+#define __FLASHLOG_H
+
+#include <zephyr.h>
+
+#include "record.h"
+
+/* Persistent, append-only log of records on the internal flash ...
+ * The log lives in the 'storage' partition and is managed by a flash circular
+ * buffer (FCB). One record per FLASHLOG_INTERVAL_MS (mean values, worst IAQ
+ * index) is staged in RAM and FLASHLOG_BATCH_RECORDS records are written as
+ * one FCB entry. Once the partition is full, the oldest sector is erased.
+ *
+ * Wear: With a 1 min interval a batch of 63 records (1 KB) is written about
+ * every hour, i.e. 16 bytes per minute. With 4 KB sectors each sector is
+ * erased once per (number of sectors x ~3.7 h); on the 32 KB partition of the
+ * nRF5340 DK that is less than once a day per sector. A power loss loses at
+ * most the staged records (< 1 batch).
+ *
+ * The log also keeps the CCS811 baseline, which is saved periodically.
+*/
+#define FLASHLOG_INTERVAL_MS (60 * MSEC_PER_SEC)
+#define FLASHLOG_BATCH_RECORDS 63
+
+struct flashlog_stats
+{
+	uint32_t records_logged; /* records written to flash */
+	uint32_t records_lost;	 /* records lost due to flash errors */
+	uint32_t batches;		 /* FCB entries written */
+	uint32_t erases;		 /* sectors erased */
+	uint16_t boot;			 /* current boot number */
+};
+
+/* Callback for walking the log: Return false to stop walking.
+*/
+typedef bool (*flashlog_cb_t)(uint16_t boot, const struct iaq_record *record, void *user_data);
+
+int flashlog_init(void);
+
+void flashlog_add(const struct iaq_record *record);
+
+void flashlog_flush(void);
+
+int flashlog_walk(uint16_t boot, uint32_t from, flashlog_cb_t cb, void *user_data);
+
+int flashlog_save_baseline(uint16_t baseline, uint32_t runtime);
+
+int flashlog_load_baseline(uint16_t *baseline, uint32_t *runtime, uint16_t *boot_age);
+
+void flashlog_get_stats(struct flashlog_stats *stats);
+
+#endif
@@ -0,0 +1,101 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+
+#include "fxp.h"
+
+/* Rounds a value (half away from zero) to the given number of decimals and
+ * returns it as scaled integer, e.g. 21.456 with 2 decimals: 2146.
+ * Only divisions by constants are used, which the compiler turns into
+ * multiplications.
+*/
+int32_t fxp_round(fxp_t value, unsigned int decimals)
+{
+	uint32_t x = value < 0 ? -(uint32_t)value : (uint32_t)value;
+
+	switch (decimals)
+	{
+	case 0:
+		x = (x + 500U) / 1000U;
+		break;
+	case 1:
+		x = (x + 50U) / 100U;
+		break;
+	case 2:
+		x = (x + 5U) / 10U;
+		break;
+	default:
+		break;
+	}
+
+	return value < 0 ? -(int32_t)x : (int32_t)x;
+}
+
+/* Formats a value with the given number of decimals (max. FXP_DECIMALS)
+ * without using the printf family. Returns the length of the string.
+*/
+int fxp_format(char *buf, size_t size, fxp_t value, unsigned int decimals)
+{
+	char tmp[FXP_STR_LEN];
+	int32_t rounded;
+	uint32_t x;
+	unsigned int digits = 0;
+	int n = 0;
+	int len = 0;
+
+	if (decimals > FXP_DECIMALS)
+	{
+		decimals = FXP_DECIMALS;
+	}
+
+	rounded = fxp_round(value, decimals);
+	x = rounded < 0 ? -(uint32_t)rounded : (uint32_t)rounded;
+
+	/* Digits in reverse order ...
+	*/
+	do
+	{
+		tmp[n++] = '0' + x % 10U;
+		x /= 10U;
+		if (++digits == decimals)
+		{
+			tmp[n++] = '.';
+		}
+	} while (x != 0 || digits <= decimals);
+
+	if (rounded < 0)
+	{
+		tmp[n++] = '-';
+	}
+
+	if (size == 0)
+	{
+		return 0;
+	}
+
+	while (n > 0 && (size_t)len < size - 1)
+	{
+		buf[len++] = tmp[--n];
+	}
+	buf[len] = '\0';
+
+	return len;
+}
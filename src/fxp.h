@@ -0,0 +1,77 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FXP_H
+#define __FXP_H
+
+#include <zephyr.h>
+#include <drivers/sensor.h>
+
+/* Fixed-point numbers ...
+ * Sensor values are handled as signed 32 bit integers in units of 1/1000
+ * (e.g. m°C, m%RH, Pa for kPa). This covers +/- 2147483.647 which is more
+ * than enough for all of the sensor channels in use.
+*/
+typedef int32_t fxp_t;
+
+#define FXP_SCALE 1000
+#define FXP_DECIMALS 3
+
+/* Max. length of a formatted value incl. sign, decimal point and NUL */
+#define FXP_STR_LEN 13
+
+static inline fxp_t fxp_from_sensor_value(const struct sensor_value *value)
+{
+	/* val1 and val2 carry the same sign */
+	return value->val1 * FXP_SCALE + value->val2 / (1000000 / FXP_SCALE);
+}
+
+static inline void fxp_to_sensor_value(fxp_t value, struct sensor_value *out)
+{
+	out->val1 = value / FXP_SCALE;
+	out->val2 = (value % FXP_SCALE) * (1000000 / FXP_SCALE);
+}
+
+static inline fxp_t fxp_from_int(int32_t value)
+{
+	return value * FXP_SCALE;
+}
+
+/* Integer part, truncated towards zero */
+static inline int32_t fxp_to_int(fxp_t value)
+{
+	return value / FXP_SCALE;
+}
+
+static inline fxp_t fxp_mul(fxp_t a, fxp_t b)
+{
+	return (fxp_t)(((int64_t)a * b) / FXP_SCALE);
+}
+
+static inline fxp_t fxp_div(fxp_t a, fxp_t b)
+{
+	return (fxp_t)(((int64_t)a * FXP_SCALE) / b);
+}
+
+int32_t fxp_round(fxp_t value, unsigned int decimals);
+
+int fxp_format(char *buf, size_t size, fxp_t value, unsigned int decimals);
+
+#endif
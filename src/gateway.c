@@ -0,0 +1,215 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+
+#include "gateway.h"
+
+/* AD structure type of manufacturer specific data (see Core Specification
+ * Supplement), spelled out to keep this module free of Bluetooth headers.
+*/
+#define GATEWAY_AD_MANUFACTURER_DATA 0xff
+
+static struct gateway_node nodes[GATEWAY_MAX_NODES];
+static uint8_t node_count;
+static struct gateway_stats stats;
+static struct k_spinlock gateway_lock;
+
+static inline bool node_active(const struct gateway_node *node, uint32_t now)
+{
+	return now - node->last_seen <= GATEWAY_NODE_TIMEOUT_MS;
+}
+
+/* Finds the manufacturer specific data in the advertising data ...
+ * Returns a pointer to the data (without the AD header) or NULL.
+*/
+static const uint8_t *find_manufacturer_data(const uint8_t *data, size_t len, size_t *data_len)
+{
+	size_t i = 0;
+
+	while (i + 1 < len)
+	{
+		uint8_t ad_len = data[i];
+
+		/* Zero length: Early termination (padding)
+		*/
+		if (ad_len == 0 || i + 1 + ad_len > len)
+		{
+			break;
+		}
+		if (data[i + 1] == GATEWAY_AD_MANUFACTURER_DATA)
+		{
+			*data_len = ad_len - 1;
+			return &data[i + 2];
+		}
+		i += 1 + ad_len;
+	}
+
+	return NULL;
+}
+
+/* Finds the slot for a node: The node's slot if known, else a free slot,
+ * an inactive slot or - if the table is full - the least recently seen node.
+*/
+static struct gateway_node *find_slot(const struct gateway_addr *addr, uint32_t now, bool *known)
+{
+	struct gateway_node *oldest = &nodes[0];
+
+	for (int i = 0; i < node_count; i++)
+	{
+		if (memcmp(&nodes[i].addr, addr, sizeof(*addr)) == 0)
+		{
+			*known = true;
+			return &nodes[i];
+		}
+		if ((int32_t)(nodes[i].last_seen - oldest->last_seen) < 0)
+		{
+			oldest = &nodes[i];
+		}
+	}
+
+	*known = false;
+	if (node_count < GATEWAY_MAX_NODES)
+	{
+		return &nodes[node_count++];
+	}
+	if (node_active(oldest, now))
+	{
+		stats.nodes_evicted++;
+	}
+
+	return oldest;
+}
+
+/* Processes a received advertisement (raw AD structures) ...
+ * Returns 0 if the node's record was updated, -EALREADY for a duplicate and
+ * -EINVAL if the advertisement does not carry an IAQ payload.
+*/
+int gateway_process_adv(const struct gateway_addr *addr, int8_t rssi,
+						const uint8_t *data, size_t len, uint32_t now)
+{
+	const uint8_t *payload;
+	size_t payload_len;
+	struct iaq_record record;
+	struct gateway_node *node;
+	uint8_t seq;
+	bool known;
+	int rc = 0;
+
+	/* Decode outside of the lock; most advertisements are not ours
+	*/
+	payload = find_manufacturer_data(data, len, &payload_len);
+	if (payload == NULL ||
+		record_unpack_adv(payload, payload_len, CONFIG_APP_BT_COMPANY_ID, &record, &seq) != 0)
+	{
+		payload = NULL;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&gateway_lock);
+
+	stats.adv_received++;
+	if (payload == NULL)
+	{
+		k_spin_unlock(&gateway_lock, key);
+		return -EINVAL;
+	}
+	stats.adv_decoded++;
+
+	node = find_slot(addr, now, &known);
+	if (known && node->seq == seq && node_active(node, now))
+	{
+		stats.adv_duplicate++;
+		rc = -EALREADY;
+	}
+	else
+	{
+		node->addr = *addr;
+		node->seq = seq;
+		node->record = record;
+		node->record.timestamp = now;
+	}
+	node->rssi = rssi;
+	node->last_seen = now;
+
+	k_spin_unlock(&gateway_lock, key);
+
+	return rc;
+}
+
+/* Summarizes the records of all active nodes ...
+*/
+void gateway_get_summary(struct gateway_summary *summary, uint32_t now)
+{
+	k_spinlock_key_t key = k_spin_lock(&gateway_lock);
+
+	summary->nodes = 0;
+	summary->worst_iaq_index = 0;
+	summary->co2_max = 0;
+
+	for (int i = 0; i < node_count; i++)
+	{
+		const struct gateway_node *node = &nodes[i];
+
+		if (!node_active(node, now))
+		{
+			continue;
+		}
+		summary->nodes++;
+		if (node->record.iaq_index != 0 &&
+			(summary->worst_iaq_index == 0 || node->record.iaq_index < summary->worst_iaq_index))
+		{
+			summary->worst_iaq_index = node->record.iaq_index;
+		}
+		summary->co2_max = MAX(summary->co2_max, node->record.values[RECORD_CHAN_CO2]);
+	}
+
+	k_spin_unlock(&gateway_lock, key);
+}
+
+/* Copies up to max_nodes active nodes, returns the number of nodes copied.
+*/
+size_t gateway_get_nodes(struct gateway_node *out, size_t max_nodes, uint32_t now)
+{
+	size_t n = 0;
+	k_spinlock_key_t key = k_spin_lock(&gateway_lock);
+
+	for (int i = 0; i < node_count && n < max_nodes; i++)
+	{
+		if (node_active(&nodes[i], now))
+		{
+			out[n++] = nodes[i];
+		}
+	}
+
+	k_spin_unlock(&gateway_lock, key);
+
+	return n;
+}
+
+void gateway_get_stats(struct gateway_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&gateway_lock);
+
+	*out = stats;
+
+	k_spin_unlock(&gateway_lock, key);
+}
@@ -0,0 +1,83 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __GATEWAY_H
+#define __GATEWAY_H
+
+#include <zephyr.h>
+
+#include "record.h"
+
+/* Gateway role: Aggregation of neighbouring IAQ monitors ...
+ * The advertisements of other monitors (see ble.h) are decoded and kept in a
+ * statically allocated table with the latest record per node. Nodes are
+ * identified by their address; repeated advertisements with the same
+ * sequence number are dropped as duplicates. Nodes not heard of within
+ * GATEWAY_NODE_TIMEOUT_MS are considered gone and their slots are reused.
+ *
+ * The module does not depend on the Bluetooth stack: the scanner passes the
+ * raw advertising data, so captured advertisements can be replayed through
+ * gateway_process_adv() on any host.
+*/
+#define GATEWAY_MAX_NODES CONFIG_APP_GATEWAY_MAX_NODES
+#define GATEWAY_NODE_TIMEOUT_MS (CONFIG_APP_GATEWAY_NODE_TIMEOUT_S * MSEC_PER_SEC)
+
+/* Node address, same layout as bt_addr_le_t
+*/
+struct gateway_addr
+{
+	uint8_t type;
+	uint8_t val[6];
+};
+
+struct gateway_node
+{
+	struct gateway_addr addr;
+	uint8_t seq;
+	int8_t rssi;
+	uint32_t last_seen;	  /* uptime in ms */
+	struct iaq_record record; /* timestamp: uptime in ms of the last update */
+};
+
+struct gateway_summary
+{
+	uint8_t nodes;			 /* active nodes */
+	uint8_t worst_iaq_index; /* lowest IAQ index of all active nodes, 0 = n/a */
+	fxp_t co2_max;			 /* highest eCO2 of all active nodes */
+};
+
+struct gateway_stats
+{
+	uint32_t adv_received;	/* advertisements processed */
+	uint32_t adv_decoded;	/* advertisements carrying an IAQ payload */
+	uint32_t adv_duplicate; /* IAQ payloads with an already known sequence number */
+	uint32_t nodes_evicted; /* active nodes dropped because the table was full */
+};
+
+int gateway_process_adv(const struct gateway_addr *addr, int8_t rssi,
+						const uint8_t *data, size_t len, uint32_t now);
+
+void gateway_get_summary(struct gateway_summary *summary, uint32_t now);
+
+size_t gateway_get_nodes(struct gateway_node *nodes, size_t max_nodes, uint32_t now);
+
+void gateway_get_stats(struct gateway_stats *stats);
+
+#endif
@@ -26,11 +26,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <string.h>
 
+#include "channels.h"
+#include "fxp.h"
 #include "gui.h"
+#include "iaq.h"
+#include "latency.h"
+#include "power.h"
 
-#define LOG_LEVEL CONFIG_LOG_DEFAULT_LEVEL
 #include <logging/log.h>
-LOG_MODULE_REGISTER(gui);
+LOG_MODULE_REGISTER(gui, CONFIG_APP_GUI_LOG_LEVEL);
 
 const struct device *display_dev;
 
@@ -49,6 +53,108 @@ lv_obj_t *co2_label;
 lv_obj_t *co2_value_label;
 lv_obj_t *tvoc_label;
 lv_obj_t *tvoc_value_label;
+lv_obj_t *summary_label;
+lv_obj_t *stats_label;
+lv_obj_t *alarm_banner;
+
+/* GUI update channel ...
+ * LVGL is not thread-safe, so only the GUI thread touches LVGL objects.
+ * Other threads post compact update records into a lock-free single-producer /
+ * single-consumer ring buffer, which the GUI thread drains in one batch before
+ * running the LVGL task handler. The (only) producer is the application's
+ * consumer stage in main(); the alarm thread and the recorder post their
+ * updates outside of the ring (see below).
+*/
+enum gui_item
+{
+	GUI_ITEM_TEMP,
+	GUI_ITEM_PRESS,
+	GUI_ITEM_HUMIDITY,
+	GUI_ITEM_CO2,
+	GUI_ITEM_VOC,
+	GUI_ITEM_QUALITY,
+	GUI_ITEM_RATING,
+	GUI_ITEM_CALIBRATION,
+	GUI_ITEM_HEADLINE,
+	GUI_ITEM_SUMMARY_NODES,
+	GUI_ITEM_SUMMARY_QUALITY,
+	GUI_ITEM_SUMMARY_CO2,
+	GUI_ITEM_STATS_MEAN,
+	GUI_ITEM_STATS_BUCKET_P95,
+	GUI_ITEM_STATS_EXPOSURE,
+};
+
+struct gui_update
+{
+	uint8_t item; /* enum gui_item */
+	union
+	{
+		int32_t value;	  /* fixed-point value or plain integer */
+		const char *text; /* static string */
+	};
+};
+
+#define GUI_UPDATE_RING_SIZE 32 /* must be a power of 2 */
+
+static struct gui_update update_ring[GUI_UPDATE_RING_SIZE];
+static atomic_t update_head = ATOMIC_INIT(0); /* written by the producer only */
+static atomic_t update_tail = ATOMIC_INIT(0); /* written by the GUI thread only */
+static atomic_t update_dropped = ATOMIC_INIT(0);
+
+static K_SEM_DEFINE(gui_ready_sem, 0, 1);
+static K_SEM_DEFINE(gui_wakeup_sem, 0, 1);
+
+/* Alarm banner: Posted by the alarm thread, i.e. outside of the update
+ * ring (single producer); only the latest text matters.
+*/
+static struct k_spinlock alarm_lock;
+static const char *alarm_text;
+static bool alarm_pending;
+
+/* Statistics: Posted by the recorder thread, also outside of the ring;
+ * only the latest values matter.
+*/
+static struct k_spinlock stats_lock;
+static int32_t stats_values[3]; /* GUI_ITEM_STATS_MEAN ... */
+static bool stats_pending;
+
+/* Last rendered value per item: Unchanged values neither invalidate
+ * the screen area nor cause a display transfer.
+*/
+#define GUI_ITEM_COUNT (GUI_ITEM_STATS_EXPOSURE + 1)
+#define GUI_VALUE_NONE INT32_MIN
+
+static union
+{
+	int32_t value;
+	const char *text;
+} rendered[GUI_ITEM_COUNT];
+
+static void gui_post(uint8_t item, int32_t value, const char *text)
+{
+	atomic_val_t head = atomic_get(&update_head);
+	struct gui_update *update;
+
+	if (head - atomic_get(&update_tail) >= GUI_UPDATE_RING_SIZE)
+	{
+		atomic_inc(&update_dropped);
+		return;
+	}
+
+	update = &update_ring[head & (GUI_UPDATE_RING_SIZE - 1)];
+	update->item = item;
+	if (text != NULL)
+	{
+		update->text = text;
+	}
+	else
+	{
+		update->value = value;
+	}
+	atomic_set(&update_head, head + 1);
+
+	k_sem_give(&gui_wakeup_sem);
+}
 
 /* GUI setup ... 
 */
@@ -151,49 +257,504 @@ void gui_setup(void)
 	lv_obj_set_x(tvoc_value_label, 245);
 	lv_obj_set_y(tvoc_value_label, line0_y + line_space * line);
 	lv_label_set_text(tvoc_value_label, "...");
+
+#if defined(CONFIG_APP_GATEWAY)
+	summary_label = lv_label_create(lv_scr_act(), NULL);
+	lv_obj_set_x(summary_label, 10);
+	lv_obj_set_y(summary_label, 218);
+	lv_label_set_text(summary_label, "Scanning for other monitors ...");
+#endif
+
+#if defined(CONFIG_APP_STATS)
+	stats_label = lv_label_create(lv_scr_act(), NULL);
+	lv_obj_set_x(stats_label, 10);
+	lv_obj_set_y(stats_label, 10);
+	lv_label_set_text(stats_label, "");
+#endif
+
+#if defined(CONFIG_APP_ALARM)
+	static lv_style_t alarm_style;
+	lv_style_init(&alarm_style);
+	lv_style_set_bg_opa(&alarm_style, LV_STATE_DEFAULT, LV_OPA_COVER);
+	lv_style_set_bg_color(&alarm_style, LV_STATE_DEFAULT, LV_COLOR_RED);
+	lv_style_set_text_color(&alarm_style, LV_STATE_DEFAULT, LV_COLOR_WHITE);
+	lv_style_set_text_font(&alarm_style, LV_STATE_DEFAULT, lv_theme_get_font_title());
+
+	alarm_banner = lv_label_create(lv_scr_act(), NULL);
+	lv_obj_add_style(alarm_banner, LV_LABEL_PART_MAIN, &alarm_style);
+	lv_label_set_long_mode(alarm_banner, LV_LABEL_LONG_CROP);
+	lv_label_set_align(alarm_banner, LV_LABEL_ALIGN_CENTER);
+	lv_obj_set_x(alarm_banner, 0);
+	lv_obj_set_y(alarm_banner, 0);
+	lv_obj_set_width(alarm_banner, lv_disp_get_hor_res(NULL));
+	lv_obj_set_height(alarm_banner, 40);
+	lv_label_set_text(alarm_banner, "");
+	lv_obj_set_hidden(alarm_banner, true);
+#endif
+
+	for (int i = 0; i < GUI_ITEM_COUNT; i++)
+	{
+		rendered[i].value = GUI_VALUE_NONE;
+	}
+	rendered[GUI_ITEM_RATING].text = NULL;
+	rendered[GUI_ITEM_HEADLINE].text = NULL;
+
+	k_sem_give(&gui_ready_sem);
+}
+
+/* Displayed decimals per sensor value item ...
+*/
+static const uint8_t item_decimals[] = {
+	[GUI_ITEM_TEMP] = 2,
+	[GUI_ITEM_PRESS] = 2,
+	[GUI_ITEM_HUMIDITY] = 2,
+	[GUI_ITEM_CO2] = 0,
+	[GUI_ITEM_VOC] = 0,
+};
+
+/* Sets the label text for a fixed-point value ...
+*/
+static void label_set_fxp(lv_obj_t *label, fxp_t value, unsigned int decimals)
+{
+	char buf[FXP_STR_LEN];
+
+	fxp_format(buf, sizeof(buf), value, decimals);
+	lv_label_set_text(label, buf);
 }
 
 /* Updates the value label for the refered sensor channel / value ... 
 */
-void gui_update_sensor_value(enum sensor_channel channel, struct sensor_value value)
+void gui_update_sensor_value(enum sensor_channel channel, fxp_t value)
 {
-	value.val2 = value.val2 / 10000;
 	switch (channel)
 	{
 	case SENSOR_CHAN_AMBIENT_TEMP:
-		lv_label_set_text_fmt(temp_value_label, "%d.%02d", value.val1, value.val2);
+		gui_post(GUI_ITEM_TEMP, value, NULL);
 		break;
 	case SENSOR_CHAN_PRESS:
-		lv_label_set_text_fmt(press_value_label, "%d.%02d", value.val1, value.val2);
+		gui_post(GUI_ITEM_PRESS, value, NULL);
 		break;
 	case SENSOR_CHAN_HUMIDITY:
-		lv_label_set_text_fmt(humid_value_label, "%d.%02d", value.val1, value.val2);
+		gui_post(GUI_ITEM_HUMIDITY, value, NULL);
 		break;
 	case SENSOR_CHAN_CO2:
-		lv_label_set_text_fmt(co2_value_label, "%u", value.val1);
+		gui_post(GUI_ITEM_CO2, value, NULL);
 		break;
 	case SENSOR_CHAN_VOC:
-		lv_label_set_text_fmt(tvoc_value_label, "%u", value.val1);
+		gui_post(GUI_ITEM_VOC, value, NULL);
+		break;
+	default:
 		break;
 	}
 }
 
 /* Updates the line meter and it's label with the 'relative IQAI' and the rating ... 
+ * The rating must be a static string.
 */
 void gui_update_qmeter(int8_t quality, const char *rating)
 {
-	lv_linemeter_set_value(qualitiy_meter, quality);
-	lv_label_set_text(qualitiy_label, rating);
+	gui_post(GUI_ITEM_QUALITY, quality, NULL);
+	gui_post(GUI_ITEM_RATING, 0, rating);
+}
+
+/* Updates the line meter's label with the remaining calibration time ... 
+*/
+void gui_update_calibration(uint32_t remaining_ms)
+{
+	gui_post(GUI_ITEM_QUALITY, 0, NULL);
+	gui_post(GUI_ITEM_CALIBRATION, remaining_ms, NULL);
+}
+
+/* Updates the headline. The text must be a static string.
+*/
+void gui_update_headline(const char *str)
+{
+	gui_post(GUI_ITEM_HEADLINE, 0, str);
+}
+
+/* Observer of record_chan and iaq_chan ...
+ * Runs in the publisher's context and only posts the values; the GUI
+ * thread renders them.
+*/
+static void gui_bus_changed(const struct bus_channel *chan, const void *message)
+{
+	if (chan == &record_chan)
+	{
+		const struct iaq_record *record = message;
+
+		gui_update_sensor_value(SENSOR_CHAN_AMBIENT_TEMP, record->values[RECORD_CHAN_TEMP]);
+		gui_update_sensor_value(SENSOR_CHAN_PRESS, record->values[RECORD_CHAN_PRESS]);
+		gui_update_sensor_value(SENSOR_CHAN_HUMIDITY, record->values[RECORD_CHAN_HUMIDITY]);
+		gui_update_sensor_value(SENSOR_CHAN_CO2, record->values[RECORD_CHAN_CO2]);
+		gui_update_sensor_value(SENSOR_CHAN_VOC, record->values[RECORD_CHAN_TVOC]);
+	}
+	else if (chan == &iaq_chan)
+	{
+		const struct iaq_result *result = message;
+
+		/* The 'relative quality' on the meter along with the IAQI rating,
+		 * else the remaining calibration time
+		*/
+		if (result->record.iaq_index > 0)
+		{
+			gui_update_qmeter(result->record.iaq_index * 100 / get_max_iaq_index(),
+							  get_iaq_rating(result->record.iaq_index));
+		}
+		else if (result->calibration_remaining_ms > 0)
+		{
+			gui_update_calibration(result->calibration_remaining_ms);
+		}
+	}
+}
+
+BUS_LISTENER_DEFINE(gui_listener, gui_bus_changed);
+
+/* Updates the building summary (gateway role) ...
+ * The quality of the worst node is given in percent, -1 if not available.
+*/
+void gui_update_summary(uint8_t nodes, int8_t worst_quality, fxp_t co2_max)
+{
+	gui_post(GUI_ITEM_SUMMARY_NODES, nodes, NULL);
+	gui_post(GUI_ITEM_SUMMARY_QUALITY, worst_quality, NULL);
+	gui_post(GUI_ITEM_SUMMARY_CO2, fxp_round(co2_max, 0), NULL);
+}
+
+/* Renders the building summary from the last posted values ...
+*/
+static void summary_render(void)
+{
+	if (summary_label == NULL || rendered[GUI_ITEM_SUMMARY_NODES].value == GUI_VALUE_NONE)
+	{
+		return;
+	}
+
+	if (rendered[GUI_ITEM_SUMMARY_NODES].value == 0)
+	{
+		lv_label_set_text_static(summary_label, "No other monitors");
+	}
+	else if (rendered[GUI_ITEM_SUMMARY_QUALITY].value < 0)
+	{
+		lv_label_set_text_fmt(summary_label, "%d monitors, eCO2 max %d ppm",
+							  rendered[GUI_ITEM_SUMMARY_NODES].value,
+							  rendered[GUI_ITEM_SUMMARY_CO2].value);
+	}
+	else
+	{
+		lv_label_set_text_fmt(summary_label, "%d monitors, worst %d %%, eCO2 max %d ppm",
+							  rendered[GUI_ITEM_SUMMARY_NODES].value,
+							  rendered[GUI_ITEM_SUMMARY_QUALITY].value,
+							  rendered[GUI_ITEM_SUMMARY_CO2].value);
+	}
+}
+
+/* Updates the eCO2 statistics: Mean of the last hour and 95th percentile
+ * of its 2 minute means, exposure above the threshold of the last 8 hours.
+ * May be called from any thread.
+*/
+void gui_update_stats(fxp_t co2_mean, fxp_t co2_bucket_p95, fxp_t co2_exposure)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats_values[0] = fxp_round(co2_mean, 0);
+	stats_values[1] = fxp_round(co2_bucket_p95, 0);
+	stats_values[2] = fxp_round(co2_exposure, 0);
+	stats_pending = true;
+	k_spin_unlock(&stats_lock, key);
+
+	k_sem_give(&gui_wakeup_sem);
+}
+
+/* Renders the statistics from the last posted values ...
+*/
+static void stats_render(void)
+{
+	if (stats_label == NULL || rendered[GUI_ITEM_STATS_MEAN].value == GUI_VALUE_NONE)
+	{
+		return;
+	}
+
+	lv_label_set_text_fmt(stats_label, "1 h: %d ppm\np95 2 min: %d ppm\n8 h: %d ppm h",
+						  rendered[GUI_ITEM_STATS_MEAN].value,
+						  rendered[GUI_ITEM_STATS_BUCKET_P95].value,
+						  MAX(rendered[GUI_ITEM_STATS_EXPOSURE].value, 0));
+}
+
+/* Shows the alarm banner with the given (static) text, or hides it (NULL).
+ * May be called from any thread.
+*/
+void gui_update_alarm(const char *text)
+{
+	k_spinlock_key_t key = k_spin_lock(&alarm_lock);
+
+	alarm_text = text;
+	alarm_pending = true;
+	k_spin_unlock(&alarm_lock, key);
+
+	k_sem_give(&gui_wakeup_sem);
+}
+
+/* Applies a pending alarm banner update (GUI thread only) ...
+ * A new alarm wakes up the display.
+*/
+static void gui_apply_alarm(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&alarm_lock);
+	const char *text = alarm_text;
+	bool pending = alarm_pending;
+
+	alarm_pending = false;
+	k_spin_unlock(&alarm_lock, key);
+
+	if (!pending || alarm_banner == NULL)
+	{
+		return;
+	}
+	if (text != NULL)
+	{
+		lv_label_set_text_static(alarm_banner, text);
+		lv_obj_set_hidden(alarm_banner, false);
+		power_activity();
+	}
+	else
+	{
+		lv_obj_set_hidden(alarm_banner, true);
+	}
 }
 
-/* Thread for activating the LVGL taskhandler periodicly ... 
+/* Applies a single update record to the LVGL objects (GUI thread only) ...
+*/
+static void gui_apply(const struct gui_update *update)
+{
+	int32_t s;
+
+	/* Skip unchanged values ...
+	*/
+	switch (update->item)
+	{
+	case GUI_ITEM_RATING:
+		if (rendered[update->item].text == update->text)
+		{
+			return;
+		}
+		rendered[update->item].text = update->text;
+		/* A new rating wakes up the display
+		*/
+		power_activity();
+		/* The rating replaces the calibration countdown (same label)
+		*/
+		rendered[GUI_ITEM_CALIBRATION].value = GUI_VALUE_NONE;
+		break;
+	case GUI_ITEM_HEADLINE:
+		if (rendered[update->item].text == update->text)
+		{
+			return;
+		}
+		rendered[update->item].text = update->text;
+		break;
+	case GUI_ITEM_CALIBRATION:
+		s = update->value / MSEC_PER_SEC;
+		if (rendered[update->item].value == s)
+		{
+			return;
+		}
+		rendered[update->item].value = s;
+		rendered[GUI_ITEM_RATING].text = NULL;
+		break;
+	case GUI_ITEM_QUALITY:
+	case GUI_ITEM_SUMMARY_NODES:
+	case GUI_ITEM_SUMMARY_QUALITY:
+	case GUI_ITEM_SUMMARY_CO2:
+	case GUI_ITEM_STATS_MEAN:
+	case GUI_ITEM_STATS_BUCKET_P95:
+	case GUI_ITEM_STATS_EXPOSURE:
+		if (rendered[update->item].value == update->value)
+		{
+			return;
+		}
+		rendered[update->item].value = update->value;
+		break;
+	default:
+		/* Sensor values: Compare the displayed (rounded) value
+		*/
+		s = fxp_round(update->value, item_decimals[update->item]);
+		if (rendered[update->item].value == s)
+		{
+			return;
+		}
+		rendered[update->item].value = s;
+		break;
+	}
+
+	switch (update->item)
+	{
+	case GUI_ITEM_TEMP:
+		label_set_fxp(temp_value_label, update->value, item_decimals[GUI_ITEM_TEMP]);
+		break;
+	case GUI_ITEM_PRESS:
+		label_set_fxp(press_value_label, update->value, item_decimals[GUI_ITEM_PRESS]);
+		break;
+	case GUI_ITEM_HUMIDITY:
+		label_set_fxp(humid_value_label, update->value, item_decimals[GUI_ITEM_HUMIDITY]);
+		break;
+	case GUI_ITEM_CO2:
+		label_set_fxp(co2_value_label, update->value, item_decimals[GUI_ITEM_CO2]);
+		break;
+	case GUI_ITEM_VOC:
+		label_set_fxp(tvoc_value_label, update->value, item_decimals[GUI_ITEM_VOC]);
+		break;
+	case GUI_ITEM_QUALITY:
+		lv_linemeter_set_value(qualitiy_meter, update->value);
+		break;
+	case GUI_ITEM_RATING:
+		lv_label_set_text_static(qualitiy_label, update->text);
+		break;
+	case GUI_ITEM_CALIBRATION:
+		lv_label_set_text_fmt(qualitiy_label, "%u:%02u:%02u",
+							  s / 3600U, (s / 60U) % 60U, s % 60U);
+		break;
+	case GUI_ITEM_HEADLINE:
+		lv_label_set_text_static(headline, update->text);
+		break;
+	case GUI_ITEM_SUMMARY_NODES:
+	case GUI_ITEM_SUMMARY_QUALITY:
+	case GUI_ITEM_SUMMARY_CO2:
+		summary_render();
+		break;
+	case GUI_ITEM_STATS_MEAN:
+	case GUI_ITEM_STATS_BUCKET_P95:
+	case GUI_ITEM_STATS_EXPOSURE:
+		stats_render();
+		break;
+	}
+}
+
+/* Drains the update ring in one batch (GUI thread only) ...
+*/
+static void gui_drain_updates(void)
+{
+	atomic_val_t tail = atomic_get(&update_tail);
+	atomic_val_t head = atomic_get(&update_head);
+
+	while (tail != head)
+	{
+		gui_apply(&update_ring[tail & (GUI_UPDATE_RING_SIZE - 1)]);
+		tail++;
+	}
+	atomic_set(&update_tail, tail);
+}
+
+/* Applies pending statistics (GUI thread only) ...
+ * Like the updates of the ring, unchanged values are skipped.
+*/
+static void gui_apply_stats(void)
+{
+	struct gui_update updates[ARRAY_SIZE(stats_values)];
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	bool pending = stats_pending;
+
+	for (int i = 0; i < ARRAY_SIZE(updates); i++)
+	{
+		updates[i].item = GUI_ITEM_STATS_MEAN + i;
+		updates[i].value = stats_values[i];
+	}
+	stats_pending = false;
+	k_spin_unlock(&stats_lock, key);
+
+	if (!pending)
+	{
+		return;
+	}
+	for (int i = 0; i < ARRAY_SIZE(updates); i++)
+	{
+		gui_apply(&updates[i]);
+	}
+}
+
+/* Wakes up the GUI thread without posting an update (e.g. on user activity)
+*/
+void gui_wakeup(void)
+{
+	k_sem_give(&gui_wakeup_sem);
+}
+
+/* Blanks / unblanks the display (GUI thread only) ...
+*/
+static void gui_display_power(bool on)
+{
+	if (display_dev == NULL)
+	{
+		return;
+	}
+
+	/* Drivers without power management just ignore the power state
+	*/
+	if (on)
+	{
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+		device_set_power_state(display_dev, DEVICE_PM_ACTIVE_STATE, NULL, NULL);
+#endif
+		display_blanking_off(display_dev);
+	}
+	else
+	{
+		display_blanking_on(display_dev);
+#ifdef CONFIG_DEVICE_POWER_MANAGEMENT
+		device_set_power_state(display_dev, DEVICE_PM_SUSPEND_STATE, NULL, NULL);
+#endif
+	}
+	power_consumer_set(POWER_DISPLAY, on);
+}
+
+/* Thread for activating the LVGL taskhandler ...
+ * The thread only wakes up if new data has been posted or an LVGL task
+ * (e.g. an animation or a pending screen refresh) is due. If nothing is
+ * left to render, it sleeps until the next update arrives.
+ * While the display is blanked, updates are applied to the LVGL objects but
+ * not rendered; the pending areas are flushed once the display is back on.
 */
 void gui_run(void)
 {
+	bool display_on = true;
+
+	k_sem_take(&gui_ready_sem, K_FOREVER);
+
 	while (1)
 	{
-		lv_task_handler();
-		k_sleep(K_MSEC(20));
+		k_timeout_t timeout = K_FOREVER;
+		uint32_t remaining_ms;
+		uint32_t next_task_ms;
+		bool active = power_display_active(&remaining_ms);
+
+		if (active != display_on)
+		{
+			display_on = active;
+			gui_display_power(display_on);
+		}
+
+		uint32_t start = latency_start();
+
+		gui_drain_updates();
+		gui_apply_alarm();
+		gui_apply_stats();
+		if (!display_on)
+		{
+			k_sem_take(&gui_wakeup_sem, K_FOREVER);
+			continue;
+		}
+
+		next_task_ms = lv_task_handler();
+		latency_end(LATENCY_GUI, start);
+
+		if (lv_disp_get_inv_buf_size(lv_disp_get_default()) > 0 ||
+			lv_anim_count_running() > 0)
+		{
+			remaining_ms = MIN(remaining_ms, next_task_ms);
+		}
+		if (remaining_ms != UINT32_MAX)
+		{
+			timeout = K_MSEC(remaining_ms);
+		}
+		k_sem_take(&gui_wakeup_sem, timeout);
 	}
 }
 
@@ -24,12 +24,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <zephyr.h>
 #include <drivers/sensor.h>
 
+#include "fxp.h"
+
 void gui_setup(void);
 
-void gui_update_sensor_value(enum sensor_channel channel, struct sensor_value value);
+void gui_update_sensor_value(enum sensor_channel channel, fxp_t value);
 
 void gui_update_qmeter(int8_t quality, const char *rating);
 
+void gui_update_calibration(uint32_t remaining_ms);
+
 void gui_update_headline(const char *str);
 
+void gui_wakeup(void);
+
+void gui_update_summary(uint8_t nodes, int8_t worst_quality, fxp_t co2_max);
+
+void gui_update_stats(fxp_t co2_mean, fxp_t co2_bucket_p95, fxp_t co2_exposure);
+
+void gui_update_alarm(const char *text);
+
 #endif
@@ -0,0 +1,332 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <shell/shell.h>
+#if defined(CONFIG_APP_HEALTH_WATCHDOG)
+#include <drivers/watchdog.h>
+#endif
+
+#include "flashlog.h"
+#include "health.h"
+#include "power.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(health, CONFIG_APP_HEALTH_LOG_LEVEL);
+
+#define HEALTH_MAX_BACKOFF_MS (CONFIG_APP_HEALTH_MAX_BACKOFF_S * MSEC_PER_SEC)
+
+BUILD_ASSERT(CONFIG_APP_HEALTH_RECOVER_FAILURES < CONFIG_APP_HEALTH_RESET_FAILURES,
+			 "The bus recovery must come before the sensor reset");
+
+/* Sensor state, written by the sensor's acquisition thread only
+*/
+struct health_sensor_state
+{
+	const char *name;
+	bool resettable;
+	uint32_t failures; /* consecutive failed cycles */
+	uint32_t due;	   /* while backing off: uptime of the next cycle (ms) */
+	uint32_t cycles;
+	uint32_t failed_cycles;
+	uint32_t recoveries;
+	uint32_t resets;
+};
+
+static struct health_sensor_state sensors[HEALTH_SENSOR_COUNT] = {
+	[HEALTH_BME280] = {.name = "BME280", .resettable = false},
+	[HEALTH_CCS811] = {.name = "CCS811", .resettable = true},
+};
+
+/* Check-in deadlines (uptime in ms, 0 = not checked in yet)
+*/
+static atomic_t deadlines[HEALTH_TASK_COUNT];
+static const char *const task_names[HEALTH_TASK_COUNT] = {
+	[HEALTH_TASK_BME280] = "bme280",
+	[HEALTH_TASK_CCS811] = "ccs811",
+	[HEALTH_TASK_MAIN] = "main",
+};
+
+/* Watchdog: Fed (or, without one, the deadlines checked) four times per
+ * timeout from the monitor thread. The thread does nothing else, so a
+ * stalled work queue (e.g. Bluetooth) cannot starve a healthy pipeline;
+ * its priority is above the pipeline's threads.
+*/
+#define HEALTH_MONITOR_THREAD_STACK_SIZE 1024
+#define HEALTH_MONITOR_THREAD_PRIORITY 1
+
+#if defined(CONFIG_APP_HEALTH_WATCHDOG)
+#define HEALTH_MONITOR_INTERVAL_MS (CONFIG_APP_HEALTH_WATCHDOG_TIMEOUT_MS / 4)
+
+#if DT_NODE_HAS_STATUS(DT_ALIAS(watchdog0), okay)
+#define WATCHDOG DT_ALIAS(watchdog0)
+#elif DT_HAS_COMPAT_STATUS_OKAY(nordic_nrf_watchdog)
+#define WATCHDOG DT_INST(0, nordic_nrf_watchdog)
+#endif
+
+static const struct device *wdt;
+static int wdt_channel;
+#else
+#define HEALTH_MONITOR_INTERVAL_MS 1000
+#endif
+
+static K_THREAD_STACK_DEFINE(monitor_thread_stack, HEALTH_MONITOR_THREAD_STACK_SIZE);
+static struct k_thread monitor_thread_data;
+static atomic_t feeds = ATOMIC_INIT(0);
+static bool starving = false; /* monitor only */
+
+/* Starts the retry budget of a fetch (first attempt now)
+*/
+void health_retry_begin(struct health_retry *retry)
+{
+	retry->start = k_uptime_get_32();
+	retry->delay_ms = CONFIG_APP_HEALTH_RETRY_DELAY_MS;
+	retry->attempts = 1;
+}
+
+/* Waits for the next attempt of a failed fetch. Returns false, without
+ * waiting, if the attempt would start after the budget.
+*/
+bool health_retry_next(struct health_retry *retry)
+{
+	uint32_t elapsed = k_uptime_get_32() - retry->start;
+
+	if (elapsed + retry->delay_ms > CONFIG_APP_HEALTH_FETCH_BUDGET_MS)
+	{
+		return false;
+	}
+
+	k_sleep(K_MSEC(retry->delay_ms));
+	retry->delay_ms *= 2;
+	retry->attempts++;
+
+	return true;
+}
+
+/* Is a cycle of the sensor due, i.e. not skipped while backing off?
+*/
+bool health_cycle_due(enum health_sensor sensor)
+{
+	return sensors[sensor].failures < 2 || (int32_t)(k_uptime_get_32() - sensors[sensor].due) >= 0;
+}
+
+/* Accounts a cycle of a sensor (rc 0: valid data) ...
+ * After n consecutive failed cycles the next one is due after n - 1
+ * doublings of the interval (less half an interval, for the jitter of the
+ * cycles). Returns the escalation the thread should carry out.
+*/
+enum health_action health_cycle_end(enum health_sensor sensor, int rc, uint32_t interval_ms)
+{
+	struct health_sensor_state *s = &sensors[sensor];
+	uint32_t backoff_ms;
+	uint32_t phase;
+
+	s->cycles++;
+	if (rc == 0)
+	{
+		if (s->failures > 0)
+		{
+			LOG_INF("%s: Recovered after %u failed cycles", s->name, s->failures);
+			s->failures = 0;
+		}
+		return HEALTH_ACTION_NONE;
+	}
+
+	s->failures++;
+	s->failed_cycles++;
+	backoff_ms = MIN((uint64_t)interval_ms << MIN(s->failures - 1, 16), HEALTH_MAX_BACKOFF_MS);
+	backoff_ms = MAX(backoff_ms, interval_ms);
+	s->due = k_uptime_get_32() + backoff_ms - interval_ms / 2;
+
+	phase = s->failures % CONFIG_APP_HEALTH_RESET_FAILURES;
+	if (phase == 0 && s->resettable)
+	{
+		LOG_WRN("%s: %u failed cycles (err %d), resetting; next cycle in %u ms",
+				s->name, s->failures, rc, backoff_ms);
+		s->resets++;
+		return HEALTH_ACTION_RESET;
+	}
+	if (phase == 0 || phase == CONFIG_APP_HEALTH_RECOVER_FAILURES)
+	{
+		LOG_WRN("%s: %u failed cycles (err %d), recovering the bus; next cycle in %u ms",
+				s->name, s->failures, rc, backoff_ms);
+		s->recoveries++;
+		return HEALTH_ACTION_RECOVER_BUS;
+	}
+
+	return HEALTH_ACTION_NONE;
+}
+
+/* Checks in a thread: It will check in again within the given time (plus
+ * HEALTH_CHECKIN_MARGIN_MS)
+*/
+void health_checkin(enum health_task task, uint32_t within_ms)
+{
+	uint32_t deadline = k_uptime_get_32() + within_ms + HEALTH_CHECKIN_MARGIN_MS;
+
+	atomic_set(&deadlines[task], deadline != 0 ? deadline : 1);
+}
+
+/* The first overdue thread, -1 if all are on time
+*/
+static int health_overdue(uint32_t now)
+{
+	for (int task = 0; task < HEALTH_TASK_COUNT; task++)
+	{
+		uint32_t deadline = atomic_get(&deadlines[task]);
+
+		if (deadline != 0 && (int32_t)(now - deadline) > 0)
+		{
+			return task;
+		}
+	}
+
+	return -1;
+}
+
+static void monitor_check(void)
+{
+	int task = health_overdue(k_uptime_get_32());
+
+	if (task < 0)
+	{
+#if defined(CONFIG_APP_HEALTH_WATCHDOG)
+		if (wdt != NULL)
+		{
+			wdt_feed(wdt, wdt_channel);
+		}
+#endif
+		atomic_inc(&feeds);
+		if (starving)
+		{
+			LOG_INF("All threads on time again");
+			starving = false;
+		}
+	}
+	else if (!starving)
+	{
+		LOG_ERR("Thread %s overdue, %s", task_names[task],
+				IS_ENABLED(CONFIG_APP_HEALTH_WATCHDOG) ? "watchdog no longer fed" : "no watchdog");
+		starving = true;
+#if defined(CONFIG_APP_HEALTH_WATCHDOG)
+		/* Unless the thread catches up, the watchdog resets the device:
+		 * Save the staged records while the flashlog thread still runs
+		*/
+		if (wdt != NULL)
+		{
+			flashlog_flush();
+		}
+#endif
+	}
+}
+
+static void monitor_run(void *p1, void *p2, void *p3)
+{
+	while (1)
+	{
+		k_sleep(K_MSEC(HEALTH_MONITOR_INTERVAL_MS));
+		monitor_check();
+	}
+}
+
+/* Setup the watchdog and start monitoring the threads
+*/
+void health_init(void)
+{
+#if defined(CONFIG_APP_HEALTH_WATCHDOG)
+#if defined(WATCHDOG)
+	wdt = device_get_binding(DT_LABEL(WATCHDOG));
+#endif
+	if (wdt != NULL)
+	{
+		struct wdt_timeout_cfg cfg = {
+			.window.min = 0,
+			.window.max = CONFIG_APP_HEALTH_WATCHDOG_TIMEOUT_MS,
+			.callback = NULL,
+			.flags = WDT_FLAG_RESET_SOC,
+		};
+
+		wdt_channel = wdt_install_timeout(wdt, &cfg);
+		if (wdt_channel < 0 || wdt_setup(wdt, WDT_OPT_PAUSE_HALTED_BY_DBG) != 0)
+		{
+			LOG_ERR("Watchdog setup failed (err %d)", wdt_channel);
+			wdt = NULL;
+		}
+		else
+		{
+			LOG_INF("Watchdog started (%u ms)", CONFIG_APP_HEALTH_WATCHDOG_TIMEOUT_MS);
+		}
+	}
+	else
+	{
+		LOG_WRN("No watchdog found, overdue threads are logged only");
+	}
+#endif
+
+	k_thread_create(&monitor_thread_data, monitor_thread_stack,
+					K_THREAD_STACK_SIZEOF(monitor_thread_stack),
+					monitor_run, NULL, NULL, NULL,
+					HEALTH_MONITOR_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&monitor_thread_data, "health");
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_health(const struct shell *shell, size_t argc, char **argv)
+{
+	uint32_t now = k_uptime_get_32();
+
+	shell_print(shell, "%-8s %8s %8s %8s %8s %8s %8s", "sensor",
+				"cycles", "failed", "consec.", "backoff", "recover", "reset");
+	for (int i = 0; i < HEALTH_SENSOR_COUNT; i++)
+	{
+		int32_t backoff_ms = sensors[i].failures >= 2 ? (int32_t)(sensors[i].due - now) : 0;
+
+		shell_print(shell, "%-8s %8u %8u %8u %8d %8u %8u", sensors[i].name,
+					sensors[i].cycles, sensors[i].failed_cycles, sensors[i].failures,
+					MAX(backoff_ms, 0), sensors[i].recoveries, sensors[i].resets);
+	}
+
+	shell_print(shell, "%-8s %8s", "thread", "slack ms");
+	for (int task = 0; task < HEALTH_TASK_COUNT; task++)
+	{
+		uint32_t deadline = atomic_get(&deadlines[task]);
+
+		if (deadline == 0)
+		{
+			shell_print(shell, "%-8s %8s", task_names[task], "-");
+		}
+		else
+		{
+			shell_print(shell, "%-8s %8d", task_names[task], (int32_t)(deadline - now));
+		}
+	}
+
+	shell_print(shell, "Monitor: %u times all on time%s", (uint32_t)atomic_get(&feeds),
+				starving ? ", currently overdue" : "");
+
+	return 0;
+}
+
+SHELL_CMD_REGISTER(health, NULL, "Sensor and thread health", cmd_health);
+
+#endif
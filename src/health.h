@@ -0,0 +1,141 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HEALTH_H
+#define __HEALTH_H
+
+#include <zephyr.h>
+
+/* Sensor health (CONFIG_APP_HEALTH) ...
+ * Bounds the time a sensor fault can hold up the pipeline:
+ *
+ * Retry budget: Within one acquisition cycle, a failed fetch is repeated
+ * with exponential backoff (CONFIG_APP_HEALTH_RETRY_DELAY_MS, doubled per
+ * attempt) as long as the next attempt starts within
+ * CONFIG_APP_HEALTH_FETCH_BUDGET_MS of the first one.
+ *
+ * Escalation: A cycle without valid data is a failed cycle. After
+ * consecutive failed cycles, the sensor is sampled less often (the interval
+ * doubled per failed cycle, up to CONFIG_APP_HEALTH_MAX_BACKOFF_S), the I2C
+ * bus is recovered (CONFIG_APP_HEALTH_RECOVER_FAILURES) and the sensor is
+ * reset if it has a reset line (CONFIG_APP_HEALTH_RESET_FAILURES, the CCS811
+ * via reset-gpios). The escalation repeats every RESET_FAILURES cycles
+ * until the sensor delivers again.
+ *
+ * Watchdog: The pipeline's threads check in with the latest time of their
+ * next check-in (health_checkin()), plus HEALTH_CHECKIN_MARGIN_MS for the
+ * fetches and recoveries in between. The hardware watchdog
+ * (CONFIG_APP_HEALTH_WATCHDOG) is only fed while all threads, that have
+ * checked in once, are on time; a hung thread or bus therefore resets the
+ * SoC after at most its deadline plus the watchdog timeout.
+ *
+ * The shell command 'health' shows the state of the sensors and threads.
+ * Without CONFIG_APP_HEALTH, a failed fetch is repeated up to 10 times,
+ * 100 ms apart, and there is no escalation and no watchdog.
+*/
+enum health_sensor
+{
+	HEALTH_BME280,
+	HEALTH_CCS811,
+	HEALTH_SENSOR_COUNT,
+};
+
+enum health_task
+{
+	HEALTH_TASK_BME280, /* acquisition thread */
+	HEALTH_TASK_CCS811, /* acquisition thread */
+	HEALTH_TASK_MAIN,	/* consumer stage */
+	HEALTH_TASK_COUNT,
+};
+
+/* Escalation after a failed cycle, carried out by the sensor's thread
+*/
+enum health_action
+{
+	HEALTH_ACTION_NONE,
+	HEALTH_ACTION_RECOVER_BUS, /* power_i2c_recover() */
+	HEALTH_ACTION_RESET,	   /* reset the sensor */
+};
+
+/* Retry budget of one fetch
+*/
+struct health_retry
+{
+	uint32_t start;		   /* uptime of the first attempt (ms) */
+	uint32_t delay_ms;	   /* before the next attempt */
+	unsigned int attempts; /* including the first one */
+};
+
+#if defined(CONFIG_APP_HEALTH)
+
+#define HEALTH_CHECKIN_MARGIN_MS (2 * CONFIG_APP_HEALTH_FETCH_BUDGET_MS + 1000)
+
+void health_init(void);
+
+void health_retry_begin(struct health_retry *retry);
+
+bool health_retry_next(struct health_retry *retry);
+
+bool health_cycle_due(enum health_sensor sensor);
+
+enum health_action health_cycle_end(enum health_sensor sensor, int rc, uint32_t interval_ms);
+
+void health_checkin(enum health_task task, uint32_t within_ms);
+
+#else
+
+static inline void health_init(void)
+{
+}
+
+static inline void health_retry_begin(struct health_retry *retry)
+{
+	retry->attempts = 1;
+}
+
+static inline bool health_retry_next(struct health_retry *retry)
+{
+	if (retry->attempts > 10)
+	{
+		return false;
+	}
+	k_sleep(K_MSEC(100));
+	retry->attempts++;
+
+	return true;
+}
+
+static inline bool health_cycle_due(enum health_sensor sensor)
+{
+	return true;
+}
+
+static inline enum health_action health_cycle_end(enum health_sensor sensor, int rc, uint32_t interval_ms)
+{
+	return HEALTH_ACTION_NONE;
+}
+
+static inline void health_checkin(enum health_task task, uint32_t within_ms)
+{
+}
+
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <string.h>
+
+#include "histogram.h"
+
+static inline unsigned int bucket_of(uint32_t value)
+{
+	unsigned int msb;
+
+	if (value < HISTOGRAM_LINEAR)
+	{
+		return value;
+	}
+	msb = 31 - __builtin_clz(value);
+	if (msb >= HISTOGRAM_MAX_BITS)
+	{
+		return HISTOGRAM_BUCKETS - 1;
+	}
+
+	/* Bucket: power of two (above the linear range) and the next
+	 * HISTOGRAM_SUB_BITS bits below the MSB
+	*/
+	return HISTOGRAM_LINEAR + (msb - HISTOGRAM_SUB_BITS - 1) * (1 << HISTOGRAM_SUB_BITS) +
+		   ((value >> (msb - HISTOGRAM_SUB_BITS)) & ((1 << HISTOGRAM_SUB_BITS) - 1));
+}
+
+/* Largest value of a bucket ...
+*/
+static inline uint32_t bucket_max(unsigned int bucket)
+{
+	unsigned int msb, sub;
+
+	if (bucket < HISTOGRAM_LINEAR)
+	{
+		return bucket;
+	}
+	if (bucket >= HISTOGRAM_BUCKETS - 1)
+	{
+		return UINT32_MAX;
+	}
+	bucket -= HISTOGRAM_LINEAR;
+	msb = bucket / (1 << HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS + 1;
+	sub = bucket % (1 << HISTOGRAM_SUB_BITS);
+
+	return (1U << msb) + ((sub + 1) << (msb - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void histogram_reset(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->min = UINT32_MAX;
+}
+
+void histogram_add(struct histogram *h, uint32_t value)
+{
+	h->counts[bucket_of(value)]++;
+	h->count++;
+	h->sum += value;
+	h->min = MIN(h->min, value);
+	h->max = MAX(h->max, value);
+}
+
+/* Gets a percentile (given in 1/1000): The upper bound of the bucket
+ * holding it, but not more than the largest value seen.
+*/
+uint32_t histogram_percentile(const struct histogram *h, unsigned int permille)
+{
+	uint32_t rank;
+	uint32_t seen = 0;
+
+	if (h->count == 0)
+	{
+		return 0;
+	}
+
+	rank = ((uint64_t)h->count * permille + 999) / 1000;
+	rank = MAX(rank, 1);
+	for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += h->counts[i];
+		if (seen >= rank)
+		{
+			return MIN(bucket_max(i), h->max);
+		}
+	}
+
+	return h->max;
+}
@@ -0,0 +1,52 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <zephyr.h>
+
+/* Log-linear histogram of unsigned values (e.g. latencies in µs) ...
+ * Values below 16 have a bucket each, above that every power of two is
+ * split into 8 buckets, i.e. the relative error of a percentile is below
+ * 12.5 %. Values up to 2^24 are covered, larger values go to the last bucket.
+ * Fixed size (about 730 bytes), no allocation; adding is O(1).
+*/
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_LINEAR (2 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 24
+#define HISTOGRAM_BUCKETS (HISTOGRAM_LINEAR + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS - 1) * (1 << HISTOGRAM_SUB_BITS))
+
+struct histogram
+{
+	uint32_t counts[HISTOGRAM_BUCKETS];
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+};
+
+void histogram_reset(struct histogram *h);
+
+void histogram_add(struct histogram *h, uint32_t value);
+
+uint32_t histogram_percentile(const struct histogram *h, unsigned int permille);
+
+#endif
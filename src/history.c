@@ -0,0 +1,490 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <shell/shell.h>
+#include <stdlib.h>
+
+#include "history.h"
+#include "util.h"
+
+/* Raw tier: one entry per record ...
+*/
+static struct
+{
+	uint32_t timestamp[HISTORY_RAW_LEN];
+	fxp_t value[RECORD_CHAN_COUNT][HISTORY_RAW_LEN];
+	uint8_t iaq_index[HISTORY_RAW_LEN];
+	uint16_t head; /* next entry to write */
+	uint16_t count;
+} raw;
+
+/* Aggregate tiers: one entry per interval ...
+ * The accumulator collects the values of the currently open interval and
+ * is written to the ring once the interval has been completed.
+*/
+struct accumulator
+{
+	uint32_t start; /* start of the interval */
+	uint32_t n;		/* number of records */
+	int64_t sum[RECORD_CHAN_COUNT];
+	fxp_t min[RECORD_CHAN_COUNT];
+	fxp_t max[RECORD_CHAN_COUNT];
+	uint8_t iaq_index;
+};
+
+struct aggregate_tier
+{
+	const uint32_t interval_ms;
+	const uint16_t len;
+	uint16_t head;
+	uint16_t count;
+	uint32_t *const timestamp;
+	fxp_t *const min;  /* [RECORD_CHAN_COUNT * len], channel-major */
+	fxp_t *const max;  /* [RECORD_CHAN_COUNT * len], channel-major */
+	fxp_t *const mean; /* [RECORD_CHAN_COUNT * len], channel-major */
+	uint8_t *const iaq_index; /* worst IAQ index of the interval */
+	struct aggregate_tier *const next; /* next (coarser) tier */
+	struct accumulator acc;
+};
+
+#define AGGREGATE_TIER_DEFINE(_name, _len, _interval_ms, _next)             \
+	static uint32_t _name##_timestamp[_len];                                \
+	static fxp_t _name##_min[RECORD_CHAN_COUNT * (_len)];                   \
+	static fxp_t _name##_max[RECORD_CHAN_COUNT * (_len)];                   \
+	static fxp_t _name##_mean[RECORD_CHAN_COUNT * (_len)];                  \
+	static uint8_t _name##_iaq_index[_len];                                 \
+	static struct aggregate_tier _name = {                                  \
+		.interval_ms = _interval_ms,                                        \
+		.len = _len,                                                        \
+		.timestamp = _name##_timestamp,                                     \
+		.min = _name##_min,                                                 \
+		.max = _name##_max,                                                 \
+		.mean = _name##_mean,                                               \
+		.iaq_index = _name##_iaq_index,                                     \
+		.next = _next,                                                      \
+	}
+
+AGGREGATE_TIER_DEFINE(hour, HISTORY_HOUR_LEN, 60 * 60 * MSEC_PER_SEC, NULL);
+AGGREGATE_TIER_DEFINE(minute, HISTORY_MINUTE_LEN, 60 * MSEC_PER_SEC, &hour);
+
+#define HISTORY_RAM_SIZE (sizeof(raw) +                                                    \
+						  sizeof(minute) + sizeof(minute_timestamp) + sizeof(minute_min) + \
+						  sizeof(minute_max) + sizeof(minute_mean) + sizeof(minute_iaq_index) + \
+						  sizeof(hour) + sizeof(hour_timestamp) + sizeof(hour_min) +       \
+						  sizeof(hour_max) + sizeof(hour_mean) + sizeof(hour_iaq_index))
+
+BUILD_ASSERT(HISTORY_RAM_SIZE <= HISTORY_RAM_BUDGET, "History exceeds its RAM budget");
+BUILD_ASSERT(HISTORY_RAW_LEN <= UINT16_MAX && HISTORY_MINUTE_LEN <= UINT16_MAX &&
+				 HISTORY_HOUR_LEN <= UINT16_MAX,
+			 "History tier too long");
+
+/* Archive: compressed raw records ...
+ * Blocks are filled in order; seq[i] is the sequence number of block i,
+ * which allows iterators to detect a block being recycled.
+*/
+static struct
+{
+	struct tsc_block blocks[HISTORY_ARCHIVE_BLOCKS];
+	uint32_t seq[HISTORY_ARCHIVE_BLOCKS];
+	uint32_t next_seq;
+	uint16_t current;
+} archive;
+
+BUILD_ASSERT(sizeof(archive) <= HISTORY_ARCHIVE_RAM_BUDGET, "Archive exceeds its RAM budget");
+
+/* A mutex rather than a spinlock: The archive iterator decodes records
+ * while holding it, which must not mask interrupts.
+*/
+static K_MUTEX_DEFINE(history_lock);
+
+static void accumulator_reset(struct accumulator *acc, uint32_t start)
+{
+	acc->start = start;
+	acc->n = 0;
+	acc->iaq_index = UINT8_MAX;
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		acc->sum[ch] = 0;
+		acc->min[ch] = INT32_MAX;
+		acc->max[ch] = INT32_MIN;
+	}
+}
+
+/* Adds an aggregate (n values with the given min, max and sum) ...
+*/
+static void accumulator_add(struct accumulator *acc, const fxp_t *min, const fxp_t *max,
+							const int64_t *sum, uint32_t n, uint8_t iaq_index)
+{
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		acc->sum[ch] += sum[ch];
+		acc->min[ch] = MIN(acc->min[ch], min[ch]);
+		acc->max[ch] = MAX(acc->max[ch], max[ch]);
+	}
+	if (iaq_index > 0)
+	{
+		acc->iaq_index = MIN(acc->iaq_index, iaq_index);
+	}
+	acc->n += n;
+}
+
+static void aggregate_tier_add(struct aggregate_tier *tier, uint32_t timestamp,
+							   const fxp_t *min, const fxp_t *max, const int64_t *sum,
+							   uint32_t n, uint8_t iaq_index);
+
+/* Closes the open interval of a tier: The aggregate is written to the ring
+ * and passed on to the next (coarser) tier.
+*/
+static void aggregate_tier_flush(struct aggregate_tier *tier)
+{
+	struct accumulator *acc = &tier->acc;
+	uint16_t i = tier->head;
+
+	tier->timestamp[i] = acc->start;
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		tier->min[ch * tier->len + i] = acc->min[ch];
+		tier->max[ch * tier->len + i] = acc->max[ch];
+		tier->mean[ch * tier->len + i] = (fxp_t)(acc->sum[ch] / acc->n);
+	}
+	tier->iaq_index[i] = acc->iaq_index == UINT8_MAX ? 0 : acc->iaq_index;
+
+	tier->head = (i + 1) % tier->len;
+	if (tier->count < tier->len)
+	{
+		tier->count++;
+	}
+
+	if (tier->next != NULL)
+	{
+		aggregate_tier_add(tier->next, acc->start, acc->min, acc->max, acc->sum, acc->n,
+						   acc->iaq_index);
+	}
+}
+
+static void aggregate_tier_add(struct aggregate_tier *tier, uint32_t timestamp,
+							   const fxp_t *min, const fxp_t *max, const int64_t *sum,
+							   uint32_t n, uint8_t iaq_index)
+{
+	uint32_t start = timestamp - timestamp % tier->interval_ms;
+
+	if (tier->acc.n > 0 && tier->acc.start != start)
+	{
+		aggregate_tier_flush(tier);
+	}
+	if (tier->acc.n == 0 || tier->acc.start != start)
+	{
+		accumulator_reset(&tier->acc, start);
+	}
+	accumulator_add(&tier->acc, min, max, sum, n, iaq_index);
+}
+
+static void archive_add(const struct iaq_record *record)
+{
+	if (archive.next_seq == 0 ||
+		tsc_block_add(&archive.blocks[archive.current], record) == -ENOSPC)
+	{
+		/* Start a new block, recycling the oldest one
+		*/
+		if (archive.next_seq > 0)
+		{
+			archive.current = (archive.current + 1) % HISTORY_ARCHIVE_BLOCKS;
+		}
+		tsc_block_init(&archive.blocks[archive.current]);
+		archive.seq[archive.current] = ++archive.next_seq;
+		tsc_block_add(&archive.blocks[archive.current], record);
+	}
+}
+
+/* Adds a record to the history: O(1), independent of the tier sizes.
+*/
+void history_add(const struct iaq_record *record)
+{
+	int64_t sum[RECORD_CHAN_COUNT];
+
+	k_mutex_lock(&history_lock, K_FOREVER);
+
+	raw.timestamp[raw.head] = record->timestamp;
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		raw.value[ch][raw.head] = record->values[ch];
+		sum[ch] = record->values[ch];
+	}
+	raw.iaq_index[raw.head] = record->iaq_index;
+	raw.head = (raw.head + 1) % HISTORY_RAW_LEN;
+	if (raw.count < HISTORY_RAW_LEN)
+	{
+		raw.count++;
+	}
+
+	aggregate_tier_add(&minute, record->timestamp, record->values, record->values, sum, 1,
+					   record->iaq_index);
+
+	archive_add(record);
+
+	k_mutex_unlock(&history_lock);
+}
+
+static struct aggregate_tier *aggregate_tier_get(enum history_tier tier)
+{
+	return tier == HISTORY_TIER_MINUTE ? &minute : &hour;
+}
+
+/* Number of entries available in the given tier ...
+*/
+size_t history_count(enum history_tier tier)
+{
+	if (tier == HISTORY_TIER_RAW)
+	{
+		return raw.count;
+	}
+	return aggregate_tier_get(tier)->count;
+}
+
+/* Gets an entry of the given tier (index 0: newest entry) ...
+*/
+int history_get(enum history_tier tier, size_t index, enum record_channel channel,
+				struct history_value *value, uint32_t *timestamp)
+{
+	int rc = 0;
+
+	k_mutex_lock(&history_lock, K_FOREVER);
+
+	if (tier == HISTORY_TIER_RAW)
+	{
+		if (index < raw.count)
+		{
+			uint16_t i = (raw.head + HISTORY_RAW_LEN - 1 - index) % HISTORY_RAW_LEN;
+
+			value->min = value->max = value->mean = raw.value[channel][i];
+			*timestamp = raw.timestamp[i];
+		}
+		else
+		{
+			rc = -ENOENT;
+		}
+	}
+	else
+	{
+		struct aggregate_tier *t = aggregate_tier_get(tier);
+
+		if (index < t->count)
+		{
+			uint16_t i = (t->head + t->len - 1 - index) % t->len;
+
+			value->min = t->min[channel * t->len + i];
+			value->max = t->max[channel * t->len + i];
+			value->mean = t->mean[channel * t->len + i];
+			*timestamp = t->timestamp[i];
+		}
+		else
+		{
+			rc = -ENOENT;
+		}
+	}
+
+	k_mutex_unlock(&history_lock);
+
+	return rc;
+}
+
+/* Gets the IAQ index of an entry (index 0: newest entry). For aggregates
+ * this is the worst IAQ index of the interval. Returns 0 if not available.
+*/
+uint8_t history_get_iaq_index(enum history_tier tier, size_t index)
+{
+	uint8_t iaq_index = 0;
+
+	k_mutex_lock(&history_lock, K_FOREVER);
+
+	if (tier == HISTORY_TIER_RAW)
+	{
+		if (index < raw.count)
+		{
+			iaq_index = raw.iaq_index[(raw.head + HISTORY_RAW_LEN - 1 - index) % HISTORY_RAW_LEN];
+		}
+	}
+	else
+	{
+		struct aggregate_tier *t = aggregate_tier_get(tier);
+
+		if (index < t->count)
+		{
+			iaq_index = t->iaq_index[(t->head + t->len - 1 - index) % t->len];
+		}
+	}
+
+	k_mutex_unlock(&history_lock);
+
+	return iaq_index;
+}
+
+/* Finds the block with the given sequence number (or the oldest block with
+ * a higher one). Returns the block index or -1.
+*/
+static int archive_find(uint32_t seq)
+{
+	uint32_t oldest = archive.next_seq > HISTORY_ARCHIVE_BLOCKS ? archive.next_seq - HISTORY_ARCHIVE_BLOCKS + 1 : 1;
+
+	if (seq < oldest)
+	{
+		seq = oldest;
+	}
+	if (archive.next_seq == 0 || seq > archive.next_seq)
+	{
+		return -1;
+	}
+	/* Block seq lives at current - (next_seq - seq) */
+	return (archive.current + HISTORY_ARCHIVE_BLOCKS - (archive.next_seq - seq) % HISTORY_ARCHIVE_BLOCKS) %
+		   HISTORY_ARCHIVE_BLOCKS;
+}
+
+/* Starts iterating the archived records with from <= timestamp <= to ...
+*/
+void history_archive_iter_init(struct history_archive_iter *iter, uint32_t from, uint32_t to)
+{
+	iter->from = from;
+	iter->to = to;
+	iter->seq = 0;
+	iter->started = false;
+	iter->done = false;
+}
+
+/* Decodes the next archived record in the requested time range. Blocks
+ * outside of the range are skipped using their header only.
+*/
+bool history_archive_iter_next(struct history_archive_iter *iter, struct iaq_record *record)
+{
+	bool next_block = !iter->started;
+	bool found = false;
+	int i;
+
+	k_mutex_lock(&history_lock, K_FOREVER);
+
+	while (!found && !iter->done)
+	{
+		/* Next record of the current block (unless it has been recycled)
+		*/
+		if (!next_block)
+		{
+			i = archive_find(iter->seq);
+			if (i >= 0 && archive.seq[i] == iter->seq && tsc_iter_next(&iter->iter, record))
+			{
+				iter->done = record->timestamp > iter->to;
+				found = !iter->done && record->timestamp >= iter->from;
+				continue;
+			}
+		}
+
+		/* Next block
+		*/
+		i = archive_find(iter->seq + 1);
+		if (i < 0)
+		{
+			/* No more data (yet) */
+			break;
+		}
+		iter->seq = archive.seq[i];
+		iter->started = true;
+		if (archive.blocks[i].first_timestamp > iter->to)
+		{
+			iter->done = true;
+			break;
+		}
+		/* Skip completed blocks outside of the range using their header */
+		next_block = archive.blocks[i].last_timestamp < iter->from && i != archive.current;
+		tsc_iter_init(&iter->iter, &archive.blocks[i]);
+	}
+
+	k_mutex_unlock(&history_lock);
+
+	return found;
+}
+
+#if defined(CONFIG_SHELL)
+
+/* Prints the newest entries of a tier (mean values; the worst IAQ index of
+ * the interval for aggregates), newest first.
+*/
+static int history_print(const struct shell *shell, enum history_tier tier, size_t argc, char **argv)
+{
+	size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 10;
+
+	count = MIN(count, history_count(tier));
+	shell_print(shell, "%-12s %12s %12s %12s %12s %12s %4s", "time",
+				record_channel_name(RECORD_CHAN_TEMP), record_channel_name(RECORD_CHAN_PRESS),
+				record_channel_name(RECORD_CHAN_HUMIDITY), record_channel_name(RECORD_CHAN_CO2),
+				record_channel_name(RECORD_CHAN_TVOC), "iaq");
+	for (size_t index = 0; index < count; index++)
+	{
+		char values[RECORD_CHAN_COUNT][FXP_STR_LEN];
+		char time[TIME_STR_LEN];
+		struct history_value value;
+		uint32_t timestamp;
+		int rc = 0;
+
+		for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+		{
+			rc = history_get(tier, index, ch, &value, &timestamp);
+			if (rc != 0)
+			{
+				break;
+			}
+			fxp_format(values[ch], sizeof(values[ch]), value.mean, 2);
+		}
+		if (rc != 0)
+		{
+			/* No such entry (yet) */
+			break;
+		}
+		shell_print(shell, "%-12s %12s %12s %12s %12s %12s %4u",
+					time_str(time, sizeof(time), timestamp, false),
+					values[0], values[1], values[2], values[3], values[4],
+					history_get_iaq_index(tier, index));
+	}
+
+	return 0;
+}
+
+static int cmd_records_raw(const struct shell *shell, size_t argc, char **argv)
+{
+	return history_print(shell, HISTORY_TIER_RAW, argc, argv);
+}
+
+static int cmd_records_minute(const struct shell *shell, size_t argc, char **argv)
+{
+	return history_print(shell, HISTORY_TIER_MINUTE, argc, argv);
+}
+
+static int cmd_records_hour(const struct shell *shell, size_t argc, char **argv)
+{
+	return history_print(shell, HISTORY_TIER_HOUR, argc, argv);
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_records,
+							   SHELL_CMD_ARG(raw, NULL, "Show the newest 1 s records [count]", cmd_records_raw, 1, 1),
+							   SHELL_CMD_ARG(minute, NULL, "Show the newest 1 min aggregates [count]", cmd_records_minute, 1, 1),
+							   SHELL_CMD_ARG(hour, NULL, "Show the newest 1 h aggregates [count]", cmd_records_hour, 1, 1),
+							   SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(records, &sub_records, "Multi-resolution record history", NULL);
+
+#endif
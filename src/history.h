@@ -0,0 +1,92 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+#include <zephyr.h>
+
+#include "fxp.h"
+#include "record.h"
+#include "tscodec.h"
+
+/* Multi-resolution history of records ...
+ * All tiers are statically allocated ring buffers (structure of arrays),
+ * the memory footprint is fixed at build time (see HISTORY_RAM_BUDGET).
+*/
+#define HISTORY_RAW_LEN 300	   /* 1 s records: 5 minutes */
+#define HISTORY_MINUTE_LEN 240 /* 1 min aggregates: 4 hours */
+#define HISTORY_HOUR_LEN 72	   /* 1 h aggregates: 3 days */
+
+#define HISTORY_RAM_BUDGET (32 * 1024)
+
+/* Compressed archive of all raw records: 32 blocks of 512 bytes. Measured
+ * with the simulated office day (src/sim), a record takes about 2.4 bytes
+ * (4.1 bytes without APP_FILTER), so the archive covers about 1.9 hours
+ * (1.1 hours) of 1 s records, more at the lower sampling rates. The oldest
+ * block is dropped once the archive is full.
+*/
+#define HISTORY_ARCHIVE_BLOCKS 32
+#define HISTORY_ARCHIVE_RAM_BUDGET (20 * 1024)
+
+enum history_tier
+{
+	HISTORY_TIER_RAW,
+	HISTORY_TIER_MINUTE,
+	HISTORY_TIER_HOUR,
+	HISTORY_TIER_COUNT,
+};
+
+/* Aggregated values of one channel for one interval.
+ * For the raw tier min, max and mean are identical.
+*/
+struct history_value
+{
+	fxp_t min;
+	fxp_t max;
+	fxp_t mean;
+};
+
+/* Iterator over a time range of the archive ...
+*/
+struct history_archive_iter
+{
+	uint32_t from;
+	uint32_t to;
+	uint32_t seq; /* sequence number of the current block */
+	struct tsc_iter iter;
+	bool started;
+	bool done;
+};
+
+void history_add(const struct iaq_record *record);
+
+void history_archive_iter_init(struct history_archive_iter *iter, uint32_t from, uint32_t to);
+
+bool history_archive_iter_next(struct history_archive_iter *iter, struct iaq_record *record);
+
+size_t history_count(enum history_tier tier);
+
+int history_get(enum history_tier tier, size_t index, enum record_channel channel,
+				struct history_value *value, uint32_t *timestamp);
+
+uint8_t history_get_iaq_index(enum history_tier tier, size_t index);
+
+#endif
@@ -29,8 +29,29 @@ http://www.iaquk.org.uk/ESW/Files/IAQ_Rating_Index.pdf for
 temperature, humidity, CO2 and TVOC concentration.
 */
 
+/* Scoring engine ...
+Each measurement is rated by a static breakpoint table: Starting with 5 points
+(excellent), a value loses one point for each breakpoint of the table it falls
+below (low) or exceeds (high). The comparisons are evaluated without branches,
+so the cost per score is constant and independent of the value.
+Unused breakpoints are set to IAQ_NO_LIMIT_LOW / IAQ_NO_LIMIT_HIGH.
+
+Temperature and humidity are scored with sub-integer resolution: They are
+given as fixed-point values in units of 1/1000 (m°C, m%RH).
+*/
+#define IAQ_SCALE_STEPS 4
+#define IAQ_MAX_POINTS 5
+#define IAQ_NO_LIMIT_LOW INT32_MIN
+#define IAQ_NO_LIMIT_HIGH INT32_MAX
+
+struct iaq_scale
+{
+    int32_t low[IAQ_SCALE_STEPS];  /* value < low[i]: one point less */
+    int32_t high[IAQ_SCALE_STEPS]; /* value > high[i]: one point less */
+};
+
 /*
-Temperature (°C)
+Temperature (m°C)
 
 Excellent: 18 - 21°C
 Good: Plus or minus 1°C 
@@ -38,26 +59,13 @@ Fair: Plus or minus 2°C
 Poor: Plus or minus 3°C 
 Inadequate: Plus or minus 4°C or more
 */
-uint8_t points_temperature(uint32_t temperature)
-{
-    uint8_t points = 5;
-    const uint32_t excellent_low = 18;
-    const uint32_t excellent_high = 21;
-
-    if (temperature < excellent_low)
-    {
-        points -= excellent_low - temperature > 4 ? 4 : excellent_low - temperature;
-    }
-    else if (temperature > excellent_high)
-    {
-        points -= temperature - excellent_high > 4 ? 4 : temperature - excellent_high;
-    }
-
-    return points;
-}
+static const struct iaq_scale scale_temperature = {
+    .low = {18000, 17000, 16000, 15000},
+    .high = {21000, 22000, 23000, 24000},
+};
 
 /*
-Relative Humidity (% RH)
+Relative Humidity (m% RH)
 
 Excellent: 40 - 60 % RH
 Good: < 40 / > 60 % RH 
@@ -65,33 +73,10 @@ Fair: < 30 / > 70 % RH
 Poor: < 20 / > 80 % RH 
 Inadequate: < 10 / > 90 % RH 
 */
-uint8_t points_humidity(uint32_t humidity)
-{
-    uint8_t points = 0;
-
-    if (humidity < 10 || humidity > 90)
-    {
-        points = 1;
-    }
-    else if (humidity < 20 || humidity > 80)
-    {
-        points = 2;
-    }
-    else if (humidity < 30 || humidity > 70)
-    {
-        points = 3;
-    }
-    else if (humidity < 40 || humidity > 60)
-    {
-        points = 4;
-    }
-    else if (humidity >= 40 && humidity <= 60)
-    {
-        points = 5;
-    }
-
-    return points;
-}
+static const struct iaq_scale scale_humidity = {
+    .low = {40000, 30000, 20000, 10000},
+    .high = {60000, 70000, 80000, 90000},
+};
 
 /*
 Carbon Dixoide (PPM)
@@ -102,33 +87,10 @@ Fair: 1000 - 1500 PPM
 Poor: 1500 - 1800 PPM 
 Inadequate: 1800 PPM + 
 */
-uint8_t points_co2(uint32_t co2)
-{
-    uint8_t points = 0;
-
-    if (co2 <= 600)
-    {
-        points = 5;
-    }
-    else if (co2 <= 800)
-    {
-        points = 4;
-    }
-    else if (co2 <= 1500)
-    {
-        points = 3;
-    }
-    else if (co2 <= 1800)
-    {
-        points = 2;
-    }
-    else if (co2 > 1800)
-    {
-        points = 1;
-    }
-
-    return points;
-}
+static const struct iaq_scale scale_co2 = {
+    .low = {IAQ_NO_LIMIT_LOW, IAQ_NO_LIMIT_LOW, IAQ_NO_LIMIT_LOW, IAQ_NO_LIMIT_LOW},
+    .high = {600, 800, 1500, 1800},
+};
 
 /*
 TVOC (ppb)
@@ -156,73 +118,74 @@ Moderate: 0.22 - 0.66 ppm (<= 660 ppb)
 Poor: 0.66 - 2.2 ppm      (<= 2200 ppb)
 Unhealthy: 2.2 - 5.5 ppm   (> 2200 ppb) 
 */
-uint8_t points_tvoc(uint32_t tvoc)
+static const struct iaq_scale scale_tvoc = {
+    .low = {IAQ_NO_LIMIT_LOW, IAQ_NO_LIMIT_LOW, IAQ_NO_LIMIT_LOW, IAQ_NO_LIMIT_LOW},
+    .high = {65, 220, 660, 2200},
+};
+
+/* IAQI rating: 5 levels based on the given IAQI / IAQ_REGARDED_MEASUREMENTS.
+*/
+static const char *const iaq_ratings[IAQ_MAX_POINTS + 1] = {
+    "Inadequate", /* not reached */
+    "Inadequate",
+    "Poor",
+    "Fair",
+    "Good",
+    "Excellent",
+};
+
+/* Points for a single measurement based on the given scale (1 - 5).
+*/
+static inline uint8_t iaq_points(const struct iaq_scale *scale, int32_t value)
 {
-    uint8_t points = 0;
+    uint8_t points = IAQ_MAX_POINTS;
 
-    if (tvoc <= 65)
-    {
-        points = 5;
-    }
-    else if (tvoc <= 220)
-    {
-        points = 4;
-    }
-    else if (tvoc <= 660)
-    {
-        points = 3;
-    }
-    else if (tvoc <= 2200)
-    {
-        points = 2;
-    }
-    else if (tvoc > 2200)
+    for (int i = 0; i < IAQ_SCALE_STEPS; i++)
     {
-        points = 1;
+        points -= (value < scale->low[i]) + (value > scale->high[i]);
     }
 
     return points;
 }
 
+static inline int32_t iaq_clamp(uint32_t value)
+{
+    return value > INT32_MAX ? INT32_MAX : (int32_t)value;
+}
+
 /* IAQI: The sum of all calculated points for each given indicator / sensor value.
+   temperature: m°C, humidity: m%RH, eco2: ppm, tvoc: ppb
 */
-uint8_t get_iaq_index(uint32_t temperature, uint32_t humidity, uint32_t eco2, uint32_t tvoc)
+uint8_t get_iaq_index(int32_t temperature, int32_t humidity, uint32_t eco2, uint32_t tvoc)
 {
     uint8_t points = 0;
 
-    points += points_temperature(temperature);
-    points += points_humidity(humidity);
-    points += points_co2(eco2);
-    points += points_tvoc(tvoc);
+    points += iaq_points(&scale_temperature, temperature);
+    points += iaq_points(&scale_humidity, humidity);
+    points += iaq_points(&scale_co2, iaq_clamp(eco2));
+    points += iaq_points(&scale_tvoc, iaq_clamp(tvoc));
 
     return points;
 }
 
+/* IAQI for a batch of samples (e.g. for re-scoring a history) ...
+*/
+void get_iaq_index_batch(const struct iaq_input *input, uint8_t *iaq_index, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        iaq_index[i] = get_iaq_index(input[i].temperature, input[i].humidity,
+                                     input[i].eco2, input[i].tvoc);
+    }
+}
+
 /* IAQI rating: 5 levels based on the given IAQI.
 */
 const char *get_iaq_rating(uint8_t iaq_index)
 {
+    uint8_t level = iaq_index / IAQ_REGARDED_MEASUREMENTS;
 
-    if (iaq_index < 2 * IAQ_REGARDED_MEASUREMENTS)
-    {
-        return "Inadequate";
-    }
-    else if (iaq_index < 3 * IAQ_REGARDED_MEASUREMENTS)
-    {
-        return "Poor";
-    }
-    else if (iaq_index < 4 * IAQ_REGARDED_MEASUREMENTS)
-    {
-        return "Fair";
-    }
-    else if (iaq_index < 5 * IAQ_REGARDED_MEASUREMENTS)
-    {
-        return "Good";
-    }
-    else
-    {
-        return "Excellent";
-    }
+    return iaq_ratings[level > IAQ_MAX_POINTS ? IAQ_MAX_POINTS : level];
 }
 
 uint8_t get_min_iaq_index()
@@ -232,5 +195,5 @@ uint8_t get_min_iaq_index()
 
 uint8_t get_max_iaq_index()
 {
-    return IAQ_REGARDED_MEASUREMENTS * 5;
+    return IAQ_REGARDED_MEASUREMENTS * IAQ_MAX_POINTS;
 }
@@ -24,7 +24,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <zephyr.h>
 #include "iaq.h"
 
-uint8_t get_iaq_index(uint32_t temperature, uint32_t humidity, uint32_t eco2, uint32_t tvoc);
+/* Input values for the IAQ index calculation:
+ * temperature: m°C, humidity: m%RH, eco2: ppm, tvoc: ppb
+*/
+struct iaq_input
+{
+	int32_t temperature;
+	int32_t humidity;
+	uint32_t eco2;
+	uint32_t tvoc;
+};
+
+uint8_t get_iaq_index(int32_t temperature, int32_t humidity, uint32_t eco2, uint32_t tvoc);
+
+void get_iaq_index_batch(const struct iaq_input *input, uint8_t *iaq_index, size_t count);
 
 const char *get_iaq_rating(uint8_t iaq_index);
 
@@ -0,0 +1,146 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <init.h>
+#include <shell/shell.h>
+
+#include "histogram.h"
+#include "latency.h"
+
+static const char *const stage_names[LATENCY_STAGE_COUNT] = {
+	[LATENCY_BME280_FETCH] = "bme280_fetch",
+	[LATENCY_CCS811_ENVDATA] = "ccs811_envdata",
+	[LATENCY_CCS811_FETCH] = "ccs811_fetch",
+	[LATENCY_QUEUE] = "queue",
+	[LATENCY_PROCESS] = "process",
+	[LATENCY_ADV_UPDATE] = "adv_update",
+	[LATENCY_GUI] = "gui",
+	[LATENCY_ALARM] = "alarm",
+};
+
+static const char *const event_names[LATENCY_EVENT_COUNT] = {
+	[LATENCY_BME280_ERROR] = "bme280_error",
+	[LATENCY_CCS811_ENVDATA_ERROR] = "ccs811_envdata_error",
+	[LATENCY_CCS811_DRDY_TIMEOUT] = "ccs811_drdy_timeout",
+	[LATENCY_CCS811_RETRY] = "ccs811_retry",
+	[LATENCY_CCS811_STALE] = "ccs811_stale",
+	[LATENCY_CCS811_ERROR] = "ccs811_error",
+	[LATENCY_CCS811_NO_DATA] = "ccs811_no_data",
+	[LATENCY_ALARM_DROPPED] = "alarm_dropped",
+};
+
+/* Each stage is recorded by a single thread; the lock is for the shell
+*/
+static struct k_spinlock latency_lock;
+static struct histogram stages[LATENCY_STAGE_COUNT];
+static atomic_t events[LATENCY_EVENT_COUNT];
+
+void latency_add(enum latency_stage stage, uint32_t us)
+{
+	k_spinlock_key_t key = k_spin_lock(&latency_lock);
+
+	histogram_add(&stages[stage], us);
+	k_spin_unlock(&latency_lock, key);
+}
+
+void latency_event(enum latency_event event)
+{
+	atomic_inc(&events[event]);
+}
+
+static void latency_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&latency_lock);
+
+	for (int i = 0; i < LATENCY_STAGE_COUNT; i++)
+	{
+		histogram_reset(&stages[i]);
+	}
+	k_spin_unlock(&latency_lock, key);
+
+	for (int i = 0; i < LATENCY_EVENT_COUNT; i++)
+	{
+		atomic_set(&events[i], 0);
+	}
+}
+
+static int latency_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	cycles_init();
+	latency_reset();
+
+	return 0;
+}
+
+SYS_INIT(latency_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_latency_show(const struct shell *shell, size_t argc, char **argv)
+{
+	shell_print(shell, "%-20s %8s %8s %8s %8s %8s %8s %8s", "stage (us)",
+				"count", "min", "mean", "p50", "p90", "p99", "max");
+	for (int i = 0; i < LATENCY_STAGE_COUNT; i++)
+	{
+		struct histogram *h = &stages[i];
+		uint32_t count, min, mean, p50, p90, p99, max;
+		k_spinlock_key_t key = k_spin_lock(&latency_lock);
+
+		count = h->count;
+		min = count ? h->min : 0;
+		mean = count ? (uint32_t)(h->sum / count) : 0;
+		p50 = histogram_percentile(h, 500);
+		p90 = histogram_percentile(h, 900);
+		p99 = histogram_percentile(h, 990);
+		max = h->max;
+		k_spin_unlock(&latency_lock, key);
+
+		shell_print(shell, "%-20s %8u %8u %8u %8u %8u %8u %8u", stage_names[i],
+					count, min, mean, p50, p90, p99, max);
+	}
+
+	shell_print(shell, "%-20s %8s", "event", "count");
+	for (int i = 0; i < LATENCY_EVENT_COUNT; i++)
+	{
+		shell_print(shell, "%-20s %8u", event_names[i], (uint32_t)atomic_get(&events[i]));
+	}
+
+	return 0;
+}
+
+static int cmd_latency_reset(const struct shell *shell, size_t argc, char **argv)
+{
+	latency_reset();
+	shell_print(shell, "Latency statistics cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_latency,
+							   SHELL_CMD(show, NULL, "Show the stage latencies and events", cmd_latency_show),
+							   SHELL_CMD(reset, NULL, "Clear the statistics", cmd_latency_reset),
+							   SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(latency, &sub_latency, "Sensing pipeline latencies", NULL);
+
+#endif
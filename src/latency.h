@@ -0,0 +1,97 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __LATENCY_H
+#define __LATENCY_H
+
+#include <zephyr.h>
+
+#include "cycles.h"
+
+/* Latency instrumentation of the sensing pipeline (CONFIG_APP_LATENCY) ...
+ * Each stage records its duration (µs, from cycles_get()) in a histogram,
+ * failures and retries are counted as events. The shell command 'latency'
+ * shows ('latency show') or clears ('latency reset') the statistics.
+ * If disabled, all calls compile to nothing.
+*/
+enum latency_stage
+{
+	LATENCY_BME280_FETCH,	/* BME280 sample fetch */
+	LATENCY_CCS811_ENVDATA, /* ccs811_envdata_update() */
+	LATENCY_CCS811_FETCH,	/* CCS811 sample fetch including the retries */
+	LATENCY_QUEUE,			/* sample timestamp to the main loop (ms resolution) */
+	LATENCY_PROCESS,		/* main loop: fusion, IAQ index, fan out */
+	LATENCY_ADV_UPDATE,		/* bt_le_adv_update_data() */
+	LATENCY_GUI,			/* GUI thread: apply the updates and render */
+	LATENCY_ALARM,			/* sample published to the alarm outputs set */
+	LATENCY_STAGE_COUNT
+};
+
+enum latency_event
+{
+	LATENCY_BME280_ERROR,		  /* failed fetch */
+	LATENCY_CCS811_ENVDATA_ERROR, /* failed environmental data update */
+	LATENCY_CCS811_DRDY_TIMEOUT,  /* no data ready interrupt in time */
+	LATENCY_CCS811_RETRY,		  /* additional fetch attempt */
+	LATENCY_CCS811_STALE,		  /* fetch without new data */
+	LATENCY_CCS811_ERROR,		  /* sensor error status */
+	LATENCY_CCS811_NO_DATA,		  /* no valid data after all retries */
+	LATENCY_ALARM_DROPPED,		  /* alarm event queue full */
+	LATENCY_EVENT_COUNT
+};
+
+#if defined(CONFIG_APP_LATENCY)
+
+static inline uint32_t latency_start(void)
+{
+	return cycles_get();
+}
+
+void latency_add(enum latency_stage stage, uint32_t us);
+
+static inline void latency_end(enum latency_stage stage, uint32_t start)
+{
+	latency_add(stage, cycles_to_us(cycles_get() - start));
+}
+
+void latency_event(enum latency_event event);
+
+#else
+
+static inline uint32_t latency_start(void)
+{
+	return 0;
+}
+
+static inline void latency_add(enum latency_stage stage, uint32_t us)
+{
+}
+
+static inline void latency_end(enum latency_stage stage, uint32_t start)
+{
+}
+
+static inline void latency_event(enum latency_event event)
+{
+}
+
+#endif
+
+#endif
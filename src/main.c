@@ -21,189 +21,245 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <device.h>
 #include <devicetree.h>
 #include <drivers/sensor.h>
-#include <drivers/sensor/ccs811.h>
 #include <drivers/display.h>
 #include <zephyr.h>
 #include <stdio.h>
 #include <string.h>
 #include <lvgl.h>
-#include <bluetooth/bluetooth.h>
-#include <bluetooth/hci.h>
 
+#include "alarm.h"
+#include "benchmark.h"
+#include "ble.h"
+#include "channels.h"
+#include "filter.h"
+#include "flashlog.h"
+#include "fxp.h"
+#include "gateway.h"
 #include "gui.h"
+#include "health.h"
+#include "history.h"
 #include "iaq.h"
+#include "latency.h"
+#include "power.h"
+#include "record.h"
+#include "sampling.h"
+#include "sensors.h"
+#include "stats.h"
 
-#define LOG_LEVEL CONFIG_LOG_DEFAULT_LEVEL
 #include <logging/log.h>
-LOG_MODULE_REGISTER(app);
-
-#define DEVICE_NAME CONFIG_BT_DEVICE_NAME
-#define DEVICE_NAME_LEN (sizeof(DEVICE_NAME) - 1)
-
-#define BME280 DT_INST(0, bosch_bme280)
-#if DT_NODE_HAS_STATUS(BME280, okay)
-#define BME280_LABEL DT_LABEL(BME280)
-#else
-#error The devicetree has no enabled nodes with compatible "bosch,bme280"
-#define BME280_LABEL "<none>"
-#endif
-
-#define CCS811 DT_INST(0, ams_ccs811)
-#if DT_NODE_HAS_STATUS(CCS811, okay)
-#define CCS811_LABEL DT_LABEL(CCS811)
-#else
-#error The devicetree has no enabled nodes with compatible "ams_ccs811"
-#define CCS811_LABEL "<none>"
-#endif
+LOG_MODULE_REGISTER(app, CONFIG_APP_LOG_LEVEL);
 
 #define CALIBRATION_TIME_SECONDS 20 // should be 20 minutes! ;)
-
-/* Auxiliary function: Format time string.
+#define CALIBRATION_TIME_RESTORED_SECONDS 0 // CCS811 baseline restored
+#define SAMPLE_MAX_AGE_MS 5000 // at least, else 2 sampling intervals
+#define MAIN_CHECKIN_INTERVAL_MS 1000 // health check-in without samples
+#define RECORDER_QUEUE_SIZE 4 // results, a measurement cycle publishes up to 2
+#define RECORDER_THREAD_STACK_SIZE 2048
+#define RECORDER_THREAD_PRIORITY 9 // below the consumer stage, above the flash log
+
+/* Consumer stage state (main thread only)
 */
-static const char *time_str(uint32_t time, bool with_millis)
+static struct
 {
-	static char buf[16]; /* ...HH:MM:SS.MMM */
-	unsigned int ms = time % MSEC_PER_SEC;
-	unsigned int s;
-	unsigned int min;
-	unsigned int h;
-
-	time /= MSEC_PER_SEC;
-	s = time % 60U;
-	time /= 60U;
-	min = time % 60U;
-	time /= 60U;
-	h = time;
-	if (with_millis)
-		snprintf(buf, sizeof(buf), "%u:%02u:%02u.%03u",
-				 h, min, s, ms);
-	else
-		snprintf(buf, sizeof(buf), "%u:%02u:%02u",
-				 h, min, s);
-
-	return buf;
-}
-
-static const char *now_str()
+	struct iaq_record record;
+	uint32_t calibration_time;
+	uint32_t first_iaq_time;
+	uint32_t env_timestamp;
+	uint32_t gas_timestamp;
+	uint32_t processed_timestamp[2]; /* by source */
+	bool valid_env_data_bme280;
+	bool valid_env_data_ccs811;
+} app;
+
+/* Consumer stage: Fuse the latest samples of all sensors, calculate the IAQI
+ * and publish the conditioned record (record_chan) and the IAQ result
+ * (iaq_chan) to the GUI, Bluetooth and the recorder.
+*/
+static void process_sample(const struct sensor_sample *sample)
 {
-	return time_str(k_uptime_get_32(), true);
-}
+	struct iaq_result result = {0};
 
-/* Bluetooth beacon setup ...
- * "stolen" from the Zephyr bluetooth beacon example 
- * (zephyr/samples/bluetooth/beacon/main.c).
- * Setup a non-connectable Eddystone beacon.
- * Later we will "abuse" the name data in the scan
- * resonse to transport our IAQ rating.
-*/
+	switch (sample->source)
+	{
+	case SENSOR_SAMPLE_BME280:
+		app.valid_env_data_bme280 = sample->rc == 0;
+		if (app.valid_env_data_bme280)
+		{
+			app.record.values[RECORD_CHAN_TEMP] = filter_sample(RECORD_CHAN_TEMP, sample->env.temp);
+			app.record.values[RECORD_CHAN_PRESS] = filter_sample(RECORD_CHAN_PRESS, sample->env.press);
+			app.record.values[RECORD_CHAN_HUMIDITY] = filter_sample(RECORD_CHAN_HUMIDITY, sample->env.humidity);
+			app.env_timestamp = sample->timestamp;
+		}
+		break;
+	case SENSOR_SAMPLE_CCS811:
+		app.valid_env_data_ccs811 = sample->rc == 0;
+		if (app.valid_env_data_ccs811)
+		{
+			app.record.values[RECORD_CHAN_CO2] = filter_sample(RECORD_CHAN_CO2, sample->gas.co2);
+			app.record.values[RECORD_CHAN_TVOC] = filter_sample(RECORD_CHAN_TVOC, sample->gas.tvoc);
+			app.gas_timestamp = sample->timestamp;
+		}
+		break;
+	}
 
-/*
-	 * Set Advertisement data. Based on the Eddystone specification:
- 	 * https://github.com/google/eddystone/blob/master/protocol-specification.md
- 	 * https://github.com/google/eddystone/tree/master/eddystone-url
- 	*/
-static const struct bt_data ad[] = {
-	BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_NO_BREDR),
-	BT_DATA_BYTES(BT_DATA_UUID16_ALL, 0xaa, 0xfe),
-	BT_DATA_BYTES(BT_DATA_SVC_DATA16,
-				  0xaa, 0xfe, /* Eddystone UUID */
-				  0x10,		  /* Eddystone-URL frame type */
-				  0x00,		  /* Calibrated Tx power at 0m */
-				  0x00,		  /* URL Scheme Prefix http://www. */
-				  'e', 'x', 'a', 'm', 'p', 'l', 'e',
-				  0x08) /* .org */
-};
-
-/* Set Scan Response data */
-static const struct bt_data sd[] = {
-	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-	BT_DATA(BT_DATA_NAME_SHORTENED, DEVICE_NAME, DEVICE_NAME_LEN),
-};
-
-static void bt_ready(int err)
-{
+	uint32_t now = k_uptime_get_32();
+	int32_t calibration_time_remaining = app.calibration_time * MSEC_PER_SEC - now;
 
-	char addr_s[BT_ADDR_LE_STR_LEN];
-	bt_addr_le_t addr = {0};
-	size_t count = 1;
+	/* Samples older than this are not fused with newer ones
+	*/
+	if (now - app.env_timestamp > MAX(SAMPLE_MAX_AGE_MS, 2 * sensors_get_interval(SENSOR_SAMPLE_BME280)))
+	{
+		app.valid_env_data_bme280 = false;
+	}
+	if (now - app.gas_timestamp > MAX(SAMPLE_MAX_AGE_MS, 2 * sensors_get_interval(SENSOR_SAMPLE_CCS811)))
+	{
+		app.valid_env_data_ccs811 = false;
+	}
+
+	/* Calculate the IAQI rating
+	*/
+
+	app.record.timestamp = sample->timestamp;
+	app.record.iaq_index = 0;
 
-	if (err)
+	/* If calibration time elapased and valid sensor readings are available ...
+	*/
+	if (calibration_time_remaining <= 0 && app.valid_env_data_bme280 && app.valid_env_data_ccs811)
 	{
-		printk("\n[%s]: Bluetooth init failed (err %d)\n", now_str(), err);
-		return;
+		/* Calculate the IAQI
+		*/
+		uint8_t iaq_index = get_iaq_index(app.record.values[RECORD_CHAN_TEMP],
+										   app.record.values[RECORD_CHAN_HUMIDITY],
+										   fxp_to_int(app.record.values[RECORD_CHAN_CO2]),
+										   fxp_to_int(app.record.values[RECORD_CHAN_TVOC]));
+		iaq_index = filter_iaq_index(iaq_index);
+		app.record.iaq_index = iaq_index;
+
+		/* Startup metric: Time to the first valid IAQ index
+		*/
+		if (app.first_iaq_time == 0)
+		{
+			app.first_iaq_time = now;
+			LOG_INF("First valid IAQ index after %u ms (CCS811 baseline %s)",
+					app.first_iaq_time,
+					sensors_ccs811_baseline_restored() ? "restored" : "not restored");
+		}
+
+		LOG_INF("IAQ index: %d (%d %%)", iaq_index, iaq_index * 100 / get_max_iaq_index());
+	}
+	/* If we are still calibrating ...
+	*/
+	else if (calibration_time_remaining > 0)
+	{
+		LOG_INF("Calibration time remaining: %d s", calibration_time_remaining / MSEC_PER_SEC);
+		result.calibration_remaining_ms = calibration_time_remaining;
 	}
-	printk("\n[%s]: Bluetooth initialized\n", now_str());
 
-	/* Start advertising */
-	err = bt_le_adv_start(BT_LE_ADV_NCONN_IDENTITY, ad, ARRAY_SIZE(ad),
-						  sd, ARRAY_SIZE(sd));
-	if (err)
+	/* Publish the conditioned values of a valid sample (with the timestamp
+	 * and the IAQ index of this sample)
+	*/
+	if (sample->rc == 0 && bus_chan_pub(&record_chan, &app.record, CHANNELS_PUB_TIMEOUT) != 0)
 	{
-		printk("\n[%s]: Advertising failed to start (err %d)\n", now_str(), err);
-		return;
+		LOG_WRN("Channel %s busy, record not published!", record_chan.name);
 	}
 
-	/* For connectable advertising you would use
-	 * bt_le_oob_get_local().  For non-connectable non-identity
-	 * advertising an non-resolvable private address is used;
-	 * there is no API to retrieve that.
-	 */
+	/* Publish the result: GUI (meter or calibration), Bluetooth (GATT
+	 * notifications, beacon) and the recorder. One record per CCS811 sample
+	 * (i.e. per measurement cycle) is complete as long as both sensors
+	 * deliver data.
+	*/
+	result.record = app.record;
+	result.valid = app.valid_env_data_bme280 && app.valid_env_data_ccs811;
+	result.complete = result.valid && sample->source == SENSOR_SAMPLE_CCS811;
+	if (bus_chan_pub(&iaq_chan, &result, CHANNELS_PUB_TIMEOUT) != 0)
+	{
+		LOG_WRN("Channel %s busy, result not published!", iaq_chan.name);
+	}
 
-	bt_id_get(&addr, &count);
-	bt_addr_le_to_str(&addr, addr_s, sizeof(addr_s));
+#if defined(CONFIG_APP_GATEWAY)
+	/* Building summary of the other monitors (once per BME280 sample)
+	*/
+	if (sample->source == SENSOR_SAMPLE_BME280)
+	{
+		struct gateway_summary summary;
 
-	printk("\n[%s]: Beacon started, advertising as %s\n", now_str(), addr_s);
+		gateway_get_summary(&summary, now);
+		gui_update_summary(summary.nodes,
+						   summary.worst_iaq_index ? summary.worst_iaq_index * 100 / get_max_iaq_index() : -1,
+						   summary.co2_max);
+	}
+#endif
 }
 
-/* Auxiliary function to handle timing issues when fetching a
- * sample from the CCS811 sensor: Repeat sensor_sample_fetch
- * until valid data has been received.
+/* Recorder: Observer of iaq_chan ...
+ * The listener runs with the channel locked, so it only queues a copy of
+ * the valid results; the recorder thread adapts the sampling rates and
+ * keeps a history / log and the rolling statistics of the complete records.
+ * A copy per result (rather than a subscription to the latest one) keeps
+ * a complete record from being overwritten by the next BME280 result.
 */
-int ccs811_sample_fetch(struct device *dev)
+K_MSGQ_DEFINE(recorder_msgq, sizeof(struct iaq_result), RECORDER_QUEUE_SIZE, 4);
+
+static K_THREAD_STACK_DEFINE(recorder_thread_stack, RECORDER_THREAD_STACK_SIZE);
+static struct k_thread recorder_thread_data;
+
+static void recorder_iaq_changed(const struct bus_channel *chan, const void *message)
 {
-	static bool first = true;
-	static bool ccs811_fw_app_v2 = false;
-	int rc;
+	const struct iaq_result *result = message;
 
-	if (first)
+	if (result->valid && k_msgq_put(&recorder_msgq, result, K_NO_WAIT) != 0)
 	{
-		struct ccs811_configver_type cfgver;
-		rc = ccs811_configver_fetch(dev, &cfgver);
-		if (rc == 0)
-		{
-			printk("\n[%s]: CCS811: HW %02x; FW Boot %04x App %04x ; mode %02x\n",
-				   now_str(),
-				   cfgver.hw_version, cfgver.fw_boot_version,
-				   cfgver.fw_app_version, cfgver.mode);
-			ccs811_fw_app_v2 = (cfgver.fw_app_version >> 8) > 0x11;
-		}
-		first = false;
+		LOG_WRN("Recorder busy, result dropped!");
 	}
+}
+
+BUS_LISTENER_DEFINE(recorder_listener, recorder_iaq_changed);
 
-	rc = sensor_sample_fetch(dev);
-	while (rc != 0)
+static void recorder_process(const struct iaq_result *result)
+{
+#if defined(CONFIG_APP_ADAPTIVE_SAMPLING)
+	/* Adapt the sampling rates to the rate of change
+	*/
+	sampling_update(&result->record, k_uptime_get_32());
+#endif
+
+	if (!result->complete)
 	{
-		const struct ccs811_result_type *rp = ccs811_result(dev);
+		return;
+	}
 
-		if (ccs811_fw_app_v2 && !(rp->status & CCS811_STATUS_DATA_READY))
-		{
-			printk("\n[%s]: CCS811: Stale data!\n", now_str());
-			continue;
-		}
+	history_add(&result->record);
+	flashlog_add(&result->record);
 
-		if (rp->status & CCS811_STATUS_ERROR)
-		{
-			printk("\n[%s]: CCS811: ERROR: %02x\n", now_str(), rp->error);
-			break;
-		}
+#if defined(CONFIG_APP_STATS)
+	/* Rolling statistics: eCO2 of the last hour and exposure of the
+	 * last 8 hours on the display
+	*/
+	struct stats_value co2;
 
-		k_sleep(K_MSEC(10));
-		rc = sensor_sample_fetch(dev);
+	stats_add(&result->record);
+	if (stats_get(STATS_WINDOW_1H, RECORD_CHAN_CO2, &co2) == 0)
+	{
+		gui_update_stats(co2.mean, co2.bucket_p95, stats_get_exposure(STATS_WINDOW_8H, STATS_EXPOSURE_CO2));
 	}
+#endif
+}
 
-	return rc;
+static void recorder_run(void *p1, void *p2, void *p3)
+{
+	struct iaq_result result;
+
+	while (1)
+	{
+		k_msgq_get(&recorder_msgq, &result, K_FOREVER);
+		recorder_process(&result);
+	}
 }
 
+/* The consumer stage subscribes to the raw sample channels
+*/
+BUS_SUBSCRIBER_DEFINE(app_subscriber, 4);
+
 /*
  * Main application logic ...
 */
@@ -212,176 +268,84 @@ void main(void)
 	/* General setup and initialization
 	*/
 
-	/* Setup sensor: BME280
+	/* Setup and start Bluetooth
 	*/
-	const struct device *bme280 = device_get_binding(BME280_LABEL);
-	if (bme280 == NULL)
-	{
-		printk("No device \"%s\" found; Initialization failed?\n",
-			   BME280_LABEL);
-		return;
-	}
-	else
-	{
-		printk("Found device \"%s\"\n", BME280_LABEL);
-		printk("Device is %p, name is %s\n", bme280, bme280->name);
-	}
+	ble_init();
 
-	/* Setup sensor: CCS811
+	/* Setup GUI
 	*/
-	const struct device *ccs811 = device_get_binding(CCS811_LABEL);
-	if (ccs811 == NULL)
-	{
-		printk("No device \"%s\" found; Initialization failed?\n",
-			   CCS811_LABEL);
-		return;
-	}
-	else
-	{
-		printk("Found device \"%s\"\n", CCS811_LABEL);
-		printk("Device is %p, name is %s\n", ccs811, ccs811->name);
-	}
+	gui_setup();
 
-	/* Setup and start Bluetooth beacon
+	/* Setup power management (display blanking, bus suspend)
 	*/
-	int bt_err;
-	printk("\n[%s]: BT: Starting beacon ...\n", now_str());
-	bt_err = bt_enable(bt_ready);
-	if (bt_err)
+	power_init();
+
+	/* Setup the alarm outputs and start the alarm thread
+	*/
+	alarm_init();
+
+	/* Start the recorder thread
+	*/
+	k_thread_create(&recorder_thread_data, recorder_thread_stack,
+					K_THREAD_STACK_SIZEOF(recorder_thread_stack),
+					recorder_run, NULL, NULL, NULL,
+					RECORDER_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&recorder_thread_data, "recorder");
+
+#if defined(CONFIG_APP_BENCHMARK)
+	/* Benchmark firmware: Run the benchmarks with synthetic samples instead
+	 * of the sensors (no flash log)
+	*/
+	app.calibration_time = 0;
+	benchmark_run(process_sample);
+	return;
+#endif
+
+	/* Setup the persistent measurement log
+	*/
+	flashlog_init();
+
+	/* Start the watchdog and the monitoring of the pipeline's threads
+	*/
+	health_init();
+
+	/* Setup sensors and start the acquisition threads
+	*/
+	if (sensors_init() != 0)
 	{
-		printk("\n[%s]: BT: Initiialization failed (err %d)\n", now_str(), bt_err);
+		return;
 	}
 
-	/* Setup GUI
-	*/
-	gui_setup();
+	app.calibration_time = sensors_ccs811_baseline_restored() ? CALIBRATION_TIME_RESTORED_SECONDS : CALIBRATION_TIME_SECONDS;
 
-	/* Forever ...
+	/* Forever ... (checking in with the health layer at least once per
+	 * MAIN_CHECKIN_INTERVAL_MS, so a hang resets the SoC)
 	*/
 	while (1)
 	{
-		int rc = -1;
-		bool valid_env_data_bme280 = false;
-		bool valid_env_data_ccs811 = false;
-		uint32_t now = k_uptime_get_32();
-		int32_t calibration_time_remaining = CALIBRATION_TIME_SECONDS * MSEC_PER_SEC - now;
-
-		struct sensor_value temp, press, humidity, co2, tvoc;
+		const struct bus_channel *chan;
+		struct sensor_sample sample;
 
-		/* Read sensor: BME280
-		*/
-		rc = sensor_sample_fetch(bme280);
-		if (rc == 0)
+		health_checkin(HEALTH_TASK_MAIN, MAIN_CHECKIN_INTERVAL_MS);
+		if (bus_sub_wait(&app_subscriber, &chan, K_MSEC(MAIN_CHECKIN_INTERVAL_MS)) != 0 ||
+			bus_chan_read(chan, &sample, CHANNELS_PUB_TIMEOUT) != 0)
 		{
-			valid_env_data_bme280 = true;
-
-			/* Get sensor values for temperature, pressure and humidity
-			*/
-			sensor_channel_get(bme280, SENSOR_CHAN_AMBIENT_TEMP, &temp);
-			sensor_channel_get(bme280, SENSOR_CHAN_PRESS, &press);
-			sensor_channel_get(bme280, SENSOR_CHAN_HUMIDITY, &humidity);
-
-			printk("\n[%s]: BME280: temp: %d.%06d; press: %d.%06d; humidity: %d.%06d\n",
-				   now_str(),
-				   temp.val1, temp.val2,
-				   press.val1, press.val2,
-				   humidity.val1, humidity.val2);
-
-			/* Update the appropriate GUI elements
-			*/
-			gui_update_sensor_value(SENSOR_CHAN_AMBIENT_TEMP, temp);
-			gui_update_sensor_value(SENSOR_CHAN_PRESS, press);
-			gui_update_sensor_value(SENSOR_CHAN_HUMIDITY, humidity);
-
-			/* Accurate calculation of gas levels requires accurate environment data. 
-			 * Measurements are only accurate to 0.5 Cel and 0.5 RH.
-			 * The CCS811 features an ENV_DATA register, which can be 'fed' with
-			 * with the actual environmental data to improve the accuracy of the
-			 * provided values for gas levels.
-			*/
-			rc = ccs811_envdata_update(ccs811, &temp, &humidity);
-			if (rc == 0)
-			{
-				printk("\n[%s]: CCS811: Env data updated!\n", now_str());
-			}
-			else
-			{
-				printk("\n[%s]: CCS811: Failed to update env data!\n", now_str());
-			}
-		}
-		else
-		{
-			valid_env_data_bme280 = false;
-			printk("\n[%s]: BME280: Failed to fetch sensor data!\n", now_str());
+			continue;
 		}
 
-		/* Read sensor: CCS811
+		/* The channel only holds the latest sample: If it has been
+		 * processed with an earlier notification already, skip it
 		*/
-		rc = ccs811_sample_fetch(ccs811);
-		if (rc == 0)
+		if (sample.timestamp == app.processed_timestamp[sample.source])
 		{
-			valid_env_data_ccs811 = true;
-
-			/* Get sensor values for CO2 and VOC concentration
-			*/
-			sensor_channel_get(ccs811, SENSOR_CHAN_CO2, &co2);
-			sensor_channel_get(ccs811, SENSOR_CHAN_VOC, &tvoc);
-
-			printk("\n[%s]: CCS811: %u ppm eCO2; %u ppb eTVOC\n",
-				   now_str(),
-				   co2.val1,
-				   tvoc.val1);
-
-			/* Update the appropriate GUI elements
-			*/
-			gui_update_sensor_value(SENSOR_CHAN_CO2, co2);
-			gui_update_sensor_value(SENSOR_CHAN_VOC, tvoc);
-		}
-		else
-		{
-			valid_env_data_ccs811 = false;
-			printk("\n[%s]: CCS811: Failed to fetch sensor data!\n", now_str());
+			continue;
 		}
+		app.processed_timestamp[sample.source] = sample.timestamp;
+		latency_add(LATENCY_QUEUE, (k_uptime_get_32() - sample.timestamp) * USEC_PER_MSEC);
 
-		/* Calculate and display the IAQI rating
-		*/
-
-		/* If calibration time elapased and valid sensor readings are available ...
-		*/
-		if (calibration_time_remaining <= 0 && valid_env_data_bme280 && valid_env_data_ccs811)
-		{
-			/* Calculate the IAQI and update the GUI's meter component with the 'relative qualitity'
-			 * and the IAQI rating.
-			*/
-			uint8_t iaq_index = get_iaq_index(temp.val1, humidity.val1, co2.val1, tvoc.val1);
-			uint16_t quality = iaq_index * 100 / get_max_iaq_index();
-			printk("\n[%s]: APP: IAQ index: %d (%d %%)\n", now_str(), iaq_index, quality);
-			gui_update_qmeter(quality, get_iaq_rating(iaq_index));
-
-			/* Update the scan reponse data for the Bluetooth beacon: 'Misuse' the name data for
-			*  transporting the IAQI rating.
-			*/
-			struct bt_data new_sd[] = {
-				BT_DATA(BT_DATA_NAME_COMPLETE, get_iaq_rating(iaq_index), strlen(get_iaq_rating(iaq_index))),
-				BT_DATA(BT_DATA_NAME_SHORTENED, DEVICE_NAME, DEVICE_NAME_LEN),
-			};
-			bt_err = bt_le_adv_update_data(ad, ARRAY_SIZE(ad),
-										   new_sd, ARRAY_SIZE(new_sd));
-			if (bt_err)
-			{
-				printk("\n[%s]: BT: Advertising update failed (err %d)\n", now_str(), bt_err);
-			}
-		}
-		/* If we are still calibrating ...
-		*/
-		else if (calibration_time_remaining > 0)
-		{
-			printk("\n[%s]: APP: Calibration time remaining: %s\n", now_str(), time_str(calibration_time_remaining, true));
-			/* Show remaining time for calibration
-			*/
-			gui_update_qmeter(0, time_str(calibration_time_remaining, false));
-		}
+		uint32_t start = latency_start();
 
-		k_sleep(K_MSEC(1000));
+		process_sample(&sample);
+		latency_end(LATENCY_PROCESS, start);
 	}
 }
@@ -0,0 +1,134 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+
+#include "pacer.h"
+
+/* Starts pacing: The first cycle is due immediately.
+*/
+void pacer_init(struct pacer *pacer, struct k_sem *wakeup, uint32_t period_ms)
+{
+	pacer->wakeup = wakeup;
+	pacer->period = k_ms_to_ticks_ceil64(period_ms);
+	pacer->deadline = k_uptime_ticks();
+	pacer->current = pacer->deadline;
+	pacer->restart = true;
+	pacer->cycles = 0;
+	pacer->overruns = 0;
+	pacer->missed = 0;
+	histogram_reset(&pacer->jitter);
+}
+
+/* Changes the period (pacing thread only): The next cycle is due
+ * immediately, the following ones on the new period.
+*/
+void pacer_set_period(struct pacer *pacer, uint32_t period_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&pacer->lock);
+
+	pacer->period = k_ms_to_ticks_ceil64(period_ms);
+	pacer->deadline = k_uptime_ticks();
+	pacer->restart = true;
+
+	k_spin_unlock(&pacer->lock, key);
+}
+
+/* Waits for the next deadline (pacing thread only) ...
+ * Returns 0 at the deadline or -EAGAIN if woken up early; in that case the
+ * deadline is kept.
+*/
+int pacer_wait(struct pacer *pacer)
+{
+	int64_t now = k_uptime_ticks();
+	k_spinlock_key_t key;
+
+	if (now >= pacer->deadline)
+	{
+		/* Overrun: The work took longer than the period ...
+		*/
+		int64_t missed = (now - pacer->deadline) / pacer->period;
+
+		key = k_spin_lock(&pacer->lock);
+		if (!pacer->restart)
+		{
+			pacer->overruns++;
+		}
+		pacer->missed += missed;
+		pacer->deadline += missed * pacer->period;
+		k_spin_unlock(&pacer->lock, key);
+	}
+	else if (k_sem_take(pacer->wakeup, K_TIMEOUT_ABS_TICKS(pacer->deadline)) == 0)
+	{
+		return -EAGAIN;
+	}
+
+	now = k_uptime_ticks();
+
+	key = k_spin_lock(&pacer->lock);
+	histogram_add(&pacer->jitter, k_ticks_to_us_floor32(now - pacer->deadline));
+	pacer->current = pacer->deadline;
+	pacer->deadline += pacer->period;
+	pacer->restart = false;
+	pacer->cycles++;
+	k_spin_unlock(&pacer->lock, key);
+
+	return 0;
+}
+
+/* Gets the nominal start of the current cycle (uptime in ms), i.e. evenly
+ * spaced timestamps for the cycle's samples.
+*/
+uint32_t pacer_timestamp(const struct pacer *pacer)
+{
+	return (uint32_t)k_ticks_to_ms_floor64(pacer->current);
+}
+
+void pacer_get_stats(struct pacer *pacer, struct pacer_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&pacer->lock);
+
+	stats->period_ms = k_ticks_to_ms_near32(pacer->period);
+	stats->cycles = pacer->cycles;
+	stats->overruns = pacer->overruns;
+	stats->missed = pacer->missed;
+	stats->jitter_min_us = pacer->jitter.count ? pacer->jitter.min : 0;
+	stats->jitter_max_us = pacer->jitter.max;
+	stats->jitter_p50_us = histogram_percentile(&pacer->jitter, 500);
+	stats->jitter_p90_us = histogram_percentile(&pacer->jitter, 900);
+	stats->jitter_p99_us = histogram_percentile(&pacer->jitter, 990);
+
+	k_spin_unlock(&pacer->lock, key);
+}
+
+/* Clears the statistics; the schedule is kept.
+*/
+void pacer_reset_stats(struct pacer *pacer)
+{
+	k_spinlock_key_t key = k_spin_lock(&pacer->lock);
+
+	pacer->cycles = 0;
+	pacer->overruns = 0;
+	pacer->missed = 0;
+	histogram_reset(&pacer->jitter);
+
+	k_spin_unlock(&pacer->lock, key);
+}
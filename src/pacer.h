@@ -0,0 +1,77 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PACER_H
+#define __PACER_H
+
+#include <zephyr.h>
+
+#include "histogram.h"
+
+/* Drift-free periodic pacing of a thread ...
+ * Cycles are scheduled on absolute deadlines (start + n * period), so the
+ * time spent in a cycle does not shift the following ones. The thread waits
+ * on a semaphore with an absolute timeout, which allows waking it up early
+ * (e.g. when the period changes).
+ *
+ * Per cycle the lateness of the wakeup (jitter) is recorded. A cycle whose
+ * work runs past the next deadline is an overrun; deadlines which passed
+ * completely during an overrun are counted as missed and skipped.
+*/
+struct pacer
+{
+	struct k_sem *wakeup;
+	int64_t period;	  /* ticks */
+	int64_t deadline; /* ticks, start of the next cycle */
+	int64_t current;  /* ticks, deadline of the current cycle */
+	bool restart;	  /* started or period changed, no overrun */
+	uint32_t cycles;
+	uint32_t overruns;
+	uint32_t missed;
+	struct histogram jitter; /* µs */
+	struct k_spinlock lock;
+};
+
+struct pacer_stats
+{
+	uint32_t period_ms;
+	uint32_t cycles;
+	uint32_t overruns;
+	uint32_t missed;
+	uint32_t jitter_min_us;
+	uint32_t jitter_max_us;
+	uint32_t jitter_p50_us;
+	uint32_t jitter_p90_us;
+	uint32_t jitter_p99_us;
+};
+
+void pacer_init(struct pacer *pacer, struct k_sem *wakeup, uint32_t period_ms);
+
+void pacer_set_period(struct pacer *pacer, uint32_t period_ms);
+
+int pacer_wait(struct pacer *pacer);
+
+uint32_t pacer_timestamp(const struct pacer *pacer);
+
+void pacer_get_stats(struct pacer *pacer, struct pacer_stats *stats);
+
+void pacer_reset_stats(struct pacer *pacer);
+
+#endif
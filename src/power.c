@@ -0,0 +1,488 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/gpio.h>
+#include <drivers/kscan.h>
+#include <shell/shell.h>
+
+#include "gui.h"
+#include "power.h"
+
+#if defined(CONFIG_APP_SIM)
+#include "sim/sim.h"
+#elif defined(CONFIG_I2C_NRFX)
+#include <nrfx_twi_twim.h>
+#endif
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(power, CONFIG_APP_POWER_LOG_LEVEL);
+
+#define POWER_DISPLAY_TIMEOUT_MS (CONFIG_APP_POWER_DISPLAY_TIMEOUT_S * MSEC_PER_SEC)
+#define POWER_REPORT_INTERVAL_MS (60 * 60 * MSEC_PER_SEC)
+
+#define CCS811 DT_INST(0, ams_ccs811)
+#define TOUCH DT_INST(0, focaltech_ft5336)
+#define BACKLIGHT DT_ALIAS(backlight)
+
+/* Typical currents (µA) per consumer and state ...
+ * Approximations from the data sheets at 3.3 V: The CCS811 draws 46 mW in
+ * mode 1, 7 mW in mode 2 and 1.2 mW in mode 3; the display's share is
+ * dominated by the backlight, so blanking without backlight control only
+ * saves the controller's share. The base current covers the SoC in idle
+ * with BLE advertising, the UART console and the BME280.
+*/
+#define POWER_BASE_UA 600
+
+static const uint32_t currents_ua[POWER_CONSUMER_COUNT][POWER_STATES_MAX] = {
+#if DT_NODE_EXISTS(BACKLIGHT)
+	[POWER_DISPLAY] = {100, 80000},
+#else
+	[POWER_DISPLAY] = {70000, 80000},
+#endif
+	[POWER_I2C] = {0, 50},
+	[POWER_CCS811] = {6, 13900, 2100, 360},
+};
+
+static struct k_spinlock power_lock;
+static uint8_t states[POWER_CONSUMER_COUNT];
+static uint32_t state_since[POWER_CONSUMER_COUNT];
+static uint32_t residency_ms[POWER_CONSUMER_COUNT][POWER_STATES_MAX];
+static uint64_t report_charge;	/* µA x ms at the last report */
+static uint32_t report_current; /* µA during the last full hour */
+static struct k_delayed_work report_work;
+
+static atomic_t last_activity = ATOMIC_INIT(0);
+static atomic_t display_wakeups = ATOMIC_INIT(0);
+
+/* Sensor bus: The lock protects the reference count and the touch state.
+ * i2c_users counts the power_i2c_get()/put() sections in progress, which
+ * bus recovery waits for (holding the lock, so no new section starts).
+*/
+static const struct device *i2c;
+static K_MUTEX_DEFINE(i2c_lock);
+static unsigned int i2c_refs = 0;
+static atomic_t i2c_users = ATOMIC_INIT(0);
+static K_SEM_DEFINE(i2c_idle, 0, 1);
+
+#if DT_NODE_HAS_STATUS(TOUCH, okay)
+static const struct device *touch;
+static bool touch_active = false;
+#endif
+
+/* Consumed charge (µA x ms) since startup, with the power lock held ...
+*/
+static uint64_t charge_locked(uint32_t now)
+{
+	uint64_t charge = (uint64_t)POWER_BASE_UA * now;
+
+	for (int c = 0; c < POWER_CONSUMER_COUNT; c++)
+	{
+		for (int s = 0; s < POWER_STATES_MAX; s++)
+		{
+			uint32_t t = residency_ms[c][s];
+
+			if (s == states[c])
+			{
+				t += now - state_since[c];
+			}
+			charge += (uint64_t)currents_ua[c][s] * t;
+		}
+	}
+
+	return charge;
+}
+
+static void report_handler(struct k_work *work)
+{
+	uint32_t now = k_uptime_get_32();
+	k_spinlock_key_t key = k_spin_lock(&power_lock);
+	uint64_t charge = charge_locked(now);
+
+	report_current = (charge - report_charge) / POWER_REPORT_INTERVAL_MS;
+	report_charge = charge;
+	k_spin_unlock(&power_lock, key);
+
+	LOG_INF("Estimated average current: %u uA (last hour), %u uA (since startup)",
+			report_current, (uint32_t)(charge / MAX(now, 1)));
+
+	k_delayed_work_submit(&report_work, K_MSEC(POWER_REPORT_INTERVAL_MS));
+}
+
+/* Touch input: Any touch counts as user activity ...
+*/
+#if DT_NODE_HAS_STATUS(TOUCH, okay)
+static void touch_callback(const struct device *dev, uint32_t row, uint32_t column, bool pressed)
+{
+	if (pressed)
+	{
+		power_activity();
+	}
+}
+#endif
+
+/* Sensor bus reference counting, with the bus lock held: The bus is resumed
+ * for the first user and suspended after the last one.
+*/
+static void i2c_ref_locked(void)
+{
+	if (i2c_refs++ == 0 && i2c != NULL)
+	{
+#if defined(CONFIG_APP_POWER_I2C_SUSPEND)
+		device_set_power_state(i2c, DEVICE_PM_ACTIVE_STATE, NULL, NULL);
+		power_consumer_set(POWER_I2C, 1);
+#endif
+	}
+}
+
+static void i2c_unref_locked(void)
+{
+	if (--i2c_refs == 0 && i2c != NULL)
+	{
+#if defined(CONFIG_APP_POWER_I2C_SUSPEND)
+		device_set_power_state(i2c, DEVICE_PM_SUSPEND_STATE, NULL, NULL);
+		power_consumer_set(POWER_I2C, 0);
+#endif
+	}
+}
+
+static void touch_enable(bool enable)
+{
+#if DT_NODE_HAS_STATUS(TOUCH, okay)
+	if (touch == NULL)
+	{
+		return;
+	}
+
+	/* The touch controller is polled over the sensor bus (by the driver,
+	 * outside of power_i2c_get()/put() sections)
+	*/
+	k_mutex_lock(&i2c_lock, K_FOREVER);
+	if (enable && !touch_active)
+	{
+		i2c_ref_locked();
+		kscan_enable_callback(touch);
+	}
+	else if (!enable && touch_active)
+	{
+		kscan_disable_callback(touch);
+		i2c_unref_locked();
+	}
+	touch_active = enable;
+	k_mutex_unlock(&i2c_lock);
+#endif
+}
+
+/* Stops the touch controller's transfers for bus recovery, with the bus
+ * lock held: The driver polls from the system work queue, so once the
+ * callback is disabled and a work item queued behind it has run, no
+ * transfer is in progress.
+*/
+#if DT_NODE_HAS_STATUS(TOUCH, okay)
+static K_SEM_DEFINE(touch_drained, 0, 1);
+
+static void touch_drain_handler(struct k_work *work)
+{
+	k_sem_give(&touch_drained);
+}
+
+static K_WORK_DEFINE(touch_drain_work, touch_drain_handler);
+#endif
+
+static void touch_pause_locked(bool pause)
+{
+#if DT_NODE_HAS_STATUS(TOUCH, okay)
+	if (touch == NULL || !touch_active)
+	{
+		return;
+	}
+
+	if (pause)
+	{
+		kscan_disable_callback(touch);
+		k_sem_reset(&touch_drained);
+		k_work_submit(&touch_drain_work);
+		k_sem_take(&touch_drained, K_FOREVER);
+	}
+	else
+	{
+		kscan_enable_callback(touch);
+	}
+#endif
+}
+
+static void display_changed(bool on)
+{
+#if DT_NODE_EXISTS(BACKLIGHT)
+	const struct device *backlight = device_get_binding(DT_GPIO_LABEL(BACKLIGHT, gpios));
+
+	if (backlight != NULL)
+	{
+		gpio_pin_set(backlight, DT_GPIO_PIN(BACKLIGHT, gpios), on);
+	}
+#endif
+
+	if (on)
+	{
+		atomic_inc(&display_wakeups);
+	}
+
+	if (!IS_ENABLED(CONFIG_APP_POWER_TOUCH_WAKE))
+	{
+		touch_enable(on);
+	}
+}
+
+/* Setup ...
+*/
+void power_init(void)
+{
+	uint32_t now = k_uptime_get_32();
+
+	states[POWER_DISPLAY] = 1;
+	states[POWER_I2C] = 1;
+	states[POWER_CCS811] = 1;
+	for (int c = 0; c < POWER_CONSUMER_COUNT; c++)
+	{
+		state_since[c] = now;
+	}
+	atomic_set(&last_activity, now);
+
+#if DT_NODE_HAS_STATUS(CCS811, okay)
+	i2c = device_get_binding(DT_BUS_LABEL(CCS811));
+#endif
+
+#if DT_NODE_EXISTS(BACKLIGHT)
+	const struct device *backlight = device_get_binding(DT_GPIO_LABEL(BACKLIGHT, gpios));
+
+	if (backlight != NULL)
+	{
+		gpio_pin_configure(backlight, DT_GPIO_PIN(BACKLIGHT, gpios),
+						   GPIO_OUTPUT_ACTIVE | DT_GPIO_FLAGS(BACKLIGHT, gpios));
+	}
+#endif
+
+#if DT_NODE_HAS_STATUS(TOUCH, okay)
+	touch = device_get_binding(DT_LABEL(TOUCH));
+	if (touch == NULL || kscan_config(touch, touch_callback) != 0)
+	{
+		LOG_WRN("Touch controller not available, waking on rating changes only");
+		touch = NULL;
+	}
+	touch_enable(true);
+#endif
+
+	k_delayed_work_init(&report_work, report_handler);
+	k_delayed_work_submit(&report_work, K_MSEC(POWER_REPORT_INTERVAL_MS));
+}
+
+/* Notes user activity (touch, rating change): Keeps the display on or
+ * wakes it up.
+*/
+void power_activity(void)
+{
+	atomic_set(&last_activity, k_uptime_get_32());
+	gui_wakeup();
+}
+
+/* Should the display be on? If so, remaining_ms is the time until it
+ * will be blanked.
+*/
+bool power_display_active(uint32_t *remaining_ms)
+{
+	uint32_t idle;
+
+	if (POWER_DISPLAY_TIMEOUT_MS == 0)
+	{
+		*remaining_ms = UINT32_MAX;
+		return true;
+	}
+
+	idle = k_uptime_get_32() - atomic_get(&last_activity);
+	if (idle >= POWER_DISPLAY_TIMEOUT_MS)
+	{
+		*remaining_ms = 0;
+		return false;
+	}
+
+	*remaining_ms = POWER_DISPLAY_TIMEOUT_MS - idle;
+	return true;
+}
+
+/* Starts a section of sensor bus transfers: Resumes the bus if necessary
+ * (waits while the bus is being recovered).
+*/
+void power_i2c_get(void)
+{
+	k_mutex_lock(&i2c_lock, K_FOREVER);
+	atomic_inc(&i2c_users);
+	i2c_ref_locked();
+	k_mutex_unlock(&i2c_lock);
+}
+
+/* Ends a section of sensor bus transfers
+*/
+void power_i2c_put(void)
+{
+	/* Leave the section before taking the lock, a recovery holds it while
+	 * waiting for the sections in progress
+	*/
+	if (atomic_dec(&i2c_users) == 1)
+	{
+		k_sem_give(&i2c_idle);
+	}
+
+	k_mutex_lock(&i2c_lock, K_FOREVER);
+	i2c_unref_locked();
+	k_mutex_unlock(&i2c_lock);
+}
+
+/* Sensor bus recovery ...
+ * A device holding SDA low (e.g. interrupted in the middle of a read)
+ * blocks all transfers. Recovery gets exclusive use of the bus: It waits
+ * for the power_i2c_get()/put() sections in progress, holds off new ones
+ * and pauses the touch controller. Then the controller is suspended to
+ * release the pins, SCL is clocked up to 9 times until SDA is released, a
+ * STOP condition is generated and the controller is resumed (unless it was
+ * suspended). Must not be called with the bus held (power_i2c_get()) or
+ * from the system work queue.
+*/
+int power_i2c_recover(void)
+{
+	int rc;
+
+	k_mutex_lock(&i2c_lock, K_FOREVER);
+	while (atomic_get(&i2c_users) > 0)
+	{
+		k_sem_take(&i2c_idle, K_FOREVER);
+	}
+	touch_pause_locked(true);
+#if defined(CONFIG_APP_SIM)
+	rc = sim_i2c_recover();
+#elif defined(CONFIG_I2C_NRFX) && DT_NODE_HAS_STATUS(CCS811, okay)
+	if (i2c == NULL)
+	{
+		rc = -ENODEV;
+	}
+	else
+	{
+		nrfx_err_t err;
+
+		device_set_power_state(i2c, DEVICE_PM_SUSPEND_STATE, NULL, NULL);
+		err = nrfx_twi_twim_bus_recover(DT_PROP(DT_BUS(CCS811), scl_pin),
+										DT_PROP(DT_BUS(CCS811), sda_pin));
+		rc = err == NRFX_SUCCESS ? 0 : -EIO;
+		if (i2c_refs > 0 || !IS_ENABLED(CONFIG_APP_POWER_I2C_SUSPEND))
+		{
+			device_set_power_state(i2c, DEVICE_PM_ACTIVE_STATE, NULL, NULL);
+		}
+	}
+#else
+	rc = -ENOTSUP;
+#endif
+	touch_pause_locked(false);
+	k_mutex_unlock(&i2c_lock);
+
+	if (rc)
+	{
+		LOG_WRN("Sensor bus recovery failed (err %d)", rc);
+	}
+	else
+	{
+		LOG_INF("Sensor bus recovered");
+	}
+
+	return rc;
+}
+
+/* Records a state change of a consumer ...
+*/
+void power_consumer_set(enum power_consumer consumer, uint8_t state)
+{
+	uint32_t now = k_uptime_get_32();
+	k_spinlock_key_t key = k_spin_lock(&power_lock);
+	bool changed = states[consumer] != state;
+
+	if (changed)
+	{
+		residency_ms[consumer][states[consumer]] += now - state_since[consumer];
+		state_since[consumer] = now;
+		states[consumer] = state;
+	}
+	k_spin_unlock(&power_lock, key);
+
+	if (changed && consumer == POWER_DISPLAY)
+	{
+		display_changed(state != 0);
+	}
+}
+
+void power_get_stats(struct power_stats *stats)
+{
+	uint32_t now = k_uptime_get_32();
+	k_spinlock_key_t key = k_spin_lock(&power_lock);
+
+	for (int c = 0; c < POWER_CONSUMER_COUNT; c++)
+	{
+		for (int s = 0; s < POWER_STATES_MAX; s++)
+		{
+			stats->residency_ms[c][s] = residency_ms[c][s];
+		}
+		stats->residency_ms[c][states[c]] += now - state_since[c];
+	}
+	stats->avg_current_ua = charge_locked(now) / MAX(now, 1);
+	stats->last_hour_current_ua = report_current;
+	k_spin_unlock(&power_lock, key);
+
+	stats->display_wakeups = atomic_get(&display_wakeups);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_power(const struct shell *shell, size_t argc, char **argv)
+{
+	static const char *const names[POWER_CONSUMER_COUNT] = {
+		[POWER_DISPLAY] = "display",
+		[POWER_I2C] = "i2c",
+		[POWER_CCS811] = "ccs811",
+	};
+	struct power_stats stats;
+
+	power_get_stats(&stats);
+
+	shell_print(shell, "%-8s %10s %10s %10s %10s", "state s", "0", "1", "2", "3");
+	for (int c = 0; c < POWER_CONSUMER_COUNT; c++)
+	{
+		shell_print(shell, "%-8s %10u %10u %10u %10u", names[c],
+					stats.residency_ms[c][0] / MSEC_PER_SEC, stats.residency_ms[c][1] / MSEC_PER_SEC,
+					stats.residency_ms[c][2] / MSEC_PER_SEC, stats.residency_ms[c][3] / MSEC_PER_SEC);
+	}
+	shell_print(shell, "Estimated current: %u uA (since startup), %u uA (last full hour)",
+				stats.avg_current_ua, stats.last_hour_current_ua);
+	shell_print(shell, "Display wakeups: %u", stats.display_wakeups);
+
+	return 0;
+}
+
+SHELL_CMD_REGISTER(power, NULL, "State residency and current estimate", cmd_power);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __POWER_H
+#define __POWER_H
+
+#include <zephyr.h>
+
+/* Power management ...
+ * - Display: Blanked (and the backlight switched off, if a 'backlight'
+ *   alias exists) after CONFIG_APP_POWER_DISPLAY_TIMEOUT_S without user
+ *   activity. A touch or a change of the IAQ rating wakes it up. The GUI
+ *   thread applies the state, see gui.c.
+ * - Sensor I2C bus: Suspended whenever no driver call is in progress.
+ *   power_i2c_recover() frees a bus held by a device (see health.h).
+ *   The touch controller is polled over the same bus, so it holds the bus
+ *   while its callback is enabled (always with CONFIG_APP_POWER_TOUCH_WAKE,
+ *   else only while the display is on).
+ * - Everything else is left to the kernel: Without periodic wakeups (tickless
+ *   kernel, paced acquisition threads, event driven GUI thread) the SoC stays
+ *   in its idle state between samples.
+ *
+ * The time spent in each state of the major consumers is accumulated and
+ * turned into an estimate of the average current using typical data sheet
+ * values.
+*/
+enum power_consumer
+{
+	POWER_DISPLAY, /* states: 0 = blanked, 1 = on */
+	POWER_I2C,	   /* states: 0 = suspended, 1 = active */
+	POWER_CCS811,  /* states: drive mode 0 .. 3 */
+	POWER_CONSUMER_COUNT,
+};
+
+#define POWER_STATES_MAX 4
+
+struct power_stats
+{
+	uint32_t residency_ms[POWER_CONSUMER_COUNT][POWER_STATES_MAX];
+	uint32_t avg_current_ua;	   /* since startup */
+	uint32_t last_hour_current_ua; /* during the last full hour */
+	uint32_t display_wakeups;
+};
+
+void power_init(void);
+
+void power_activity(void);
+
+bool power_display_active(uint32_t *remaining_ms);
+
+void power_i2c_get(void);
+
+void power_i2c_put(void);
+
+int power_i2c_recover(void);
+
+void power_consumer_set(enum power_consumer consumer, uint8_t state);
+
+void power_get_stats(struct power_stats *stats);
+
+#endif
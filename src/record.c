@@ -0,0 +1,132 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <sys/byteorder.h>
+#include <errno.h>
+#include <string.h>
+
+#include "record.h"
+
+static inline uint16_t clamp_u16(int32_t value)
+{
+	return CLAMP(value, 0, UINT16_MAX);
+}
+
+static inline int16_t clamp_s16(int32_t value)
+{
+	return CLAMP(value, INT16_MIN, INT16_MAX);
+}
+
+/* Short name of a record channel (e.g. for shell output)
+*/
+const char *record_channel_name(enum record_channel channel)
+{
+	static const char *const names[RECORD_CHAN_COUNT] = {
+		[RECORD_CHAN_TEMP] = "temp",
+		[RECORD_CHAN_PRESS] = "press",
+		[RECORD_CHAN_HUMIDITY] = "humidity",
+		[RECORD_CHAN_CO2] = "co2",
+		[RECORD_CHAN_TVOC] = "tvoc",
+	};
+
+	return channel < RECORD_CHAN_COUNT ? names[channel] : "?";
+}
+
+/* Packs a record: The values are rounded to the resolution of the
+ * packed representation.
+*/
+void record_pack(const struct iaq_record *record, struct iaq_record_packed *packed)
+{
+	packed->timestamp = sys_cpu_to_le32(record->timestamp);
+	packed->temp = sys_cpu_to_le16(clamp_s16(fxp_round(record->values[RECORD_CHAN_TEMP], 2)));
+	packed->humidity = sys_cpu_to_le16(clamp_u16(fxp_round(record->values[RECORD_CHAN_HUMIDITY], 2)));
+	packed->press = sys_cpu_to_le16(clamp_u16(fxp_round(record->values[RECORD_CHAN_PRESS], 2)));
+	packed->co2 = sys_cpu_to_le16(clamp_u16(fxp_round(record->values[RECORD_CHAN_CO2], 0)));
+	packed->tvoc = sys_cpu_to_le16(clamp_u16(fxp_round(record->values[RECORD_CHAN_TVOC], 0)));
+	packed->iaq_index = record->iaq_index;
+	packed->flags = 0;
+}
+
+void record_unpack(const struct iaq_record_packed *packed, struct iaq_record *record)
+{
+	record->timestamp = sys_le32_to_cpu(packed->timestamp);
+	record->values[RECORD_CHAN_TEMP] = (int16_t)sys_le16_to_cpu(packed->temp) * 10;
+	record->values[RECORD_CHAN_HUMIDITY] = sys_le16_to_cpu(packed->humidity) * 10;
+	record->values[RECORD_CHAN_PRESS] = sys_le16_to_cpu(packed->press) * 10;
+	record->values[RECORD_CHAN_CO2] = fxp_from_int(sys_le16_to_cpu(packed->co2));
+	record->values[RECORD_CHAN_TVOC] = fxp_from_int(sys_le16_to_cpu(packed->tvoc));
+	record->iaq_index = packed->iaq_index;
+}
+
+/* Packs a record for advertising (the timestamp is not transmitted) ...
+*/
+void record_pack_adv(const struct iaq_record *record, uint16_t company_id, uint8_t seq,
+					 struct iaq_record_adv *adv)
+{
+	struct iaq_record_packed packed;
+
+	record_pack(record, &packed);
+
+	adv->company_id = sys_cpu_to_le16(company_id);
+	adv->version = RECORD_ADV_VERSION;
+	adv->seq = seq;
+	adv->temp = packed.temp;
+	adv->humidity = packed.humidity;
+	adv->press = packed.press;
+	adv->co2 = packed.co2;
+	adv->tvoc = packed.tvoc;
+	adv->iaq_index = packed.iaq_index;
+	adv->flags = packed.flags;
+}
+
+/* Unpacks received manufacturer specific data (the timestamp is set to 0).
+ * Returns -EINVAL if the data is not an advertising payload of this
+ * version and company id.
+*/
+int record_unpack_adv(const uint8_t *data, size_t len, uint16_t company_id,
+					  struct iaq_record *record, uint8_t *seq)
+{
+	struct iaq_record_adv adv;
+	struct iaq_record_packed packed;
+
+	if (len != sizeof(adv))
+	{
+		return -EINVAL;
+	}
+	memcpy(&adv, data, sizeof(adv));
+	if (sys_le16_to_cpu(adv.company_id) != company_id || adv.version != RECORD_ADV_VERSION)
+	{
+		return -EINVAL;
+	}
+
+	packed.timestamp = 0;
+	packed.temp = adv.temp;
+	packed.humidity = adv.humidity;
+	packed.press = adv.press;
+	packed.co2 = adv.co2;
+	packed.tvoc = adv.tvoc;
+	packed.iaq_index = adv.iaq_index;
+	packed.flags = adv.flags;
+	record_unpack(&packed, record);
+	*seq = adv.seq;
+
+	return 0;
+}
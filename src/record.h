@@ -0,0 +1,105 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include <zephyr.h>
+
+#include "fxp.h"
+
+/* Measurement channels of a record ...
+*/
+enum record_channel
+{
+	RECORD_CHAN_TEMP,	  /* m°C */
+	RECORD_CHAN_PRESS,	  /* Pa */
+	RECORD_CHAN_HUMIDITY, /* m%RH */
+	RECORD_CHAN_CO2,	  /* 1/1000 ppm */
+	RECORD_CHAN_TVOC,	  /* 1/1000 ppb */
+	RECORD_CHAN_COUNT,
+};
+
+/* A record combines the latest samples of all sensors and the resulting
+ * IAQ index (0 if no IAQ index is available yet, e.g. while calibrating).
+*/
+struct iaq_record
+{
+	uint32_t timestamp; /* uptime in ms */
+	fxp_t values[RECORD_CHAN_COUNT];
+	uint8_t iaq_index;
+};
+
+/* Flags of the packed record / advertising payload
+*/
+#define RECORD_FLAG_ALARM BIT(0) /* at least one alarm active */
+
+/* Packed (16 bytes, little endian) representation of a record as used for
+ * persistent storage and data transfer ...
+*/
+struct iaq_record_packed
+{
+	uint32_t timestamp; /* uptime in ms */
+	int16_t temp;		/* 0.01 °C */
+	uint16_t humidity;	/* 0.01 %RH */
+	uint16_t press;		/* 0.1 hPa */
+	uint16_t co2;		/* ppm */
+	uint16_t tvoc;		/* ppb */
+	uint8_t iaq_index;
+	uint8_t flags; /* RECORD_FLAG_* */
+} __packed;
+
+BUILD_ASSERT(sizeof(struct iaq_record_packed) == 16, "Unexpected packed record size");
+
+/* Advertising payload (manufacturer specific data, 16 bytes, little endian) ...
+ * Same resolution as the packed record. The sequence number is incremented
+ * whenever the payload changes, so observers can drop duplicates.
+*/
+#define RECORD_ADV_VERSION 1
+
+struct iaq_record_adv
+{
+	uint16_t company_id;
+	uint8_t version; /* RECORD_ADV_VERSION */
+	uint8_t seq;
+	int16_t temp;	   /* 0.01 °C */
+	uint16_t humidity; /* 0.01 %RH */
+	uint16_t press;	   /* 0.1 hPa */
+	uint16_t co2;	   /* ppm */
+	uint16_t tvoc;	   /* ppb */
+	uint8_t iaq_index;
+	uint8_t flags; /* RECORD_FLAG_* */
+} __packed;
+
+BUILD_ASSERT(sizeof(struct iaq_record_adv) == 16, "Unexpected advertising payload size");
+
+const char *record_channel_name(enum record_channel channel);
+
+void record_pack(const struct iaq_record *record, struct iaq_record_packed *packed);
+
+void record_unpack(const struct iaq_record_packed *packed, struct iaq_record *record);
+
+void record_pack_adv(const struct iaq_record *record, uint16_t company_id, uint8_t seq,
+					 struct iaq_record_adv *adv);
+
+int record_unpack_adv(const uint8_t *data, size_t len, uint16_t company_id,
+					  struct iaq_record *record, uint8_t *seq);
+
+#endif
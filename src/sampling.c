@@ -0,0 +1,134 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <stdlib.h>
+
+#include "iaq.h"
+#include "sampling.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(sampling, CONFIG_APP_SAMPLING_LOG_LEVEL);
+
+#define SAMPLING_SLOW_AFTER_MS (CONFIG_APP_SAMPLING_SLOW_AFTER_S * MSEC_PER_SEC)
+#define SAMPLING_IDLE_AFTER_MS (CONFIG_APP_SAMPLING_IDLE_AFTER_S * MSEC_PER_SEC)
+
+/* Significant change per channel (0 = ignored)
+*/
+static const fxp_t thresholds[RECORD_CHAN_COUNT] = {
+	[RECORD_CHAN_TEMP] = CONFIG_APP_SAMPLING_TEMP_THRESHOLD,
+	[RECORD_CHAN_PRESS] = 0,
+	[RECORD_CHAN_HUMIDITY] = CONFIG_APP_SAMPLING_HUMIDITY_THRESHOLD,
+	[RECORD_CHAN_CO2] = CONFIG_APP_SAMPLING_CO2_THRESHOLD * FXP_SCALE,
+	[RECORD_CHAN_TVOC] = CONFIG_APP_SAMPLING_TVOC_THRESHOLD * FXP_SCALE,
+};
+
+static const char *const rate_names[SENSORS_RATE_COUNT] = {
+	[SENSORS_RATE_FAST] = "fast",
+	[SENSORS_RATE_SLOW] = "slow",
+	[SENSORS_RATE_IDLE] = "idle",
+};
+
+/* Reference record: The values at the last significant change. Changes are
+ * measured against it, so slow drifts are detected as well.
+*/
+static struct iaq_record reference;
+static bool reference_valid = false;
+static uint32_t stable_since;
+static enum sensors_rate rate = SENSORS_RATE_FAST;
+static uint32_t rate_since;
+static uint32_t residency_ms[SENSORS_RATE_COUNT];
+
+static bool significant_change(const struct iaq_record *record)
+{
+	for (int i = 0; i < RECORD_CHAN_COUNT; i++)
+	{
+		if (thresholds[i] != 0 && abs(record->values[i] - reference.values[i]) > thresholds[i])
+		{
+			return true;
+		}
+	}
+
+	return record->iaq_index != 0 && reference.iaq_index != 0 &&
+		   get_iaq_rating(record->iaq_index) != get_iaq_rating(reference.iaq_index);
+}
+
+/* Feeds a new (fused) record into the scheduler ...
+ * No IAQ index yet (warm-up, calibration) keeps the fast rate.
+*/
+void sampling_update(const struct iaq_record *record, uint32_t now)
+{
+	enum sensors_rate next;
+
+	if (!reference_valid || record->iaq_index == 0 || significant_change(record))
+	{
+		reference = *record;
+		reference_valid = true;
+		stable_since = now;
+	}
+
+	if (now - stable_since >= SAMPLING_IDLE_AFTER_MS)
+	{
+		next = SENSORS_RATE_IDLE;
+	}
+	else if (now - stable_since >= SAMPLING_SLOW_AFTER_MS)
+	{
+		next = SENSORS_RATE_SLOW;
+	}
+	else
+	{
+		next = SENSORS_RATE_FAST;
+	}
+
+	if (next != rate)
+	{
+		struct sampling_stats stats;
+
+		residency_ms[rate] += now - rate_since;
+		rate_since = now;
+		rate = next;
+		sensors_set_rate(rate);
+
+		sampling_get_stats(&stats, now);
+		LOG_INF("Rate %s (duty cycle: %u %%, samples saved: %u)",
+				rate_names[rate], stats.duty_cycle, stats.samples_saved);
+	}
+}
+
+/* Gets the statistics: The duty cycle relates the samples taken to the
+ * samples taken at the fast rate (1 / s per sensor) since startup.
+*/
+void sampling_get_stats(struct sampling_stats *stats, uint32_t now)
+{
+	struct sensors_stats sensors;
+	uint32_t expected = 2 * (now / MSEC_PER_SEC);
+
+	sensors_get_stats(&sensors);
+
+	stats->rate = rate;
+	for (int i = 0; i < SENSORS_RATE_COUNT; i++)
+	{
+		stats->residency_ms[i] = residency_ms[i];
+	}
+	stats->residency_ms[rate] += now - rate_since;
+	stats->samples = sensors.bme280_samples + sensors.ccs811_samples;
+	stats->samples_saved = expected > stats->samples ? expected - stats->samples : 0;
+	stats->duty_cycle = expected > 0 ? MIN(100, (uint64_t)stats->samples * 100 / expected) : 100;
+}
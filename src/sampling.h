@@ -0,0 +1,47 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SAMPLING_H
+#define __SAMPLING_H
+
+#include <zephyr.h>
+
+#include "record.h"
+#include "sensors.h"
+
+/* Adaptive sampling ...
+ * As long as the readings are stable, the sensors are sampled at
+ * successively lower rates. Any significant change (see the thresholds in
+ * Kconfig) or a change of the IAQ rating switches back to the fast rate.
+*/
+struct sampling_stats
+{
+	enum sensors_rate rate;
+	uint32_t residency_ms[SENSORS_RATE_COUNT]; /* time spent per rate */
+	uint32_t samples;						   /* samples taken (all sensors) */
+	uint32_t samples_saved;					   /* compared to sampling at the fast rate */
+	uint8_t duty_cycle;						   /* samples taken / samples at the fast rate (%) */
+};
+
+void sampling_update(const struct iaq_record *record, uint32_t now);
+
+void sampling_get_stats(struct sampling_stats *stats, uint32_t now);
+
+#endif
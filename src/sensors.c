@@ -0,0 +1,912 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/sensor.h>
+#include <drivers/sensor/ccs811.h>
+#include <drivers/gpio.h>
+#include <drivers/i2c.h>
+#include <shell/shell.h>
+#include <zephyr.h>
+
+#include "channels.h"
+#include "flashlog.h"
+#include "fxp.h"
+#include "health.h"
+#include "latency.h"
+#include "pacer.h"
+#include "power.h"
+#include "sensors.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(sensors, CONFIG_APP_SENSORS_LOG_LEVEL);
+
+#if defined(CONFIG_APP_SIM)
+#include "sim/sim.h"
+
+#define BME280_LABEL SIM_BME280_LABEL
+#define CCS811_LABEL SIM_CCS811_LABEL
+#else
+#define BME280 DT_INST(0, bosch_bme280)
+#if DT_NODE_HAS_STATUS(BME280, okay)
+#define BME280_LABEL DT_LABEL(BME280)
+#else
+#error The devicetree has no enabled nodes with compatible "bosch,bme280"
+#define BME280_LABEL "<none>"
+#endif
+
+#define CCS811 DT_INST(0, ams_ccs811)
+#if DT_NODE_HAS_STATUS(CCS811, okay)
+#define CCS811_LABEL DT_LABEL(CCS811)
+#else
+#error The devicetree has no enabled nodes with compatible "ams_ccs811"
+#define CCS811_LABEL "<none>"
+#endif
+#endif
+
+/* Acquisition threads ...
+ * Each sensor is read by its own thread, which publishes timestamped samples
+ * on its channel of the data bus (sample_env_chan, sample_gas_chan). A slow
+ * or stuck sensor therefore only delays its own samples.
+*/
+#define SENSOR_THREAD_STACK_SIZE 2048
+#define SENSOR_THREAD_PRIORITY 5
+
+/* Sampling rates ...
+ * The CCS811 runs in the drive mode matching the rate; its interval is only
+ * used in polling mode. The rate is requested by sensors_set_rate() and
+ * applied by the acquisition threads.
+*/
+static const struct
+{
+	uint32_t bme280_interval_ms;
+	uint32_t ccs811_interval_ms;
+	uint8_t ccs811_drive_mode;
+} rates[SENSORS_RATE_COUNT] = {
+	[SENSORS_RATE_FAST] = {1000, 1000, 1},
+	[SENSORS_RATE_SLOW] = {10000, 10000, 2},
+	[SENSORS_RATE_IDLE] = {60000, 60000, 3},
+};
+
+static atomic_t requested_rate = ATOMIC_INIT(SENSORS_RATE_FAST);
+static atomic_t bme280_samples = ATOMIC_INIT(0);
+static atomic_t ccs811_samples = ATOMIC_INIT(0);
+static atomic_t rate_changes = ATOMIC_INIT(0);
+static K_SEM_DEFINE(bme280_wakeup_sem, 0, 1);
+
+/* Pacing: BME280 always, CCS811 in polling mode (else the sensor's data
+ * ready interrupt paces the thread). Samples are timestamped with the
+ * nominal start of their cycle.
+*/
+#define PACING_REPORT_CYCLES 600
+
+static struct pacer bme280_pacer;
+static struct pacer ccs811_pacer;
+
+K_THREAD_STACK_DEFINE(bme280_thread_stack, SENSOR_THREAD_STACK_SIZE);
+K_THREAD_STACK_DEFINE(ccs811_thread_stack, SENSOR_THREAD_STACK_SIZE);
+static struct k_thread bme280_thread_data;
+static struct k_thread ccs811_thread_data;
+
+static const struct device *bme280;
+static const struct device *ccs811;
+
+/* Latest environmental data for the CCS811 compensation (written by
+ * the BME280 thread, consumed by the CCS811 thread).
+*/
+static struct k_spinlock envdata_lock;
+static struct sensor_value envdata_temp, envdata_humidity;
+static bool envdata_pending = false;
+
+/* Publish a sample on the channel of its sensor. The listeners (alarm
+ * rules) run right away; the consumer stage is notified and never
+ * blocks the acquisition.
+*/
+static void sample_put(struct sensor_sample *sample)
+{
+	const struct bus_channel *chan =
+		sample->source == SENSOR_SAMPLE_BME280 ? &sample_env_chan : &sample_gas_chan;
+
+	if (bus_chan_pub(chan, sample, CHANNELS_PUB_TIMEOUT) != 0)
+	{
+		LOG_WRN("Channel %s busy, dropped sample!", chan->name);
+	}
+}
+
+/* CCS811 data acquisition ...
+ * If the driver has been built with trigger support, the sensor's nINT line
+ * (irq-gpios in the overlay) signals a new eCO2/TVOC result and the sampling
+ * loop simply waits for it. Without trigger support or if the interrupt does
+ * not show up in time, the fetch is repeated within the retry budget of
+ * the health layer (see health.h).
+*/
+#define CCS811_DRDY_MARGIN_MS 1500 /* on top of the measurement period */
+
+static K_SEM_DEFINE(ccs811_drdy_sem, 0, 1); /* also given on rate changes */
+static bool ccs811_trigger_active = false;
+static enum sensors_rate ccs811_rate = SENSORS_RATE_FAST; /* CCS811 thread only */
+static uint32_t ccs811_idle_until = 0;					   /* CCS811 thread only */
+static atomic_t ccs811_idling = ATOMIC_INIT(0);
+
+#ifdef CONFIG_CCS811_TRIGGER
+static void ccs811_drdy_handler(const struct device *dev,
+								struct sensor_trigger *trig)
+{
+	k_sem_give(&ccs811_drdy_sem);
+}
+#endif
+
+/* Setup the CCS811 data ready trigger (if available) ...
+*/
+static void ccs811_trigger_setup(const struct device *dev)
+{
+#ifdef CONFIG_CCS811_TRIGGER
+	struct sensor_trigger trig = {
+		.type = SENSOR_TRIG_DATA_READY,
+		.chan = SENSOR_CHAN_ALL,
+	};
+	int rc = sensor_trigger_set(dev, &trig, ccs811_drdy_handler);
+
+	if (rc == 0)
+	{
+		ccs811_trigger_active = true;
+		LOG_INF("CCS811: Using data ready trigger");
+		return;
+	}
+	LOG_WRN("CCS811: Failed to set data ready trigger (err %d)", rc);
+#endif
+	LOG_INF("CCS811: Using polling mode");
+}
+
+/* Auxiliary function to handle timing issues when fetching a
+ * sample from the CCS811 sensor: Wait for the data ready trigger
+ * (if active) and repeat sensor_sample_fetch until valid data
+ * has been received or the retry budget has been used up.
+ * Returns -ECANCELED if the cycle is skipped (backoff).
+*/
+static int ccs811_sample_fetch(const struct device *dev)
+{
+	static bool first = true;
+	static bool ccs811_fw_app_v2 = false;
+	struct health_retry retry;
+	uint32_t start;
+	int rc;
+
+	if (first)
+	{
+		struct ccs811_configver_type cfgver;
+		power_i2c_get();
+		rc = ccs811_configver_fetch(dev, &cfgver);
+		power_i2c_put();
+		if (rc == 0)
+		{
+			LOG_INF("CCS811: HW %02x; FW Boot %04x App %04x ; mode %02x",
+					cfgver.hw_version, cfgver.fw_boot_version,
+					cfgver.fw_app_version, cfgver.mode);
+			ccs811_fw_app_v2 = (cfgver.fw_app_version >> 8) > 0x11;
+		}
+		first = false;
+	}
+
+	/* Sleep until the sensor signals a new result ...
+	*/
+	if (ccs811_trigger_active &&
+		k_sem_take(&ccs811_drdy_sem, K_MSEC(rates[ccs811_rate].ccs811_interval_ms + CCS811_DRDY_MARGIN_MS)) != 0)
+	{
+		LOG_WRN("CCS811: Data ready timeout, polling ...");
+		latency_event(LATENCY_CCS811_DRDY_TIMEOUT);
+	}
+
+	/* Woken up by a rate change: Apply it first
+	*/
+	if (atomic_get(&requested_rate) != ccs811_rate)
+	{
+		return -EAGAIN;
+	}
+
+	/* Failing sensor: Sampled less often
+	*/
+	if (!health_cycle_due(HEALTH_CCS811))
+	{
+		return -ECANCELED;
+	}
+
+	start = latency_start();
+	health_retry_begin(&retry);
+	power_i2c_get();
+	rc = sensor_sample_fetch(dev);
+	while (rc != 0)
+	{
+		const struct ccs811_result_type *rp = ccs811_result(dev);
+
+		if (rp->status & CCS811_STATUS_ERROR)
+		{
+			LOG_WRN("CCS811: ERROR: %02x", rp->error);
+			latency_event(LATENCY_CCS811_ERROR);
+			break;
+		}
+
+		if (ccs811_fw_app_v2 && !(rp->status & CCS811_STATUS_DATA_READY))
+		{
+			LOG_WRN("CCS811: Stale data!");
+			latency_event(LATENCY_CCS811_STALE);
+		}
+
+		if (!health_retry_next(&retry))
+		{
+			LOG_WRN("CCS811: No valid data after %u attempts!", retry.attempts);
+			latency_event(LATENCY_CCS811_NO_DATA);
+			break;
+		}
+
+		latency_event(LATENCY_CCS811_RETRY);
+		rc = sensor_sample_fetch(dev);
+	}
+	power_i2c_put();
+	latency_end(LATENCY_CCS811_FETCH, start);
+
+	return rc;
+}
+
+/* CCS811 drive mode switching ...
+ * The driver sets the drive mode only at initialization, so MEAS_MODE is
+ * updated directly (keeping the interrupt configuration). The sensor only
+ * listens on I2C while nWAKE is asserted.
+ * Datasheet: Before switching to a lower sample rate, the sensor should be
+ * kept idle (mode 0) for 10 minutes. Switching to a higher rate is immediate.
+*/
+#define CCS811_REG_MEAS_MODE 0x01
+#define CCS811_DRIVE_MODE_MASK 0x70
+#define CCS811_DRIVE_MODE_SHIFT 4
+#define CCS811_DOWNSHIFT_IDLE_S (10 * 60)
+
+static int ccs811_set_drive_mode(uint8_t mode)
+{
+	int rc;
+
+#if defined(CONFIG_APP_SIM)
+	rc = sim_ccs811_set_drive_mode(mode);
+#else
+	const struct device *i2c = device_get_binding(DT_BUS_LABEL(CCS811));
+
+	if (i2c == NULL)
+	{
+		return -ENODEV;
+	}
+
+	power_i2c_get();
+#if DT_NODE_HAS_PROP(CCS811, wake_gpios)
+	const struct device *wake = device_get_binding(DT_GPIO_LABEL(CCS811, wake_gpios));
+
+	gpio_pin_set(wake, DT_GPIO_PIN(CCS811, wake_gpios), 1);
+	k_busy_wait(50);
+#endif
+	rc = i2c_reg_update_byte(i2c, DT_REG_ADDR(CCS811), CCS811_REG_MEAS_MODE,
+							 CCS811_DRIVE_MODE_MASK, mode << CCS811_DRIVE_MODE_SHIFT);
+#if DT_NODE_HAS_PROP(CCS811, wake_gpios)
+	gpio_pin_set(wake, DT_GPIO_PIN(CCS811, wake_gpios), 0);
+	k_busy_wait(20);
+#endif
+	power_i2c_put();
+#endif
+
+	if (rc)
+	{
+		LOG_WRN("CCS811: Failed to set drive mode %u (err %d)", mode, rc);
+	}
+	else
+	{
+		LOG_INF("CCS811: Drive mode %u", mode);
+		power_consumer_set(POWER_CCS811, mode);
+	}
+
+	return rc;
+}
+
+/* Applies a requested rate change (CCS811 thread only) ...
+*/
+static void ccs811_apply_rate(enum sensors_rate rate)
+{
+	if (rate > ccs811_rate)
+	{
+		/* Lower sample rate: Idle first (unless idling already)
+		*/
+		if (ccs811_idle_until == 0)
+		{
+			ccs811_set_drive_mode(0);
+			ccs811_idle_until = k_uptime_get_32() + CCS811_DOWNSHIFT_IDLE_S * MSEC_PER_SEC;
+			atomic_set(&ccs811_idling, 1);
+		}
+	}
+	else
+	{
+		ccs811_set_drive_mode(rates[rate].ccs811_drive_mode);
+		ccs811_idle_until = 0;
+		atomic_set(&ccs811_idling, 0);
+	}
+	ccs811_rate = rate;
+	pacer_set_period(&ccs811_pacer, rates[rate].ccs811_interval_ms);
+}
+
+/* CCS811 baseline handling ...
+ * Once the sensor has been running for CCS811_BURN_IN_S since its last
+ * power-up or reset, its baseline is saved to the flash log together with
+ * that runtime, then every CCS811_BASELINE_SAVE_INTERVAL_S. At startup the
+ * latest baseline is restored if it is not older than CCS811_BASELINE_MAX_BOOT_AGE
+ * boots and was taken after the burn-in, so the sensor doesn't have to settle
+ * from scratch after a reset.
+*/
+#define CCS811_BURN_IN_S (20 * 60)
+#define CCS811_BASELINE_SAVE_INTERVAL_S (60 * 60)
+#define CCS811_BASELINE_MAX_BOOT_AGE 5
+
+static bool ccs811_baseline_restored = false;
+
+/* Sensor runtime (CCS811 thread only): Counted from the uptime of the last
+ * power-up or reset (ms), a reset restarts the burn-in. The next save is due
+ * at the given runtime (s).
+*/
+static uint32_t ccs811_started;
+static uint32_t ccs811_next_baseline_save = CCS811_BURN_IN_S;
+
+static void ccs811_baseline_restore(const struct device *dev)
+{
+	uint16_t baseline;
+	uint16_t boot_age;
+	uint32_t runtime;
+	int rc;
+
+	rc = flashlog_load_baseline(&baseline, &runtime, &boot_age);
+	if (rc)
+	{
+		LOG_INF("CCS811: No saved baseline");
+		return;
+	}
+
+	if (boot_age > CCS811_BASELINE_MAX_BOOT_AGE || runtime < CCS811_BURN_IN_S)
+	{
+		LOG_WRN("CCS811: Saved baseline %04x discarded (age: %u boots, runtime: %u s)",
+				baseline, boot_age, runtime);
+		return;
+	}
+
+	rc = ccs811_baseline_update(dev, baseline);
+	if (rc)
+	{
+		LOG_WRN("CCS811: Failed to restore baseline (err %d)", rc);
+		return;
+	}
+
+	ccs811_baseline_restored = true;
+	LOG_INF("CCS811: Baseline %04x restored (age: %u boots)", baseline, boot_age);
+}
+
+static void ccs811_baseline_save(const struct device *dev, uint32_t runtime)
+{
+	int baseline = ccs811_baseline_fetch(dev);
+	int rc;
+
+	if (baseline < 0)
+	{
+		LOG_WRN("CCS811: Failed to fetch baseline (err %d)", baseline);
+		return;
+	}
+
+	rc = flashlog_save_baseline(baseline, runtime);
+	if (rc)
+	{
+		LOG_WRN("CCS811: Failed to save baseline (err %d)", rc);
+		return;
+	}
+
+	LOG_INF("CCS811: Baseline %04x saved", baseline);
+}
+
+/* CCS811 reset ...
+ * Pulses nRESET (reset-gpios), else writes the software reset sequence,
+ * then starts the application firmware and restores the drive mode, the
+ * data ready interrupt and the baseline: The driver does this only at its
+ * initialization. CCS811 thread only.
+*/
+#define CCS811_REG_APP_START 0xF4
+#define CCS811_REG_SW_RESET 0xFF
+#define CCS811_MEAS_MODE_INTERRUPT BIT(3)
+#define CCS811_RESET_START_MS 20 /* boot time after a reset */
+#define CCS811_APP_START_MS 2
+
+static int ccs811_reset(void)
+{
+	uint8_t mode = ccs811_idle_until != 0 ? 0 : rates[ccs811_rate].ccs811_drive_mode;
+	int rc;
+
+#if defined(CONFIG_APP_SIM)
+	rc = sim_ccs811_reset(mode);
+#else
+	const struct device *i2c = device_get_binding(DT_BUS_LABEL(CCS811));
+	const uint8_t app_start = CCS811_REG_APP_START;
+
+	if (i2c == NULL)
+	{
+		return -ENODEV;
+	}
+
+	power_i2c_get();
+#if DT_NODE_HAS_PROP(CCS811, wake_gpios)
+	const struct device *wake = device_get_binding(DT_GPIO_LABEL(CCS811, wake_gpios));
+
+	gpio_pin_set(wake, DT_GPIO_PIN(CCS811, wake_gpios), 1);
+	k_busy_wait(50);
+#endif
+#if DT_NODE_HAS_PROP(CCS811, reset_gpios)
+	const struct device *reset = device_get_binding(DT_GPIO_LABEL(CCS811, reset_gpios));
+
+	gpio_pin_set(reset, DT_GPIO_PIN(CCS811, reset_gpios), 1);
+	k_busy_wait(20);
+	gpio_pin_set(reset, DT_GPIO_PIN(CCS811, reset_gpios), 0);
+	rc = 0;
+#else
+	const uint8_t sw_reset[] = {CCS811_REG_SW_RESET, 0x11, 0xE5, 0x72, 0x8A};
+
+	rc = i2c_write(i2c, sw_reset, sizeof(sw_reset), DT_REG_ADDR(CCS811));
+#endif
+	k_sleep(K_MSEC(CCS811_RESET_START_MS));
+	if (rc == 0)
+	{
+		rc = i2c_write(i2c, &app_start, 1, DT_REG_ADDR(CCS811));
+		k_sleep(K_MSEC(CCS811_APP_START_MS));
+	}
+	if (rc == 0)
+	{
+		rc = i2c_reg_write_byte(i2c, DT_REG_ADDR(CCS811), CCS811_REG_MEAS_MODE,
+								(mode << CCS811_DRIVE_MODE_SHIFT) |
+									(ccs811_trigger_active ? CCS811_MEAS_MODE_INTERRUPT : 0));
+	}
+#if DT_NODE_HAS_PROP(CCS811, wake_gpios)
+	gpio_pin_set(wake, DT_GPIO_PIN(CCS811, wake_gpios), 0);
+	k_busy_wait(20);
+#endif
+	power_i2c_put();
+#endif
+
+	if (rc)
+	{
+		LOG_WRN("CCS811: Reset failed (err %d)", rc);
+		return rc;
+	}
+
+	LOG_INF("CCS811: Reset, drive mode %u", mode);
+	ccs811_started = k_uptime_get_32();
+	ccs811_next_baseline_save = CCS811_BURN_IN_S;
+	power_consumer_set(POWER_CCS811, mode);
+	power_i2c_get();
+	ccs811_baseline_restore(ccs811);
+	power_i2c_put();
+
+	return 0;
+}
+
+/* Accounts a cycle of a sensor and carries out the escalation of the
+ * health layer, if any
+*/
+static void sensor_cycle_end(enum health_sensor sensor, int rc, uint32_t interval_ms)
+{
+	switch (health_cycle_end(sensor, rc, interval_ms))
+	{
+	case HEALTH_ACTION_RECOVER_BUS:
+		power_i2c_recover();
+		break;
+	case HEALTH_ACTION_RESET:
+		if (sensor == HEALTH_CCS811)
+		{
+			ccs811_reset();
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void pacing_report(const char *name, struct pacer *pacer)
+{
+	struct pacer_stats stats;
+
+	pacer_get_stats(pacer, &stats);
+	LOG_INF("%s: Pacing: %u cycles of %u ms, %u overruns, %u missed, "
+			"jitter min/p50/p90/p99/max: %u/%u/%u/%u/%u us",
+			name, stats.cycles, stats.period_ms, stats.overruns, stats.missed,
+			stats.jitter_min_us, stats.jitter_p50_us, stats.jitter_p90_us, stats.jitter_p99_us,
+			stats.jitter_max_us);
+}
+
+/* Acquisition thread: BME280
+*/
+static void bme280_run(void *p1, void *p2, void *p3)
+{
+	enum sensors_rate rate = atomic_get(&requested_rate);
+
+	pacer_init(&bme280_pacer, &bme280_wakeup_sem, rates[rate].bme280_interval_ms);
+
+	while (1)
+	{
+		struct sensor_sample sample = {
+			.source = SENSOR_SAMPLE_BME280,
+		};
+
+		struct sensor_value temp, press, humidity;
+		struct health_retry retry;
+
+		health_checkin(HEALTH_TASK_BME280, rates[rate].bme280_interval_ms);
+
+		/* Woken up early if the rate changes
+		*/
+		if (pacer_wait(&bme280_pacer) != 0)
+		{
+			if (atomic_get(&requested_rate) != rate)
+			{
+				rate = atomic_get(&requested_rate);
+				pacer_set_period(&bme280_pacer, rates[rate].bme280_interval_ms);
+			}
+			continue;
+		}
+
+		/* Failing sensor: Sampled less often
+		*/
+		if (!health_cycle_due(HEALTH_BME280))
+		{
+			continue;
+		}
+
+		uint32_t start = latency_start();
+
+		health_retry_begin(&retry);
+		power_i2c_get();
+		sample.rc = sensor_sample_fetch(bme280);
+		while (sample.rc != 0 && health_retry_next(&retry))
+		{
+			sample.rc = sensor_sample_fetch(bme280);
+		}
+		power_i2c_put();
+		latency_end(LATENCY_BME280_FETCH, start);
+		sample.timestamp = pacer_timestamp(&bme280_pacer);
+		if (sample.rc == 0)
+		{
+			/* Get sensor values for temperature, pressure and humidity
+			*/
+			sensor_channel_get(bme280, SENSOR_CHAN_AMBIENT_TEMP, &temp);
+			sensor_channel_get(bme280, SENSOR_CHAN_PRESS, &press);
+			sensor_channel_get(bme280, SENSOR_CHAN_HUMIDITY, &humidity);
+			sample.env.temp = fxp_from_sensor_value(&temp);
+			sample.env.press = fxp_from_sensor_value(&press);
+			sample.env.humidity = fxp_from_sensor_value(&humidity);
+
+			LOG_INF("BME280: temp: %d m°C; press: %d Pa; humidity: %d m%%RH",
+					sample.env.temp, sample.env.press, sample.env.humidity);
+
+			/* Hand the environmental data over to the CCS811 thread
+			*/
+			k_spinlock_key_t key = k_spin_lock(&envdata_lock);
+			envdata_temp = temp;
+			envdata_humidity = humidity;
+			envdata_pending = true;
+			k_spin_unlock(&envdata_lock, key);
+		}
+		else
+		{
+			LOG_WRN("BME280: Failed to fetch sensor data after %u attempts!", retry.attempts);
+			latency_event(LATENCY_BME280_ERROR);
+		}
+
+		sample_put(&sample);
+		atomic_inc(&bme280_samples);
+		sensor_cycle_end(HEALTH_BME280, sample.rc, rates[rate].bme280_interval_ms);
+
+		if (bme280_pacer.cycles % PACING_REPORT_CYCLES == 0)
+		{
+			pacing_report("BME280", &bme280_pacer);
+			if (!ccs811_trigger_active)
+			{
+				pacing_report("CCS811", &ccs811_pacer);
+			}
+		}
+	}
+}
+
+/* Acquisition thread: CCS811
+*/
+static void ccs811_run(void *p1, void *p2, void *p3)
+{
+	while (1)
+	{
+		struct sensor_sample sample = {
+			.source = SENSOR_SAMPLE_CCS811,
+		};
+		struct sensor_value temp, humidity;
+		enum sensors_rate rate = atomic_get(&requested_rate);
+		bool update;
+		int rc;
+
+		if (rate != ccs811_rate)
+		{
+			ccs811_apply_rate(rate);
+		}
+		health_checkin(HEALTH_TASK_CCS811, rates[ccs811_rate].ccs811_interval_ms + CCS811_DRDY_MARGIN_MS);
+
+		/* Idle before a lower sample rate: No results
+		*/
+		if (ccs811_idle_until != 0)
+		{
+			int32_t remaining = ccs811_idle_until - k_uptime_get_32();
+
+			if (remaining > 0)
+			{
+				health_checkin(HEALTH_TASK_CCS811, remaining);
+				k_sem_take(&ccs811_drdy_sem, K_MSEC(remaining));
+				continue;
+			}
+			ccs811_set_drive_mode(rates[ccs811_rate].ccs811_drive_mode);
+			ccs811_idle_until = 0;
+			atomic_set(&ccs811_idling, 0);
+			pacer_set_period(&ccs811_pacer, rates[ccs811_rate].ccs811_interval_ms);
+		}
+
+		/* Polling mode: Wait for the next cycle (or a rate change)
+		*/
+		if (!ccs811_trigger_active && pacer_wait(&ccs811_pacer) != 0)
+		{
+			continue;
+		}
+
+		k_spinlock_key_t key = k_spin_lock(&envdata_lock);
+		update = envdata_pending;
+		temp = envdata_temp;
+		humidity = envdata_humidity;
+		envdata_pending = false;
+		k_spin_unlock(&envdata_lock, key);
+
+		/* Accurate calculation of gas levels requires accurate environment data. 
+		 * Measurements are only accurate to 0.5 Cel and 0.5 RH.
+		 * The CCS811 features an ENV_DATA register, which can be 'fed' with
+		 * with the actual environmental data to improve the accuracy of the
+		 * provided values for gas levels.
+		*/
+		if (update)
+		{
+			uint32_t start = latency_start();
+
+			power_i2c_get();
+			rc = ccs811_envdata_update(ccs811, &temp, &humidity);
+			power_i2c_put();
+			latency_end(LATENCY_CCS811_ENVDATA, start);
+			if (rc == 0)
+			{
+				LOG_DBG("CCS811: Env data updated!");
+			}
+			else
+			{
+				LOG_WRN("CCS811: Failed to update env data!");
+				latency_event(LATENCY_CCS811_ENVDATA_ERROR);
+			}
+		}
+
+		sample.rc = ccs811_sample_fetch(ccs811);
+		sample.timestamp = ccs811_trigger_active ? k_uptime_get_32() : pacer_timestamp(&ccs811_pacer);
+		if ((sample.rc == -EAGAIN && atomic_get(&requested_rate) != ccs811_rate) ||
+			sample.rc == -ECANCELED)
+		{
+			continue;
+		}
+		if (sample.rc == 0)
+		{
+			struct sensor_value co2, tvoc;
+
+			/* Get sensor values for CO2 and VOC concentration
+			*/
+			sensor_channel_get(ccs811, SENSOR_CHAN_CO2, &co2);
+			sensor_channel_get(ccs811, SENSOR_CHAN_VOC, &tvoc);
+			sample.gas.co2 = fxp_from_sensor_value(&co2);
+			sample.gas.tvoc = fxp_from_sensor_value(&tvoc);
+
+			LOG_INF("CCS811: %d ppm eCO2; %d ppb eTVOC",
+					fxp_to_int(sample.gas.co2),
+					fxp_to_int(sample.gas.tvoc));
+
+			/* Save the baseline periodically
+			*/
+			uint32_t runtime = (k_uptime_get_32() - ccs811_started) / MSEC_PER_SEC;
+			if (runtime >= ccs811_next_baseline_save)
+			{
+				power_i2c_get();
+				ccs811_baseline_save(ccs811, runtime);
+				power_i2c_put();
+				ccs811_next_baseline_save = runtime + CCS811_BASELINE_SAVE_INTERVAL_S;
+			}
+		}
+		else
+		{
+			LOG_WRN("CCS811: Failed to fetch sensor data!");
+		}
+
+		sample_put(&sample);
+		atomic_inc(&ccs811_samples);
+		sensor_cycle_end(HEALTH_CCS811, sample.rc, rates[ccs811_rate].ccs811_interval_ms);
+	}
+}
+
+/* Setup the sensors and start the acquisition threads ...
+*/
+int sensors_init(void)
+{
+	/* Setup sensor: BME280
+	*/
+	bme280 = device_get_binding(BME280_LABEL);
+	if (bme280 == NULL)
+	{
+		LOG_ERR("No device \"%s\" found; Initialization failed?", BME280_LABEL);
+		return -ENODEV;
+	}
+	else
+	{
+		LOG_DBG("Found device \"%s\"", BME280_LABEL);
+		LOG_DBG("Device is %p, name is %s", bme280, bme280->name);
+	}
+
+	/* Setup sensor: CCS811
+	*/
+	ccs811 = device_get_binding(CCS811_LABEL);
+	if (ccs811 == NULL)
+	{
+		LOG_ERR("No device \"%s\" found; Initialization failed?", CCS811_LABEL);
+		return -ENODEV;
+	}
+	else
+	{
+		LOG_DBG("Found device \"%s\"", CCS811_LABEL);
+		LOG_DBG("Device is %p, name is %s", ccs811, ccs811->name);
+	}
+	power_i2c_get();
+	ccs811_trigger_setup(ccs811);
+	ccs811_baseline_restore(ccs811);
+	power_i2c_put();
+
+	/* Start the acquisition threads
+	*/
+	pacer_init(&ccs811_pacer, &ccs811_drdy_sem, rates[SENSORS_RATE_FAST].ccs811_interval_ms);
+
+	k_thread_create(&bme280_thread_data, bme280_thread_stack,
+					K_THREAD_STACK_SIZEOF(bme280_thread_stack),
+					bme280_run, NULL, NULL, NULL,
+					SENSOR_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&bme280_thread_data, "bme280");
+
+	k_thread_create(&ccs811_thread_data, ccs811_thread_stack,
+					K_THREAD_STACK_SIZEOF(ccs811_thread_stack),
+					ccs811_run, NULL, NULL, NULL,
+					SENSOR_THREAD_PRIORITY, 0, K_NO_WAIT);
+	k_thread_name_set(&ccs811_thread_data, "ccs811");
+
+	return 0;
+}
+
+/* Has a saved CCS811 baseline been restored at startup?
+*/
+bool sensors_ccs811_baseline_restored(void)
+{
+	return ccs811_baseline_restored;
+}
+
+/* Requests a sampling rate ...
+ * The acquisition threads are woken up, so a higher rate takes effect
+ * immediately.
+*/
+void sensors_set_rate(enum sensors_rate rate)
+{
+	if (atomic_set(&requested_rate, rate) != rate)
+	{
+		atomic_inc(&rate_changes);
+		k_sem_give(&bme280_wakeup_sem);
+		k_sem_give(&ccs811_drdy_sem);
+	}
+}
+
+/* Gets the current interval between two samples of a sensor, i.e. the
+ * expected maximum age of its latest sample ...
+*/
+uint32_t sensors_get_interval(enum sensor_sample_source source)
+{
+	enum sensors_rate rate = atomic_get(&requested_rate);
+
+	if (source == SENSOR_SAMPLE_BME280)
+	{
+		return rates[rate].bme280_interval_ms;
+	}
+
+	/* Including the idle period before a lower rate
+	*/
+	if (atomic_get(&ccs811_idling))
+	{
+		return CCS811_DOWNSHIFT_IDLE_S * MSEC_PER_SEC + rates[rate].ccs811_interval_ms;
+	}
+
+	return rates[rate].ccs811_interval_ms;
+}
+
+void sensors_get_stats(struct sensors_stats *stats)
+{
+	stats->bme280_samples = atomic_get(&bme280_samples);
+	stats->ccs811_samples = atomic_get(&ccs811_samples);
+	stats->rate_changes = atomic_get(&rate_changes);
+}
+
+/* Gets the pacing statistics of a sensor's acquisition thread (the CCS811
+ * thread is only paced in polling mode).
+*/
+void sensors_get_pacing_stats(enum sensor_sample_source source, struct pacer_stats *stats)
+{
+	pacer_get_stats(source == SENSOR_SAMPLE_BME280 ? &bme280_pacer : &ccs811_pacer, stats);
+}
+
+void sensors_reset_pacing_stats(void)
+{
+	pacer_reset_stats(&bme280_pacer);
+	pacer_reset_stats(&ccs811_pacer);
+}
+
+#if defined(CONFIG_SHELL)
+
+static int cmd_pacing_show(const struct shell *shell, size_t argc, char **argv)
+{
+	static const char *const names[] = {
+		[SENSOR_SAMPLE_BME280] = "BME280",
+		[SENSOR_SAMPLE_CCS811] = "CCS811",
+	};
+
+	shell_print(shell, "%-8s %8s %8s %8s %8s %8s %8s %8s %8s %8s", "sensor", "period",
+				"cycles", "overrun", "missed", "min us", "p50 us", "p90 us", "p99 us", "max us");
+	for (int source = SENSOR_SAMPLE_BME280; source <= SENSOR_SAMPLE_CCS811; source++)
+	{
+		struct pacer_stats stats;
+
+		sensors_get_pacing_stats(source, &stats);
+		shell_print(shell, "%-8s %8u %8u %8u %8u %8u %8u %8u %8u %8u", names[source],
+					stats.period_ms, stats.cycles, stats.overruns, stats.missed,
+					stats.jitter_min_us, stats.jitter_p50_us, stats.jitter_p90_us,
+					stats.jitter_p99_us, stats.jitter_max_us);
+	}
+
+	return 0;
+}
+
+static int cmd_pacing_reset(const struct shell *shell, size_t argc, char **argv)
+{
+	sensors_reset_pacing_stats();
+	shell_print(shell, "Pacing statistics cleared");
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_pacing,
+							   SHELL_CMD(show, NULL, "Show the pacing of the acquisition threads", cmd_pacing_show),
+							   SHELL_CMD(reset, NULL, "Clear the statistics", cmd_pacing_reset),
+							   SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(pacing, &sub_pacing, "Sensor acquisition pacing", NULL);
+
+#endif
@@ -0,0 +1,93 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SENSORS_H
+#define __SENSORS_H
+
+#include <zephyr.h>
+#include <drivers/sensor.h>
+
+#include "fxp.h"
+#include "pacer.h"
+
+/* Source of a sample: Each sensor is read by its own acquisition thread.
+*/
+enum sensor_sample_source
+{
+	SENSOR_SAMPLE_BME280,
+	SENSOR_SAMPLE_CCS811,
+};
+
+/* A timestamped sample as published by the acquisition threads
+ * (sample_env_chan, sample_gas_chan).
+*/
+struct sensor_sample
+{
+	uint32_t timestamp; /* uptime in ms */
+	enum sensor_sample_source source;
+	int rc; /* 0 if the values are valid */
+	union
+	{
+		struct
+		{
+			fxp_t temp;		/* m°C */
+			fxp_t press;	/* Pa */
+			fxp_t humidity; /* m%RH */
+		} env;				/* SENSOR_SAMPLE_BME280 */
+		struct
+		{
+			fxp_t co2;	/* 1/1000 ppm */
+			fxp_t tvoc; /* 1/1000 ppb */
+		} gas;			/* SENSOR_SAMPLE_CCS811 */
+	};
+};
+
+/* Sampling rates: BME280 interval / CCS811 drive mode
+*/
+enum sensors_rate
+{
+	SENSORS_RATE_FAST, /* 1 s / mode 1 (1 s) */
+	SENSORS_RATE_SLOW, /* 10 s / mode 2 (10 s) */
+	SENSORS_RATE_IDLE, /* 60 s / mode 3 (60 s) */
+	SENSORS_RATE_COUNT,
+};
+
+struct sensors_stats
+{
+	uint32_t bme280_samples;
+	uint32_t ccs811_samples;
+	uint32_t rate_changes;
+};
+
+int sensors_init(void);
+
+bool sensors_ccs811_baseline_restored(void);
+
+void sensors_set_rate(enum sensors_rate rate);
+
+uint32_t sensors_get_interval(enum sensor_sample_source source);
+
+void sensors_get_stats(struct sensors_stats *stats);
+
+void sensors_get_pacing_stats(enum sensor_sample_source source, struct pacer_stats *stats);
+
+void sensors_reset_pacing_stats(void);
+
+#endif
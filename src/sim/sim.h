@@ -0,0 +1,53 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#include <zephyr.h>
+
+/* Simulated sensors for host builds (native_posix) ...
+ * The devices SIM_BME280_LABEL and SIM_CCS811_LABEL implement the sensor
+ * API (and the CCS811 driver's extended API) on top of a trace: Either a
+ * CSV file given with --trace=<path> or, without that option, a synthetic
+ * office day starting at 08:00.
+ *
+ * CSV format, one sample per line, lines not starting with a digit are
+ * skipped (header, comments):
+ *   time (s since boot), temperature (°C), pressure (kPa), humidity (%RH),
+ *   eCO2 (ppm), TVOC (ppb)
+ * Each sensor replays the trace against the uptime, holding the latest
+ * row whose time has passed, and keeps the last row at the end of the trace.
+*/
+#define SIM_BME280_LABEL "BME280"
+#define SIM_CCS811_LABEL "CCS811"
+
+/* Sets the CCS811 drive mode (0 = idle, 1 - 3 = 1 s, 10 s, 60 s).
+*/
+int sim_ccs811_set_drive_mode(uint8_t mode);
+
+/* Fault injection (option --faults=<percent>, see sim_sensors.c): Recover
+ * the bus, reset the CCS811 and start it in the given drive mode.
+*/
+int sim_i2c_recover(void);
+
+int sim_ccs811_reset(uint8_t mode);
+
+#endif
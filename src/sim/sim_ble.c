@@ -0,0 +1,128 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <string.h>
+
+#include "../ble.h"
+#include "../channels.h"
+#include "../record.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(sim_ble, CONFIG_APP_SIM_LOG_LEVEL);
+
+/* Bluetooth stub for host builds without a controller (CONFIG_BT=n) ...
+ * Packs the advertising payload like ble.c, so the encoding is exercised,
+ * and counts the advertising data updates the controller would have seen.
+*/
+#define SIM_BLE_REPORT_INTERVAL 100
+#define SIM_BLE_UPDATE_THREAD_STACK_SIZE 1024
+#define SIM_BLE_UPDATE_THREAD_PRIORITY 7
+
+static struct iaq_record_adv advertised;
+static uint32_t adv_updates;
+
+/* Last record and flags, updated by the main and the alarm thread
+*/
+static K_MUTEX_DEFINE(adv_mutex);
+static struct iaq_record adv_record;
+static bool adv_record_valid;
+static uint8_t adv_flags;
+
+/* Updates run in their own work queue like ble.c
+*/
+static K_THREAD_STACK_DEFINE(update_queue_stack, SIM_BLE_UPDATE_THREAD_STACK_SIZE);
+static struct k_work_q update_queue;
+
+int ble_init(void)
+{
+	k_work_q_start(&update_queue, update_queue_stack,
+				   K_THREAD_STACK_SIZEOF(update_queue_stack),
+				   SIM_BLE_UPDATE_THREAD_PRIORITY);
+	k_thread_name_set(&update_queue.thread, "ble_update");
+
+	LOG_INF("BT: No controller, advertising is counted only");
+
+	return 0;
+}
+
+static void adv_update(void)
+{
+	struct iaq_record_adv payload;
+
+	record_pack_adv(&adv_record, CONFIG_APP_BT_COMPANY_ID, advertised.seq, &payload);
+	payload.flags |= adv_flags;
+	if (memcmp(&payload, &advertised, sizeof(payload)) == 0)
+	{
+		return;
+	}
+
+	payload.seq = advertised.seq + 1;
+	advertised = payload;
+	if (++adv_updates % SIM_BLE_REPORT_INTERVAL == 0)
+	{
+		LOG_INF("BT: %u advertising data updates", adv_updates);
+	}
+}
+
+void ble_update(const struct iaq_record *record)
+{
+	k_mutex_lock(&adv_mutex, K_FOREVER);
+	adv_record = *record;
+	adv_record_valid = true;
+	adv_update();
+	k_mutex_unlock(&adv_mutex);
+}
+
+void ble_set_flags(uint8_t flags)
+{
+	k_mutex_lock(&adv_mutex, K_FOREVER);
+	if (flags != adv_flags)
+	{
+		LOG_INF("BT: Flags 0x%02x", flags);
+	}
+	adv_flags = flags;
+	if (adv_record_valid)
+	{
+		adv_update();
+	}
+	k_mutex_unlock(&adv_mutex);
+}
+
+/* Observer of iaq_chan: Updates in the BLE update work queue like ble.c
+*/
+static void ble_update_work_handler(struct k_work *work)
+{
+	struct iaq_result result;
+
+	if (bus_chan_read(&iaq_chan, &result, K_FOREVER) == 0)
+	{
+		ble_update(&result.record);
+	}
+}
+
+static K_WORK_DEFINE(ble_update_work, ble_update_work_handler);
+
+static void ble_iaq_changed(const struct bus_channel *chan, const void *message)
+{
+	k_work_submit_to_queue(&update_queue, &ble_update_work);
+}
+
+BUS_LISTENER_DEFINE(ble_listener, ble_iaq_changed);
@@ -0,0 +1,482 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <device.h>
+#include <drivers/sensor.h>
+#include <drivers/sensor/ccs811.h>
+#include <zephyr.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cmdline.h"
+#include "soc.h"
+
+#include "../fxp.h"
+#include "sim.h"
+
+#include <logging/log.h>
+LOG_MODULE_REGISTER(sim, CONFIG_APP_SIM_LOG_LEVEL);
+
+/* Trace replay ...
+ * Each device has its own reader on the trace, so both can replay it at
+ * their own pace. Values are kept in the fixed point units of fxp.h.
+*/
+struct sim_row
+{
+	uint32_t time_ms;
+	fxp_t temp;		/* °C */
+	fxp_t press;	/* kPa */
+	fxp_t humidity; /* %RH */
+	fxp_t co2;		/* ppm */
+	fxp_t tvoc;		/* ppb */
+};
+
+struct sim_trace
+{
+	FILE *file; /* NULL: synthetic trace */
+	struct sim_row row;
+	struct sim_row next;
+	bool has_next;
+	/* synthetic trace state */
+	uint32_t time_ms;
+	double co2;
+	uint32_t random;
+};
+
+static const char *trace_path = NULL;
+static uint32_t fault_percent = 0;
+
+static void sim_options(void)
+{
+	static struct args_struct_t options[] = {
+		{.manual = false,
+		 .is_mandatory = false,
+		 .is_switch = false,
+		 .option = "trace",
+		 .name = "path",
+		 .type = 's',
+		 .dest = (void *)&trace_path,
+		 .call_when_found = NULL,
+		 .descript = "CSV trace replayed by the simulated sensors "
+					 "(default: synthetic office day)"},
+		{.manual = false,
+		 .is_mandatory = false,
+		 .is_switch = false,
+		 .option = "faults",
+		 .name = "percent",
+		 .type = 'u',
+		 .dest = (void *)&fault_percent,
+		 .call_when_found = NULL,
+		 .descript = "Probability of a failed sensor fetch (default: 0)"},
+		ARG_TABLE_ENDMARKER};
+
+	native_add_command_line_opts(options);
+}
+
+NATIVE_TASK(sim_options, PRE_BOOT_1, 1);
+
+static bool trace_read_row(struct sim_trace *trace, struct sim_row *row)
+{
+	char line[128];
+	double time, temp, press, humidity, co2, tvoc;
+
+	while (fgets(line, sizeof(line), trace->file) != NULL)
+	{
+		if (line[0] < '0' || line[0] > '9' ||
+			sscanf(line, "%lf,%lf,%lf,%lf,%lf,%lf", &time, &temp, &press, &humidity, &co2, &tvoc) != 6)
+		{
+			continue;
+		}
+		row->time_ms = (uint32_t)(time * MSEC_PER_SEC);
+		row->temp = (fxp_t)(temp * FXP_SCALE);
+		row->press = (fxp_t)(press * FXP_SCALE);
+		row->humidity = (fxp_t)(humidity * FXP_SCALE);
+		row->co2 = (fxp_t)(co2 * FXP_SCALE);
+		row->tvoc = (fxp_t)(tvoc * FXP_SCALE);
+		return true;
+	}
+
+	return false;
+}
+
+/* Synthetic office day ...
+ * The simulation starts at 08:00; the office is occupied 09:00 - 12:00 and
+ * 13:00 - 17:30. Temperature and humidity follow the daily cycle plus the
+ * occupancy, eCO2 rises by 8 ppm/min while occupied (up to 2000 ppm) and
+ * decays by 12 ppm/min towards 420 ppm otherwise, TVOC follows eCO2.
+*/
+#define SIM_DAY_S (24 * 60 * 60)
+#define SIM_START_S (8 * 60 * 60)
+
+/* sin(2 pi x) for x in [0, 1), Bhaskara's approximation (error < 0.002)
+*/
+static double sim_sin(double x)
+{
+	const double pi = 3.14159265358979;
+	double sign = 1.0;
+	double a;
+
+	if (x >= 0.5)
+	{
+		x -= 0.5;
+		sign = -1.0;
+	}
+	a = 2.0 * pi * x;
+
+	return sign * 16.0 * a * (pi - a) / (5.0 * pi * pi - 4.0 * a * (pi - a));
+}
+
+/* Noise in [-1, 1] (xorshift32)
+*/
+static double sim_noise(struct sim_trace *trace)
+{
+	trace->random ^= trace->random << 13;
+	trace->random ^= trace->random >> 17;
+	trace->random ^= trace->random << 5;
+
+	return (double)(trace->random % 2001) / 1000.0 - 1.0;
+}
+
+/* Fault injection ...
+ * A fetch fails with the probability given by --faults. One in 16 faults
+ * latches the bus (all fetches fail until sim_i2c_recover()), another one
+ * in 16 hangs the CCS811 (until sim_ccs811_reset()).
+*/
+static struct
+{
+	uint32_t random;
+	bool bus_stuck;
+	bool ccs811_hung;
+} faults = {
+	.random = 0x2545f491,
+};
+
+static int sim_fault(bool ccs811)
+{
+	if (faults.bus_stuck || (ccs811 && faults.ccs811_hung))
+	{
+		return -EIO;
+	}
+
+	faults.random ^= faults.random << 13;
+	faults.random ^= faults.random >> 17;
+	faults.random ^= faults.random << 5;
+	if (faults.random % 100 >= fault_percent)
+	{
+		return 0;
+	}
+
+	switch ((faults.random / 100) % 16)
+	{
+	case 0:
+		LOG_WRN("Fault injection: Bus stuck");
+		faults.bus_stuck = true;
+		break;
+	case 1:
+		if (ccs811)
+		{
+			LOG_WRN("Fault injection: CCS811 hung");
+			faults.ccs811_hung = true;
+		}
+		break;
+	}
+
+	return -EIO;
+}
+
+int sim_i2c_recover(void)
+{
+	faults.bus_stuck = false;
+
+	return 0;
+}
+
+static void synthetic_row(struct sim_trace *trace, uint32_t now_ms, struct sim_row *row)
+{
+	uint32_t time = SIM_START_S + now_ms / MSEC_PER_SEC;
+	uint32_t clock = time % SIM_DAY_S;
+	double day = (double)clock / SIM_DAY_S;
+	double weather = (double)(time % (3 * SIM_DAY_S)) / (3 * SIM_DAY_S);
+	bool occupied = (clock >= 9 * 3600 && clock < 12 * 3600) || (clock >= 13 * 3600 && clock < 17 * 3600 + 1800);
+	double minutes = (double)(now_ms - trace->time_ms) / (60 * MSEC_PER_SEC);
+
+	trace->time_ms = now_ms;
+	if (occupied)
+	{
+		trace->co2 = MIN(trace->co2 + 8.0 * minutes, 2000.0);
+	}
+	else
+	{
+		trace->co2 = MAX(trace->co2 - 12.0 * minutes, 420.0);
+	}
+
+	/* daily minimum at 04:00 */
+	double cycle = sim_sin(day >= 10.0 / 24 ? day - 10.0 / 24 : day + 14.0 / 24);
+
+	row->time_ms = now_ms;
+	row->temp = (fxp_t)((21.0 + 1.5 * cycle + (occupied ? 0.8 : 0.0) + 0.05 * sim_noise(trace)) * FXP_SCALE);
+	row->press = (fxp_t)((101.3 + 0.3 * sim_sin(weather) + 0.002 * sim_noise(trace)) * FXP_SCALE);
+	row->humidity = (fxp_t)((45.0 - 5.0 * cycle + (occupied ? 3.0 : 0.0) + 0.2 * sim_noise(trace)) * FXP_SCALE);
+	row->co2 = fxp_from_int((int32_t)(trace->co2 + 5.0 * sim_noise(trace)));
+	row->tvoc = fxp_from_int((int32_t)MAX((trace->co2 - 400.0) / 4.0 + 3.0 * sim_noise(trace), 0.0));
+}
+
+static int trace_open(struct sim_trace *trace, const char *name)
+{
+	trace->random = 0x2545f491 ^ (uint32_t)(uintptr_t)trace;
+	trace->co2 = 420.0;
+	if (trace_path == NULL)
+	{
+		synthetic_row(trace, 0, &trace->row);
+		return 0;
+	}
+
+	trace->file = fopen(trace_path, "r");
+	if (trace->file == NULL || !trace_read_row(trace, &trace->row))
+	{
+		LOG_ERR("%s: Cannot read trace %s", name, trace_path);
+		return -EIO;
+	}
+	trace->has_next = trace_read_row(trace, &trace->next);
+	LOG_INF("%s: Replaying %s", name, trace_path);
+
+	return 0;
+}
+
+/* Returns the row current at the uptime now_ms
+*/
+static const struct sim_row *trace_get(struct sim_trace *trace, uint32_t now_ms)
+{
+	if (trace->file == NULL)
+	{
+		synthetic_row(trace, now_ms, &trace->row);
+		return &trace->row;
+	}
+
+	while (trace->has_next && trace->next.time_ms <= now_ms)
+	{
+		trace->row = trace->next;
+		trace->has_next = trace_read_row(trace, &trace->next);
+		if (!trace->has_next)
+		{
+			LOG_INF("End of trace");
+		}
+	}
+
+	return &trace->row;
+}
+
+/* Simulated BME280 ...
+*/
+struct sim_bme280_data
+{
+	struct sim_trace trace;
+	struct sim_row sample;
+};
+
+static struct sim_bme280_data sim_bme280_data;
+
+static int sim_bme280_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+	struct sim_bme280_data *data = dev->data;
+	int rc = sim_fault(false);
+
+	if (rc)
+	{
+		return rc;
+	}
+	data->sample = *trace_get(&data->trace, k_uptime_get_32());
+
+	return 0;
+}
+
+static int sim_bme280_channel_get(const struct device *dev, enum sensor_channel chan,
+								  struct sensor_value *val)
+{
+	struct sim_bme280_data *data = dev->data;
+
+	switch (chan)
+	{
+	case SENSOR_CHAN_AMBIENT_TEMP:
+		fxp_to_sensor_value(data->sample.temp, val);
+		break;
+	case SENSOR_CHAN_PRESS:
+		fxp_to_sensor_value(data->sample.press, val);
+		break;
+	case SENSOR_CHAN_HUMIDITY:
+		fxp_to_sensor_value(data->sample.humidity, val);
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+static const struct sensor_driver_api sim_bme280_api = {
+	.sample_fetch = sim_bme280_sample_fetch,
+	.channel_get = sim_bme280_channel_get,
+};
+
+static int sim_bme280_init(const struct device *dev)
+{
+	struct sim_bme280_data *data = dev->data;
+
+	return trace_open(&data->trace, SIM_BME280_LABEL);
+}
+
+DEVICE_AND_API_INIT(sim_bme280, SIM_BME280_LABEL, sim_bme280_init, &sim_bme280_data, NULL,
+					POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY, &sim_bme280_api);
+
+/* Simulated CCS811 ...
+ * Emulates the parts of the driver's extended API used by the application:
+ * Result and status (data ready unless idle), firmware version (2.0, so
+ * stale data is detected), baseline and environmental data.
+*/
+struct sim_ccs811_data
+{
+	struct sim_trace trace;
+	struct sim_row sample;
+	struct ccs811_result_type result;
+	uint8_t mode;
+	uint16_t baseline;
+};
+
+static struct sim_ccs811_data sim_ccs811_data = {
+	.mode = 1,
+	.baseline = 0x847b,
+};
+
+static int sim_ccs811_sample_fetch(const struct device *dev, enum sensor_channel chan)
+{
+	struct sim_ccs811_data *data = dev->data;
+	int rc = sim_fault(true);
+
+	if (rc)
+	{
+		return rc;
+	}
+	data->result.status = CCS811_STATUS_APP_MODE;
+	if (data->mode != 0)
+	{
+		data->sample = *trace_get(&data->trace, k_uptime_get_32());
+		data->result.status |= CCS811_STATUS_DATA_READY;
+	}
+	data->result.co2 = (uint16_t)fxp_to_int(data->sample.co2);
+	data->result.voc = (uint16_t)fxp_to_int(data->sample.tvoc);
+
+	return 0;
+}
+
+static int sim_ccs811_channel_get(const struct device *dev, enum sensor_channel chan,
+								  struct sensor_value *val)
+{
+	struct sim_ccs811_data *data = dev->data;
+
+	switch (chan)
+	{
+	case SENSOR_CHAN_CO2:
+		fxp_to_sensor_value(data->sample.co2, val);
+		break;
+	case SENSOR_CHAN_VOC:
+		fxp_to_sensor_value(data->sample.tvoc, val);
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+static const struct sensor_driver_api sim_ccs811_api = {
+	.sample_fetch = sim_ccs811_sample_fetch,
+	.channel_get = sim_ccs811_channel_get,
+};
+
+static int sim_ccs811_init(const struct device *dev)
+{
+	struct sim_ccs811_data *data = dev->data;
+
+	return trace_open(&data->trace, SIM_CCS811_LABEL);
+}
+
+DEVICE_AND_API_INIT(sim_ccs811, SIM_CCS811_LABEL, sim_ccs811_init, &sim_ccs811_data, NULL,
+					POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY, &sim_ccs811_api);
+
+const struct ccs811_result_type *ccs811_result(const struct device *dev)
+{
+	struct sim_ccs811_data *data = dev->data;
+
+	return &data->result;
+}
+
+int ccs811_configver_fetch(const struct device *dev, struct ccs811_configver_type *ptr)
+{
+	struct sim_ccs811_data *data = dev->data;
+
+	ptr->hw_version = 0x12;
+	ptr->fw_boot_version = 0x1000;
+	ptr->fw_app_version = 0x2000;
+	ptr->mode = data->mode << 4;
+
+	return 0;
+}
+
+int ccs811_baseline_fetch(const struct device *dev)
+{
+	struct sim_ccs811_data *data = dev->data;
+
+	return data->baseline;
+}
+
+int ccs811_baseline_update(const struct device *dev, uint16_t baseline)
+{
+	struct sim_ccs811_data *data = dev->data;
+
+	data->baseline = baseline;
+
+	return 0;
+}
+
+int ccs811_envdata_update(const struct device *dev,
+						  const struct sensor_value *temperature,
+						  const struct sensor_value *humidity)
+{
+	return 0;
+}
+
+int sim_ccs811_set_drive_mode(uint8_t mode)
+{
+	if (mode > 4)
+	{
+		return -EINVAL;
+	}
+	sim_ccs811_data.mode = mode;
+
+	return 0;
+}
+
+int sim_ccs811_reset(uint8_t mode)
+{
+	faults.ccs811_hung = false;
+
+	return sim_ccs811_set_drive_mode(mode);
+}
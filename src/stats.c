@@ -0,0 +1,445 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <errno.h>
+#include <string.h>
+
+#include "stats.h"
+
+#define STATS_MINUTE_MS (60 * MSEC_PER_SEC)
+#define STATS_HOUR_MS (60 * STATS_MINUTE_MS)
+
+static const uint32_t window_ms[STATS_WINDOW_COUNT] = {
+	[STATS_WINDOW_15MIN] = 15 * STATS_MINUTE_MS,
+	[STATS_WINDOW_1H] = STATS_HOUR_MS,
+	[STATS_WINDOW_8H] = 8 * STATS_HOUR_MS,
+	[STATS_WINDOW_24H] = 24 * STATS_HOUR_MS,
+};
+
+/* Percentile bins per channel: STATS_BINS bins of 'width' from 'low' on,
+ * values outside count in the first or last bin
+*/
+static const struct
+{
+	fxp_t low;
+	fxp_t width;
+} bin_ranges[RECORD_CHAN_COUNT] = {
+	[RECORD_CHAN_TEMP] = {-10000, 1000},			   /* -10 - 54 °C */
+	[RECORD_CHAN_PRESS] = {90000, 320},				   /* 900 - 1104.8 hPa */
+	[RECORD_CHAN_HUMIDITY] = {0, 1600},				   /* 0 - 102.4 %RH */
+	[RECORD_CHAN_CO2] = {400 * FXP_SCALE, 80 * FXP_SCALE}, /* 400 - 5520 ppm */
+	[RECORD_CHAN_TVOC] = {0, 25 * FXP_SCALE},		   /* 0 - 1600 ppb */
+};
+
+static const enum record_channel exposure_channels[STATS_EXPOSURE_COUNT] = {
+	[STATS_EXPOSURE_CO2] = RECORD_CHAN_CO2,
+	[STATS_EXPOSURE_TVOC] = RECORD_CHAN_TVOC,
+};
+
+static const fxp_t exposure_thresholds[STATS_EXPOSURE_COUNT] = {
+	[STATS_EXPOSURE_CO2] = CONFIG_APP_STATS_CO2_THRESHOLD * FXP_SCALE,
+	[STATS_EXPOSURE_TVOC] = CONFIG_APP_STATS_TVOC_THRESHOLD * FXP_SCALE,
+};
+
+/* Exposure units: The open bucket accumulates 1/1000 ppm·ms, completed
+ * buckets keep ppm·s.
+*/
+#define EXPOSURE_BUCKET_DIVISOR ((uint64_t)FXP_SCALE * MSEC_PER_SEC)
+
+/* Deque of bucket slots, oldest first
+*/
+struct deque
+{
+	uint8_t slots[STATS_BUCKETS];
+	uint8_t head;
+	uint8_t count;
+};
+
+/* Per window and channel: Ring of the completed buckets (indexed by slot)
+ * and the accumulator of the open bucket
+*/
+struct channel_state
+{
+	fxp_t mean[STATS_BUCKETS];
+	fxp_t min[STATS_BUCKETS];
+	fxp_t max[STATS_BUCKETS];
+	struct deque min_deque; /* ascending minima */
+	struct deque max_deque; /* descending maxima */
+	uint8_t bins[STATS_BINS];
+	int64_t sum; /* mean x count of the completed buckets */
+	fxp_t bucket_p50;
+	fxp_t bucket_p95;
+	int64_t acc_sum;
+	fxp_t acc_min;
+	fxp_t acc_max;
+};
+
+struct window_state
+{
+	uint16_t count[STATS_BUCKETS];
+	uint32_t exposure[STATS_EXPOSURE_COUNT][STATS_BUCKETS]; /* ppm·s */
+	uint64_t exposure_sum[STATS_EXPOSURE_COUNT];			/* ppm·s, completed buckets */
+	uint64_t acc_exposure[STATS_EXPOSURE_COUNT];			/* 1/1000 ppm·ms, open bucket */
+	uint32_t total;											/* records in the completed buckets */
+	uint32_t acc_count;										/* records in the open bucket */
+	uint32_t start;											/* start of the open bucket */
+	uint8_t head;											/* slot of the open bucket */
+	uint8_t completed;										/* completed buckets in the window */
+	uint8_t used;											/* ... of these holding records */
+	bool started;
+	struct channel_state channels[RECORD_CHAN_COUNT];
+};
+
+static struct
+{
+	struct window_state windows[STATS_WINDOW_COUNT];
+	fxp_t last_values[STATS_EXPOSURE_COUNT];
+	uint32_t last_timestamp;
+	bool started;
+	uint64_t exposure_total[STATS_EXPOSURE_COUNT]; /* 1/1000 ppm·ms */
+} stats;
+
+BUILD_ASSERT(sizeof(stats) <= STATS_RAM_BUDGET, "Statistics exceed their RAM budget");
+BUILD_ASSERT(STATS_BUCKETS <= UINT8_MAX, "Too many buckets");
+
+static struct k_spinlock stats_lock;
+
+/* Monotonic deques ...
+ * Pushing a bucket drops all younger ones it dominates from the back, so
+ * the front always holds the extremum of the buckets in the deque. Buckets
+ * leave the window in age order, so an expiring bucket is either at the
+ * front or has been dropped already.
+*/
+static inline uint8_t deque_slot(const struct deque *d, uint8_t i)
+{
+	return d->slots[(d->head + i) % STATS_BUCKETS];
+}
+
+static void deque_push(struct deque *d, const fxp_t *values, uint8_t slot, bool ascending)
+{
+	while (d->count > 0)
+	{
+		fxp_t back = values[deque_slot(d, d->count - 1)];
+
+		if (ascending ? back < values[slot] : back > values[slot])
+		{
+			break;
+		}
+		d->count--;
+	}
+	d->slots[(d->head + d->count) % STATS_BUCKETS] = slot;
+	d->count++;
+}
+
+static void deque_expire(struct deque *d, uint8_t slot)
+{
+	if (d->count > 0 && d->slots[d->head] == slot)
+	{
+		d->head = (d->head + 1) % STATS_BUCKETS;
+		d->count--;
+	}
+}
+
+static inline unsigned int bin_of(enum record_channel channel, fxp_t value)
+{
+	int32_t bin = (value - bin_ranges[channel].low) / bin_ranges[channel].width;
+
+	return CLAMP(bin, 0, STATS_BINS - 1);
+}
+
+/* Percentile (given in 1/1000) of the 'n' values in the bins, interpolated
+ * within the bin (values assumed evenly spread)
+*/
+static fxp_t bins_percentile(const struct channel_state *c, enum record_channel channel,
+							 uint32_t n, unsigned int permille)
+{
+	uint32_t rank = MAX(((uint64_t)n * permille + 999) / 1000, 1);
+	uint32_t seen = 0;
+
+	for (unsigned int i = 0; i < STATS_BINS; i++)
+	{
+		if (seen + c->bins[i] >= rank)
+		{
+			int32_t position = 2 * (int32_t)(rank - seen) - 1; /* in half values */
+
+			return bin_ranges[channel].low + bin_ranges[channel].width * (int32_t)i +
+				   bin_ranges[channel].width * position / (2 * c->bins[i]);
+		}
+		seen += c->bins[i];
+	}
+
+	return bin_ranges[channel].low + bin_ranges[channel].width * STATS_BINS;
+}
+
+static void accumulator_reset(struct window_state *s)
+{
+	s->acc_count = 0;
+	for (int e = 0; e < STATS_EXPOSURE_COUNT; e++)
+	{
+		s->acc_exposure[e] = 0;
+	}
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		s->channels[ch].acc_sum = 0;
+		s->channels[ch].acc_min = INT32_MAX;
+		s->channels[ch].acc_max = INT32_MIN;
+	}
+}
+
+static void window_reset(struct window_state *s, uint32_t start)
+{
+	memset(s, 0, sizeof(*s));
+	s->start = start;
+	s->started = true;
+	accumulator_reset(s);
+}
+
+/* Removes the oldest completed bucket from the window
+*/
+static void bucket_expire(struct window_state *s, uint8_t slot)
+{
+	for (int e = 0; e < STATS_EXPOSURE_COUNT; e++)
+	{
+		s->exposure_sum[e] -= s->exposure[e][slot];
+	}
+
+	if (s->count[slot] > 0)
+	{
+		for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+		{
+			struct channel_state *c = &s->channels[ch];
+
+			c->sum -= (int64_t)c->mean[slot] * s->count[slot];
+			c->bins[bin_of(ch, c->mean[slot])]--;
+			deque_expire(&c->min_deque, slot);
+			deque_expire(&c->max_deque, slot);
+		}
+		s->total -= s->count[slot];
+		s->used--;
+	}
+	s->completed--;
+}
+
+/* Completes the open bucket and opens the next one ...
+ * The window holds STATS_BUCKETS - 1 completed buckets besides the open
+ * one, so once full, the oldest bucket expires, freeing the slot for the
+ * next open bucket.
+*/
+static void bucket_close(struct window_state *s)
+{
+	uint8_t slot = s->head;
+
+	s->count[slot] = s->acc_count;
+	for (int e = 0; e < STATS_EXPOSURE_COUNT; e++)
+	{
+		s->exposure[e][slot] = s->acc_exposure[e] / EXPOSURE_BUCKET_DIVISOR;
+		s->exposure_sum[e] += s->exposure[e][slot];
+	}
+
+	if (s->acc_count > 0)
+	{
+		for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+		{
+			struct channel_state *c = &s->channels[ch];
+
+			c->mean[slot] = c->acc_sum / s->acc_count;
+			c->min[slot] = c->acc_min;
+			c->max[slot] = c->acc_max;
+			c->sum += (int64_t)c->mean[slot] * s->acc_count;
+			c->bins[bin_of(ch, c->mean[slot])]++;
+			deque_push(&c->min_deque, c->min, slot, true);
+			deque_push(&c->max_deque, c->max, slot, false);
+		}
+		s->total += s->acc_count;
+		s->used++;
+	}
+	s->completed++;
+
+	s->head = (slot + 1) % STATS_BUCKETS;
+	if (s->completed == STATS_BUCKETS)
+	{
+		bucket_expire(s, s->head);
+	}
+	accumulator_reset(s);
+
+	/* Percentiles change with the completed buckets only: Evaluate them
+	 * once per bucket
+	*/
+	if (s->used > 0)
+	{
+		for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+		{
+			struct channel_state *c = &s->channels[ch];
+			fxp_t min = c->min[c->min_deque.slots[c->min_deque.head]];
+			fxp_t max = c->max[c->max_deque.slots[c->max_deque.head]];
+
+			c->bucket_p50 = CLAMP(bins_percentile(c, ch, s->used, 500), min, max);
+			c->bucket_p95 = CLAMP(bins_percentile(c, ch, s->used, 950), min, max);
+		}
+	}
+}
+
+static void window_add(struct window_state *s, enum stats_window window,
+					   const struct iaq_record *record, const uint64_t *exposure)
+{
+	uint32_t bucket_ms = window_ms[window] / STATS_BUCKETS;
+
+	/* Start over after a gap longer than the window, else complete the
+	 * buckets passed since the last record (at most the whole window)
+	*/
+	if (!s->started || record->timestamp - s->start >= window_ms[window])
+	{
+		window_reset(s, record->timestamp);
+	}
+	while (record->timestamp - s->start >= bucket_ms)
+	{
+		bucket_close(s);
+		s->start += bucket_ms;
+	}
+
+	s->acc_count++;
+	for (int e = 0; e < STATS_EXPOSURE_COUNT; e++)
+	{
+		s->acc_exposure[e] += exposure[e];
+	}
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		struct channel_state *c = &s->channels[ch];
+		fxp_t value = record->values[ch];
+
+		c->acc_sum += value;
+		c->acc_min = MIN(c->acc_min, value);
+		c->acc_max = MAX(c->acc_max, value);
+	}
+}
+
+void stats_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	memset(&stats, 0, sizeof(stats));
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+/* Adds a record to all windows ...
+ * The exposure since the previous record is attributed to the bucket of
+ * this record.
+*/
+void stats_add(const struct iaq_record *record)
+{
+	uint64_t exposure[STATS_EXPOSURE_COUNT] = {0};
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	if (stats.started)
+	{
+		uint32_t hold = MIN(record->timestamp - stats.last_timestamp, STATS_HOLD_MAX_MS);
+
+		for (int e = 0; e < STATS_EXPOSURE_COUNT; e++)
+		{
+			fxp_t excess = stats.last_values[e] - exposure_thresholds[e];
+
+			exposure[e] = excess > 0 ? (uint64_t)excess * hold : 0;
+			stats.exposure_total[e] += exposure[e];
+		}
+	}
+	for (int e = 0; e < STATS_EXPOSURE_COUNT; e++)
+	{
+		stats.last_values[e] = record->values[exposure_channels[e]];
+	}
+	stats.last_timestamp = record->timestamp;
+	stats.started = true;
+
+	for (int w = 0; w < STATS_WINDOW_COUNT; w++)
+	{
+		window_add(&stats.windows[w], w, record, exposure);
+	}
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+/* Gets the statistics of a channel over a window, -ENODATA if the window
+ * holds no records
+*/
+int stats_get(enum stats_window window, enum record_channel channel, struct stats_value *value)
+{
+	const struct window_state *s = &stats.windows[window];
+	const struct channel_state *c = &s->channels[channel];
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	uint32_t n = s->total + s->acc_count;
+
+	if (n == 0)
+	{
+		k_spin_unlock(&stats_lock, key);
+		return -ENODATA;
+	}
+
+	value->count = n;
+	value->mean = (c->sum + c->acc_sum) / n;
+	value->min = c->acc_min;
+	value->max = c->acc_max;
+	if (c->min_deque.count > 0)
+	{
+		value->min = MIN(value->min, c->min[c->min_deque.slots[c->min_deque.head]]);
+		value->max = MAX(value->max, c->max[c->max_deque.slots[c->max_deque.head]]);
+	}
+	if (s->used > 0)
+	{
+		value->bucket_p50 = c->bucket_p50;
+		value->bucket_p95 = c->bucket_p95;
+	}
+	else
+	{
+		/* First bucket still open: No percentiles yet
+		*/
+		value->bucket_p50 = value->mean;
+		value->bucket_p95 = value->mean;
+	}
+
+	k_spin_unlock(&stats_lock, key);
+
+	return 0;
+}
+
+/* Gets the exposure over a window in 1/1000 ppm·h (ppb·h)
+*/
+fxp_t stats_get_exposure(enum stats_window window, enum stats_exposure exposure)
+{
+	const struct window_state *s = &stats.windows[window];
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	uint64_t fxp_s = s->exposure_sum[exposure] * FXP_SCALE + s->acc_exposure[exposure] / MSEC_PER_SEC;
+
+	k_spin_unlock(&stats_lock, key);
+
+	return (fxp_t)MIN(fxp_s / (STATS_HOUR_MS / MSEC_PER_SEC), INT32_MAX);
+}
+
+/* Gets the exposure since boot in 1/1000 ppm·h (ppb·h)
+*/
+fxp_t stats_get_exposure_total(enum stats_exposure exposure)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	uint64_t total = stats.exposure_total[exposure];
+
+	k_spin_unlock(&stats_lock, key);
+
+	return (fxp_t)MIN(total / STATS_HOUR_MS, INT32_MAX);
+}
@@ -0,0 +1,99 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <zephyr.h>
+
+#include "fxp.h"
+#include "record.h"
+
+/* Rolling statistics and exposure (CONFIG_APP_STATS) ...
+ * Each window is split into STATS_BUCKETS time buckets of window / buckets.
+ * The window covers the completed buckets and the currently open one, so
+ * it slides in steps of one bucket (30 s for the 15 minute window, 48 min
+ * for the 24 hour window). All state is updated incrementally, at constant
+ * cost per record; nothing is rescanned:
+ *
+ * Mean: running sum of the bucket sums (mean x count) and sample counts.
+ *
+ * Min / max: monotonic deques of the completed buckets (ascending minima,
+ * descending maxima) plus the open bucket.
+ *
+ * Bucket percentiles: histogram of the bucket means of the completed
+ * buckets over STATS_BINS linear bins per channel (see stats.c for the
+ * ranges), updated as buckets enter and leave the window and evaluated with
+ * interpolation within the bin once per bucket. These are percentiles of
+ * the (at most STATS_BUCKETS - 1) bucket means, e.g. of the 2 minute means
+ * for the 1 hour window, not of the individual records; short peaks are
+ * averaged out. Resolution: 1/STATS_BINS of the channel's range.
+ *
+ * Exposure: time integral of the eCO2 / TVOC concentration above
+ * CONFIG_APP_STATS_CO2_THRESHOLD / CONFIG_APP_STATS_TVOC_THRESHOLD, per
+ * window and since boot. Each record's value is held until the next one,
+ * for at most STATS_HOLD_MAX_MS.
+ *
+ * Records are added by the main thread; the getters may be called from any
+ * thread.
+*/
+#define STATS_BUCKETS 30
+#define STATS_BINS 64
+#define STATS_HOLD_MAX_MS (2 * 60 * MSEC_PER_SEC)
+
+#define STATS_RAM_BUDGET (12 * 1024)
+
+enum stats_window
+{
+	STATS_WINDOW_15MIN,
+	STATS_WINDOW_1H,
+	STATS_WINDOW_8H,
+	STATS_WINDOW_24H,
+	STATS_WINDOW_COUNT,
+};
+
+enum stats_exposure
+{
+	STATS_EXPOSURE_CO2,	 /* 1/1000 ppm·h */
+	STATS_EXPOSURE_TVOC, /* 1/1000 ppb·h */
+	STATS_EXPOSURE_COUNT,
+};
+
+struct stats_value
+{
+	fxp_t mean;
+	fxp_t min;
+	fxp_t max;
+	fxp_t bucket_p50; /* median of the bucket means */
+	fxp_t bucket_p95; /* 95th percentile of the bucket means */
+	uint32_t count;	  /* records in the window */
+};
+
+void stats_reset(void);
+
+void stats_add(const struct iaq_record *record);
+
+int stats_get(enum stats_window window, enum record_channel channel, struct stats_value *value);
+
+fxp_t stats_get_exposure(enum stats_window window, enum stats_exposure exposure);
+
+fxp_t stats_get_exposure_total(enum stats_exposure exposure);
+
+#endif
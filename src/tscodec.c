@@ -0,0 +1,297 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <string.h>
+
+#include "tscodec.h"
+
+/* Quantization step per channel (in fixed-point units): The resolution
+ * kept in the encoded history.
+*/
+static const int32_t quantization[RECORD_CHAN_COUNT] = {
+	[RECORD_CHAN_TEMP] = 10,	 /* 0.01 °C */
+	[RECORD_CHAN_PRESS] = 1,	 /* 1 Pa */
+	[RECORD_CHAN_HUMIDITY] = 10, /* 0.01 %RH */
+	[RECORD_CHAN_CO2] = 1000,	 /* 1 ppm */
+	[RECORD_CHAN_TVOC] = 1000,	 /* 1 ppb */
+};
+
+/* Variable-length codes: A unary prefix selects the payload size. The last
+ * class (prefix of all ones) always carries a full 32 bit payload.
+*/
+#define TSC_CODE_CLASSES 5
+
+struct tsc_code
+{
+	uint8_t payload_bits[TSC_CODE_CLASSES];
+};
+
+/* '0' | '10' + 7 | '110' + 12 | '1110' + 20 | '1111' + 32 */
+static const struct tsc_code timestamp_code = {{0, 7, 12, 20, 32}};
+
+/* '0' | '10' + 4 | '110' + 8 | '1110' + 16 | '1111' + 32 */
+static const struct tsc_code value_code = {{0, 4, 8, 16, 32}};
+
+#define IAQ_INDEX_BITS 5
+
+static inline uint32_t zigzag_encode(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t zigzag_decode(uint32_t value)
+{
+	return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline int32_t quantize(int ch, fxp_t value)
+{
+	return value / quantization[ch];
+}
+
+/* Code class for a (zig-zag encoded) value ...
+*/
+static inline int code_class(const struct tsc_code *code, uint32_t value)
+{
+	int c = 0;
+
+	if (value == 0)
+	{
+		return 0;
+	}
+	for (c = 1; c < TSC_CODE_CLASSES - 1; c++)
+	{
+		if (value < (1U << code->payload_bits[c]))
+		{
+			break;
+		}
+	}
+	return c;
+}
+
+/* Number of bits needed for a value of the given code class ...
+*/
+static inline uint8_t code_bits(const struct tsc_code *code, int c)
+{
+	uint8_t prefix = c < TSC_CODE_CLASSES - 1 ? c + 1 : c;
+
+	return prefix + code->payload_bits[c];
+}
+
+/* Bit writer / reader: MSB first, at most 32 bits at a time ...
+*/
+static void bits_put(uint8_t *data, uint16_t *bitpos, uint32_t bits, uint8_t n)
+{
+	while (n > 0)
+	{
+		uint8_t offset = *bitpos & 7U;
+		uint8_t take = MIN(8U - offset, n);
+		uint8_t chunk = (bits >> (n - take)) & ((1U << take) - 1U);
+
+		data[*bitpos >> 3] |= chunk << (8U - offset - take);
+		*bitpos += take;
+		n -= take;
+	}
+}
+
+static uint32_t bits_get(const uint8_t *data, uint16_t *bitpos, uint8_t n)
+{
+	uint32_t bits = 0;
+
+	while (n > 0)
+	{
+		uint8_t offset = *bitpos & 7U;
+		uint8_t take = MIN(8U - offset, n);
+		uint8_t chunk = (data[*bitpos >> 3] >> (8U - offset - take)) & ((1U << take) - 1U);
+
+		bits = (bits << take) | chunk;
+		*bitpos += take;
+		n -= take;
+	}
+
+	return bits;
+}
+
+static void code_put(uint8_t *data, uint16_t *bitpos, const struct tsc_code *code,
+					 int c, uint32_t value)
+{
+	/* Prefix: c ones followed by a zero (omitted for the last class) */
+	if (c < TSC_CODE_CLASSES - 1)
+	{
+		bits_put(data, bitpos, ((1U << c) - 1U) << 1, c + 1);
+	}
+	else
+	{
+		bits_put(data, bitpos, (1U << c) - 1U, c);
+	}
+	bits_put(data, bitpos, value, code->payload_bits[c]);
+}
+
+static uint32_t code_get(const uint8_t *data, uint16_t *bitpos, const struct tsc_code *code)
+{
+	int c = 0;
+
+	while (c < TSC_CODE_CLASSES - 1 && bits_get(data, bitpos, 1))
+	{
+		c++;
+	}
+	return bits_get(data, bitpos, code->payload_bits[c]);
+}
+
+void tsc_block_init(struct tsc_block *block)
+{
+	memset(block, 0, sizeof(*block));
+}
+
+/* Appends a record to a block. Returns -ENOSPC if the block is full.
+*/
+int tsc_block_add(struct tsc_block *block, const struct iaq_record *record)
+{
+	uint32_t values[RECORD_CHAN_COUNT];
+	int classes[RECORD_CHAN_COUNT];
+	int32_t quantized[RECORD_CHAN_COUNT];
+	uint32_t dod;
+	int32_t delta;
+	int ts_class;
+	uint32_t bits;
+
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		quantized[ch] = quantize(ch, record->values[ch]);
+	}
+
+	/* First record: Header only
+	*/
+	if (block->count == 0)
+	{
+		block->first_timestamp = block->last_timestamp = record->timestamp;
+		block->first_iaq_index = block->last_iaq_index = record->iaq_index;
+		block->last_delta = 0;
+		for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+		{
+			block->first_values[ch] = block->last_values[ch] = quantized[ch];
+		}
+		block->count = 1;
+		return 0;
+	}
+
+	if (block->count == UINT16_MAX)
+	{
+		return -ENOSPC;
+	}
+
+	/* Size of the encoded record ...
+	*/
+	delta = (int32_t)(record->timestamp - block->last_timestamp);
+	dod = zigzag_encode(delta - block->last_delta);
+	ts_class = code_class(&timestamp_code, dod);
+	bits = code_bits(&timestamp_code, ts_class);
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		values[ch] = zigzag_encode(quantized[ch] - block->last_values[ch]);
+		classes[ch] = code_class(&value_code, values[ch]);
+		bits += code_bits(&value_code, classes[ch]);
+	}
+	bits += record->iaq_index == block->last_iaq_index ? 1 : 1 + IAQ_INDEX_BITS;
+
+	if (block->bitpos + bits > TSC_BLOCK_SIZE * 8)
+	{
+		return -ENOSPC;
+	}
+
+	/* ... and encode it
+	*/
+	code_put(block->data, &block->bitpos, &timestamp_code, ts_class, dod);
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		code_put(block->data, &block->bitpos, &value_code, classes[ch], values[ch]);
+		block->last_values[ch] = quantized[ch];
+	}
+	if (record->iaq_index == block->last_iaq_index)
+	{
+		bits_put(block->data, &block->bitpos, 0, 1);
+	}
+	else
+	{
+		bits_put(block->data, &block->bitpos, 1, 1);
+		bits_put(block->data, &block->bitpos, record->iaq_index, IAQ_INDEX_BITS);
+	}
+
+	block->last_timestamp = record->timestamp;
+	block->last_delta = delta;
+	block->last_iaq_index = record->iaq_index;
+	block->count++;
+
+	return 0;
+}
+
+void tsc_iter_init(struct tsc_iter *iter, const struct tsc_block *block)
+{
+	iter->block = block;
+	iter->index = 0;
+	iter->bitpos = 0;
+}
+
+/* Decodes the next record of the block. Returns false at the end of the block.
+*/
+bool tsc_iter_next(struct tsc_iter *iter, struct iaq_record *record)
+{
+	const struct tsc_block *block = iter->block;
+
+	if (iter->index >= block->count)
+	{
+		return false;
+	}
+
+	if (iter->index == 0)
+	{
+		iter->timestamp = block->first_timestamp;
+		iter->delta = 0;
+		iter->iaq_index = block->first_iaq_index;
+		for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+		{
+			iter->values[ch] = block->first_values[ch];
+		}
+	}
+	else
+	{
+		iter->delta += zigzag_decode(code_get(block->data, &iter->bitpos, &timestamp_code));
+		iter->timestamp += iter->delta;
+		for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+		{
+			iter->values[ch] += zigzag_decode(code_get(block->data, &iter->bitpos, &value_code));
+		}
+		if (bits_get(block->data, &iter->bitpos, 1))
+		{
+			iter->iaq_index = bits_get(block->data, &iter->bitpos, IAQ_INDEX_BITS);
+		}
+	}
+
+	record->timestamp = iter->timestamp;
+	for (int ch = 0; ch < RECORD_CHAN_COUNT; ch++)
+	{
+		record->values[ch] = iter->values[ch] * quantization[ch];
+	}
+	record->iaq_index = iter->iaq_index;
+	iter->index++;
+
+	return true;
+}
@@ -0,0 +1,77 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TSCODEC_H
+#define __TSCODEC_H
+
+#include <zephyr.h>
+
+#include "record.h"
+
+/* Streaming time-series codec for records ...
+ * Records are encoded into fixed-size blocks. The first record of a block is
+ * stored uncompressed in the block header, all further records are encoded
+ * as variable-length bit codes:
+ * - timestamp: delta-of-delta (ms)
+ * - channel values: zig-zag encoded delta of the quantized value
+ * - IAQ index: repeat flag or 5 bit value
+ * Encoding a record takes a constant number of operations; a block can be
+ * decoded incrementally, record by record.
+*/
+#define TSC_BLOCK_SIZE 512 /* bytes of encoded data per block */
+
+struct tsc_block
+{
+	/* Header: first record (quantized) and the time range of the block */
+	uint32_t first_timestamp;
+	uint32_t last_timestamp;
+	int32_t first_values[RECORD_CHAN_COUNT];
+	uint8_t first_iaq_index;
+	uint16_t count;	 /* number of records in the block */
+	uint16_t bitpos; /* bits used in data */
+
+	/* Encoder state (last record, last timestamp delta) */
+	int32_t last_values[RECORD_CHAN_COUNT];
+	uint8_t last_iaq_index;
+	int32_t last_delta;
+
+	uint8_t data[TSC_BLOCK_SIZE];
+};
+
+struct tsc_iter
+{
+	const struct tsc_block *block;
+	uint16_t index;
+	uint16_t bitpos;
+	uint32_t timestamp;
+	int32_t delta;
+	int32_t values[RECORD_CHAN_COUNT];
+	uint8_t iaq_index;
+};
+
+void tsc_block_init(struct tsc_block *block);
+
+int tsc_block_add(struct tsc_block *block, const struct iaq_record *record);
+
+void tsc_iter_init(struct tsc_iter *iter, const struct tsc_block *block);
+
+bool tsc_iter_next(struct tsc_iter *iter, struct iaq_record *record);
+
+#endif
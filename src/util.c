@@ -0,0 +1,66 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <zephyr.h>
+#include <init.h>
+#include <stdio.h>
+#include <logging/log_ctrl.h>
+
+#include "util.h"
+
+/* Auxiliary function: Format time string (H:MM:SS[.MMM]) into the caller's
+ * buffer (TIME_STR_LEN).
+*/
+char *time_str(char *buf, size_t size, uint32_t time, bool with_millis)
+{
+	unsigned int ms = time % MSEC_PER_SEC;
+	unsigned int s;
+	unsigned int min;
+	unsigned int h;
+
+	time /= MSEC_PER_SEC;
+	s = time % 60U;
+	time /= 60U;
+	min = time % 60U;
+	time /= 60U;
+	h = time;
+	if (with_millis)
+		snprintf(buf, size, "%u:%02u:%02u.%03u",
+				 h, min, s, ms);
+	else
+		snprintf(buf, size, "%u:%02u:%02u",
+				 h, min, s);
+
+	return buf;
+}
+
+/* Log timestamps: Uptime in ms instead of the hardware cycle counter (which
+ * wraps after 36 hours with the 32 kHz RTC), formatted by the log backend.
+*/
+#if defined(CONFIG_LOG)
+static int log_timestamp_init(const struct device *dev)
+{
+	ARG_UNUSED(dev);
+
+	return log_set_timestamp_func(k_uptime_get_32, MSEC_PER_SEC);
+}
+
+SYS_INIT(log_timestamp_init, PRE_KERNEL_1, 0);
+#endif
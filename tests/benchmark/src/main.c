@@ -0,0 +1,98 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ztest.h>
+
+#include "benchmark.h"
+
+/* Benchmark suite: The benchmarks of the processing (see benchmark.h), one
+ * test each. The results are printed as BENCH lines like by the benchmark
+ * firmware; the tests check that each benchmark ran all its calls.
+ * benchmark_iaq_rating() rates the results of benchmark_iaq_index_batch(),
+ * so the order matters.
+*/
+static void test_iaq_index(void)
+{
+	zassert_equal(benchmark_iaq_index(), BENCHMARK_CALLS, "get_iaq_index not run");
+}
+
+static void test_iaq_index_batch(void)
+{
+	uint32_t calls = benchmark_iaq_index_batch();
+
+	zassert_true(calls >= BENCHMARK_INPUTS, "get_iaq_index_batch not run");
+	zassert_equal(calls % BENCHMARK_INPUTS, 0, "Incomplete batch");
+}
+
+static void test_iaq_rating(void)
+{
+	zassert_equal(benchmark_iaq_rating(), BENCHMARK_CALLS, "get_iaq_rating not run");
+}
+
+static void test_fxp_format(void)
+{
+	zassert_equal(benchmark_fxp_format(), BENCHMARK_CALLS, "fxp_format not run");
+}
+
+static void test_time_str(void)
+{
+	zassert_equal(benchmark_time_str(), BENCHMARK_CALLS, "time_str not run");
+}
+
+static void test_filter(void)
+{
+#if defined(CONFIG_APP_FILTER)
+	zassert_equal(benchmark_filter(), BENCHMARK_CALLS, "filter_sample not run");
+#else
+	ztest_test_skip();
+#endif
+}
+
+static void test_stats(void)
+{
+#if defined(CONFIG_APP_STATS)
+	zassert_equal(benchmark_stats(), BENCHMARK_CALLS, "stats_add not run");
+#else
+	ztest_test_skip();
+#endif
+}
+
+static void test_tsc_encode(void)
+{
+	zassert_equal(benchmark_tsc_encode(), BENCHMARK_CALLS, "tsc_encode not run");
+}
+
+void test_main(void)
+{
+	benchmark_begin();
+
+	ztest_test_suite(benchmark,
+					 ztest_unit_test(test_iaq_index),
+					 ztest_unit_test(test_iaq_index_batch),
+					 ztest_unit_test(test_iaq_rating),
+					 ztest_unit_test(test_fxp_format),
+					 ztest_unit_test(test_time_str),
+					 ztest_unit_test(test_filter),
+					 ztest_unit_test(test_stats),
+					 ztest_unit_test(test_tsc_encode));
+	ztest_run_test_suite(benchmark);
+
+	benchmark_end();
+}
@@ -0,0 +1,218 @@
+/*
+SPDX-License-Identifier: GPL-3.0-or-later
+
+iaq-monitor-demo
+Copyright (C) 2021  dxcfl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ztest.h>
+#include <errno.h>
+#include <string.h>
+
+#include "gateway.h"
+
+/* Replay of captured advertisements through the gateway's decoder and
+ * aggregator (no Bluetooth stack). The test configuration (prj.conf) has
+ * room for 4 nodes, which time out after 10 s.
+*/
+#define T0 1000U
+#define TIMEOUT_MS GATEWAY_NODE_TIMEOUT_MS
+
+/* Advertising data of a monitor as captured by the scanner: Flags,
+ * Environmental Sensing Service and the IAQ payload (company 0xffff,
+ * version 1, seq 7, 21.50 °C, 45.00 %RH, 1013.3 hPa, 850 ppm eCO2,
+ * 120 ppb TVOC, IAQ index 4)
+*/
+static const uint8_t adv_monitor[] = {
+	0x02, 0x01, 0x06,
+	0x03, 0x03, 0x1a, 0x18,
+	0x11, 0xff, 0xff, 0xff, 0x01, 0x07, 0x66, 0x08, 0x94, 0x11,
+	0x95, 0x27, 0x52, 0x03, 0x78, 0x00, 0x04, 0x00};
+
+/* The same monitor after a change: seq 8, 1200 ppm eCO2, IAQ index 2
+*/
+static const uint8_t adv_monitor_next[] = {
+	0x02, 0x01, 0x06,
+	0x03, 0x03, 0x1a, 0x18,
+	0x11, 0xff, 0xff, 0xff, 0x01, 0x08, 0x66, 0x08, 0x94, 0x11,
+	0x95, 0x27, 0xb0, 0x04, 0x78, 0x00, 0x02, 0x00};
+
+/* Other devices: Another company's manufacturer data and a device
+ * name only
+*/
+static const uint8_t adv_foreign[] = {
+	0x02, 0x01, 0x06,
+	0x05, 0xff, 0x59, 0x00, 0x01, 0x02};
+
+static const uint8_t adv_name[] = {
+	0x02, 0x01, 0x06,
+	0x05, 0x09, 'T', 'a', 'g', '1'};
+
+static const struct gateway_addr addr_a = {.type = 0, .val = {0x01, 0x00, 0x00, 0x00, 0x00, 0xc0}};
+static const struct gateway_addr addr_b = {.type = 0, .val = {0x02, 0x00, 0x00, 0x00, 0x00, 0xc0}};
+
+static struct gateway_addr node_addr(uint8_t n)
+{
+	struct gateway_addr addr = {.type = 1, .val = {n, 0x10, 0x00, 0x00, 0x00, 0xc0}};
+
+	return addr;
+}
+
+static void test_decode(void)
+{
+	struct gateway_summary summary;
+	struct gateway_node node;
+
+	zassert_equal(gateway_process_adv(&addr_a, -60, adv_monitor, sizeof(adv_monitor), T0), 0,
+				  "Payload not decoded");
+
+	gateway_get_summary(&summary, T0);
+	zassert_equal(summary.nodes, 1, "Unexpected node count");
+	zassert_equal(summary.worst_iaq_index, 4, "Unexpected IAQ index");
+	zassert_equal(summary.co2_max, fxp_from_int(850), "Unexpected eCO2");
+
+	zassert_equal(gateway_get_nodes(&node, 1, T0), 1, "Node not listed");
+	zassert_equal(node.seq, 7, "Unexpected sequence number");
+	zassert_equal(node.rssi, -60, "Unexpected RSSI");
+	zassert_equal(node.record.values[RECORD_CHAN_TEMP], 21500, "Unexpected temperature");
+	zassert_equal(node.record.values[RECORD_CHAN_HUMIDITY], 45000, "Unexpected humidity");
+	zassert_equal(node.record.values[RECORD_CHAN_PRESS], 101330, "Unexpected pressure");
+	zassert_equal(node.record.values[RECORD_CHAN_TVOC], fxp_from_int(120), "Unexpected TVOC");
+	zassert_equal(node.record.timestamp, T0, "Unexpected timestamp");
+}
+
+static void test_foreign(void)
+{
+	struct gateway_summary summary;
+
+	zassert_equal(gateway_process_adv(&addr_b, -70, adv_foreign, sizeof(adv_foreign), T0 + 100),
+				  -EINVAL, "Foreign payload decoded");
+	zassert_equal(gateway_process_adv(&addr_b, -70, adv_name, sizeof(adv_name), T0 + 100),
+				  -EINVAL, "Advertisement without payload decoded");
+
+	/* Truncated capture: The length of the last AD structure exceeds the data
+	*/
+	zassert_equal(gateway_process_adv(&addr_b, -70, adv_monitor, sizeof(adv_monitor) - 1, T0 + 100),
+				  -EINVAL, "Truncated payload decoded");
+
+	gateway_get_summary(&summary, T0 + 100);
+	zassert_equal(summary.nodes, 1, "Foreign device counted");
+}
+
+static void test_duplicate(void)
+{
+	struct gateway_summary summary;
+	struct gateway_stats before, after;
+
+	gateway_get_stats(&before);
+
+	/* Repeated advertising events of an unchanged payload
+	*/
+	zassert_equal(gateway_process_adv(&addr_a, -61, adv_monitor, sizeof(adv_monitor), T0 + 200),
+				  -EALREADY, "Duplicate not detected");
+	zassert_equal(gateway_process_adv(&addr_a, -62, adv_monitor, sizeof(adv_monitor), T0 + 300),
+				  -EALREADY, "Duplicate not detected");
+
+	/* The same payload from another node is not a duplicate
+	*/
+	zassert_equal(gateway_process_adv(&addr_b, -70, adv_monitor, sizeof(adv_monitor), T0 + 300), 0,
+				  "Other node dropped");
+
+	/* A new sequence number updates the node
+	*/
+	zassert_equal(gateway_process_adv(&addr_a, -60, adv_monitor_next, sizeof(adv_monitor_next), T0 + 400), 0,
+				  "Update dropped");
+
+	gateway_get_stats(&after);
+	zassert_equal(after.adv_received - before.adv_received, 4, "Unexpected received count");
+	zassert_equal(after.adv_decoded - before.adv_decoded, 4, "Unexpected decoded count");
+	zassert_equal(after.adv_duplicate - before.adv_duplicate, 2, "Unexpected duplicate count");
+
+	gateway_get_summary(&summary, T0 + 400);
+	zassert_equal(summary.nodes, 2, "Unexpected node count");
+	zassert_equal(summary.worst_iaq_index, 2, "Unexpected worst IAQ index");
+	zassert_equal(summary.co2_max, fxp_from_int(1200), "Unexpected eCO2 maximum");
+}
+
+static void test_timeout(void)
+{
+	struct gateway_summary summary;
+
+	/* Node B was last heard at T0 + 300, node A at T0 + 400
+	*/
+	gateway_get_summary(&summary, T0 + 300 + TIMEOUT_MS + 1);
+	zassert_equal(summary.nodes, 1, "Node B not timed out");
+	zassert_equal(summary.co2_max, fxp_from_int(1200), "Unexpected eCO2 maximum");
+
+	gateway_get_summary(&summary, T0 + 400 + TIMEOUT_MS + 1);
+	zassert_equal(summary.nodes, 0, "Node A not timed out");
+	zassert_equal(summary.worst_iaq_index, 0, "IAQ index of a gone node");
+
+	/* A node that is back after the timeout is not a duplicate
+	*/
+	zassert_equal(gateway_process_adv(&addr_a, -60, adv_monitor_next, sizeof(adv_monitor_next),
+									  T0 + 400 + TIMEOUT_MS + 1),
+				  0, "Returning node dropped");
+}
+
+static void test_eviction(void)
+{
+	uint32_t now = T0 + 3 * TIMEOUT_MS;
+	struct gateway_node nodes[GATEWAY_MAX_NODES + 1];
+	struct gateway_summary summary;
+	struct gateway_stats before, after;
+	size_t count;
+
+	gateway_get_stats(&before);
+
+	/* Fill the table with active nodes (reusing the slots of the timed
+	 * out ones), then one more: The least recently seen node is evicted.
+	*/
+	for (uint8_t n = 1; n <= GATEWAY_MAX_NODES + 1; n++)
+	{
+		struct gateway_addr addr = node_addr(n);
+
+		zassert_equal(gateway_process_adv(&addr, -50 - n, adv_monitor, sizeof(adv_monitor), now + n), 0,
+					  "Node not added");
+	}
+
+	gateway_get_stats(&after);
+	zassert_equal(after.nodes_evicted - before.nodes_evicted, 1, "Unexpected eviction count");
+
+	count = gateway_get_nodes(nodes, ARRAY_SIZE(nodes), now + GATEWAY_MAX_NODES + 1);
+	zassert_equal(count, GATEWAY_MAX_NODES, "Unexpected node count");
+	for (size_t i = 0; i < count; i++)
+	{
+		struct gateway_addr first = node_addr(1);
+
+		zassert_not_equal(memcmp(&nodes[i].addr, &first, sizeof(first)), 0, "Oldest node not evicted");
+	}
+
+	gateway_get_summary(&summary, now + GATEWAY_MAX_NODES + 1);
+	zassert_equal(summary.nodes, GATEWAY_MAX_NODES, "Unexpected summary node count");
+	zassert_equal(summary.co2_max, fxp_from_int(850), "Unexpected eCO2 maximum");
+}
+
+void test_main(void)
+{
+	ztest_test_suite(gateway,
+					 ztest_unit_test(test_decode),
+					 ztest_unit_test(test_foreign),
+					 ztest_unit_test(test_duplicate),
+					 ztest_unit_test(test_timeout),
+					 ztest_unit_test(test_eviction));
+	ztest_run_test_suite(gateway);
+}